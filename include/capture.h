@@ -0,0 +1,58 @@
+/**
+ * @file
+ * @brief Header for the console capture file
+ *
+ * FileName: include/capture.h
+ *
+ * Received console data is written to a file, each line stamped with the
+ * time its first byte came in. Writing is done from a thread of its own
+ * out of a ring buffer, so a slow disk never holds up the serial reads:
+ * when the ring is full, data is dropped and the loss noted in the file.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#ifndef __LIB_INCLUDE_CAPTURE_H
+#define __LIB_INCLUDE_CAPTURE_H
+
+/**
+ * @brief cap_open - start capturing to a file
+ *
+ * @param name - file to write (truncated)
+ *
+ * @return 0 or error
+ */
+signed int cap_open(const char *name);
+
+/**
+ * @brief cap_write - capture received data, never blocks
+ *
+ * @param buf - data
+ * @param len - length of data
+ */
+void cap_write(const unsigned char *buf, unsigned int len);
+
+/**
+ * @brief cap_close - write out what is left and close the file
+ *
+ * @return bytes dropped because the ring was full
+ */
+unsigned long cap_close(void);
+
+#endif				/* __LIB_INCLUDE_CAPTURE_H */
@@ -0,0 +1,162 @@
+/**
+ * @file
+ * @brief Header for U-Boot console helpers
+ *
+ * FileName: include/console.h
+ *
+ * Send commands to U-Boot and wait for its responses over the serial
+ * port opened with s_open.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#ifndef __LIB_INCLUDE_CONSOLE_H
+#define __LIB_INCLUDE_CONSOLE_H
+
+/**
+ * @brief con_set_echo - should received console data be shown?
+ *
+ * The echo is buffered and written out a line at a time, or once a partial
+ * line has waited for a little while.
+ *
+ * @param echo - 1 to dump received characters on stdout (default), 0 not to
+ */
+void con_set_echo(int echo);
+
+/**
+ * @brief con_set_tap - have all received data passed to a function
+ *
+ * @param tap - function getting the data, such as cap_write; NULL for none
+ */
+void con_set_tap(void (*tap) (const unsigned char *buf, unsigned int len));
+
+/**
+ * @brief con_set_pace - send command lines no faster than they echo
+ *
+ * U-Boot polls its UART, characters typed faster than it echoes them can
+ * be lost. With a window, at most that many characters are ahead of their
+ * echo, and a line which echoes wrong is killed (^U) and sent again. The
+ * target must be at its prompt when a line is sent; the echo of the line
+ * is taken in by con_send_cmd then (and still shown and tapped).
+ *
+ * @param window - characters sent ahead of their echo, 0 to write lines at
+ *	once (default)
+ */
+void con_set_pace(unsigned int window);
+
+/**
+ * @brief con_send_cmd - send a command line to U-Boot
+ *
+ * @param cmd - command to send, the enter key is added
+ *
+ * @return SERIAL_OK or error
+ */
+signed int con_send_cmd(const char *cmd);
+
+/**
+ * Matcher waiting for several patterns at once (Aho-Corasick automaton)
+ */
+struct con_match;
+
+/**
+ * @brief con_match_new - create an empty matcher
+ *
+ * @return matcher or NULL
+ */
+struct con_match *con_match_new(void);
+
+/**
+ * @brief con_match_add - add a pattern to wait for
+ *
+ * @param m - matcher
+ * @param pattern - string to find, or "re:" and an extended regular
+ *	expression matched against each complete line (not on win32)
+ * @param code - value con_match_wait returns when this pattern is found
+ *	(0 or more)
+ *
+ * @return 0 or error
+ */
+signed int con_match_add(struct con_match *m, const char *pattern, int code);
+
+/**
+ * @brief con_match_wait - wait for any of the patterns from U-Boot
+ *
+ * All patterns are looked for at once in the data received. The first
+ * one to complete wins; for patterns completing on the same character,
+ * the one added first.
+ *
+ * @param m - matcher
+ * @param capture - if not NULL, gets the text received till the match
+ *	(the tail of it if it does not fit), NUL terminated
+ * @param capture_size - size of capture buffer
+ * @param timeout_ms - time to wait for, 0 for no limit other than the
+ *	ones set with s_set_timeouts
+ *
+ * @return code of the pattern found, SERIAL_TIMEDOUT or SERIAL_FAILED
+ */
+signed int con_match_wait(struct con_match *m, char *capture,
+			  unsigned int capture_size, unsigned int timeout_ms);
+
+/**
+ * @brief con_match_text - the pattern which returns a code
+ *
+ * @param m - matcher
+ * @param code - code of the pattern
+ *
+ * @return the first pattern added with this code, NULL if none
+ */
+const char *con_match_text(struct con_match *m, int code);
+
+/**
+ * @brief con_match_free - release a matcher
+ *
+ * @param m - matcher
+ */
+void con_match_free(struct con_match *m);
+
+/**
+ * @brief con_expect - wait for a string from U-Boot
+ *
+ * @param expected - string to wait for
+ * @param capture - if not NULL, gets the text received till the match
+ *	(the tail of it if it does not fit), NUL terminated
+ * @param capture_size - size of capture buffer
+ *
+ * @return 0 on match, else error
+ */
+signed int con_expect(const char *expected, char *capture,
+		      unsigned int capture_size);
+
+/**
+ * @brief con_expect_timeout - wait for a string from U-Boot, for a while
+ *
+ * @param expected - string to wait for
+ * @param capture - if not NULL, gets the text received till the match
+ *	(the tail of it if it does not fit), NUL terminated
+ * @param capture_size - size of capture buffer
+ * @param timeout_ms - time to wait for, 0 for no limit other than the
+ *	ones set with s_set_timeouts
+ *
+ * @return 0 on match, SERIAL_TIMEDOUT or SERIAL_FAILED
+ */
+signed int con_expect_timeout(const char *expected, char *capture,
+			      unsigned int capture_size,
+			      unsigned int timeout_ms);
+
+#endif				/* __LIB_INCLUDE_CONSOLE_H */
@@ -0,0 +1,101 @@
+/**
+ * @file
+ * @brief Header for picking SIMD implementations at runtime
+ *
+ * FileName: include/cpu_dispatch.h
+ *
+ * A library with several implementations of the same function lists them
+ * from the plain C one (index 0, runs anywhere) to the best, each with the
+ * CPU feature it needs. The best one the host supports is picked on first
+ * use, and the library calls it through its own table of functions.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#ifndef __LIB_INCLUDE_CPU_DISPATCH_H
+#define __LIB_INCLUDE_CPU_DISPATCH_H
+
+/** CPU features an implementation can need */
+#define CPU_ANY			0
+#define CPU_SSE2		1
+#define CPU_AVX2		2
+
+/** An implementation */
+struct cpu_impl {
+	/** printable name */
+	const char *name;
+	/** CPU_xxx it needs */
+	int feature;
+};
+
+/** Implementations of a function and the one picked */
+struct cpu_dispatch {
+	const struct cpu_impl *impls;
+	int count;
+	/** builds the tables of the implementations on first pick, or NULL */
+	void (*init) (void);
+	/** index of the implementation picked, -1 till then */
+	int best;
+};
+
+/**
+ * @brief cpu_has - does the host CPU have a feature?
+ *
+ * Features of other architectures than the one built for are never there,
+ * so implementations which are not built are never picked.
+ *
+ * @param feature - CPU_xxx
+ *
+ * @return 1 if it has, else 0
+ */
+int cpu_has(int feature);
+
+/**
+ * @brief cpu_dispatch_supported - is an implementation usable on this host?
+ *
+ * @param d - implementations
+ * @param impl - index
+ *
+ * @return 1 if supported, else 0
+ */
+int cpu_dispatch_supported(const struct cpu_dispatch *d, int impl);
+
+/**
+ * @brief cpu_dispatch_select - pick the best implementation for this host
+ *
+ * This is done on the first call, unsynchronised: call it once before
+ * threads use the implementations at once.
+ *
+ * @param d - implementations
+ *
+ * @return index of the implementation
+ */
+int cpu_dispatch_select(struct cpu_dispatch *d);
+
+/**
+ * @brief cpu_dispatch_name - printable name of an implementation
+ *
+ * @param d - implementations
+ * @param impl - index, or -1 for the one picked
+ *
+ * @return name string
+ */
+const char *cpu_dispatch_name(struct cpu_dispatch *d, int impl);
+
+#endif				/* __LIB_INCLUDE_CPU_DISPATCH_H */
@@ -0,0 +1,66 @@
+/**
+ * @file
+ * @brief Header for checksum helpers
+ *
+ * FileName: include/crc.h
+ *
+ * CRC32 here is the same as zlib and U-Boot's crc32 command compute, so
+ * that data loaded on the target can be checked against the host copy.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#ifndef __LIB_INCLUDE_CRC_H
+#define __LIB_INCLUDE_CRC_H
+
+/**
+ * @brief crc_init - build the lookup tables
+ *
+ * Must be called before the CRCs are used from more than one thread, the
+ * lazy set up on first use is not thread safe.
+ */
+void crc_init(void);
+
+/**
+ * @brief crc32_update - update a running CRC32 (IEEE 802.3)
+ *
+ * @param crc - CRC of previous data, 0 to start with
+ * @param buf - data
+ * @param len - size of data
+ *
+ * @return updated CRC
+ */
+unsigned int crc32_update(unsigned int crc, const unsigned char *buf,
+			  unsigned int len);
+
+/**
+ * @brief crc16_update - update a running CRC-16/XMODEM (CCITT, 0x1021)
+ *
+ * This is the CRC x/ymodem blocks carry, sent most significant byte first.
+ *
+ * @param crc - CRC of previous data, 0 to start with
+ * @param buf - data
+ * @param len - size of data
+ *
+ * @return updated CRC
+ */
+unsigned short crc16_update(unsigned short crc, const unsigned char *buf,
+			    unsigned int len);
+
+#endif				/* __LIB_INCLUDE_CRC_H */
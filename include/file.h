@@ -38,5 +38,7 @@ signed char f_open(const char *f_name);
 signed char f_close(void);
 signed int f_read(unsigned char *buffer, unsigned int read_size);
 int f_seek(long offset);
+const unsigned char *f_map(const char *f_name, unsigned long *size);
+signed char f_unmap(const unsigned char *map, unsigned long size);
 
 #endif				/* __FILE__H_ */
@@ -0,0 +1,85 @@
+/**
+ * @file
+ * @brief Header for the U-Boot memory dump decoder
+ *
+ * FileName: include/h_decode.h
+ *
+ * U-Boot's md.l prints memory as lines of an address and up to 4 words:
+ * "80000000: 12345678 9abcdef0 11223344 55667788    .4Vx....\"3DUfw."
+ * The decoder turns such a line back to the bytes, in the order a little
+ * endian target has them in memory. Vectorized versions are picked at
+ * runtime when the host CPU supports them.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#ifndef __LIB_INCLUDE_H_DECODE_H
+#define __LIB_INCLUDE_H_DECODE_H
+
+/** Most bytes on a md.l line */
+#define H_DEC_LINE_MAX		16
+
+/** Decoder implementations */
+#define H_DEC_SCALAR		0
+#define H_DEC_SSE2		1
+#define H_DEC_MAX		2
+
+/**
+ * @brief h_decode_line - decode a line of md.l output
+ *
+ * @param line - the line, without its end of line
+ * @param len - length of line
+ * @param addr - gets the address the line starts at
+ * @param out - gets the bytes, must be able to hold H_DEC_LINE_MAX
+ *
+ * @return number of bytes decoded, -1 if it is not a md.l line
+ */
+int h_decode_line(const char *line, unsigned int len, unsigned long *addr,
+		  unsigned char *out);
+
+/**
+ * @brief h_decode_line_with - same as h_decode_line using a specific
+ * implementation
+ *
+ * @param impl - H_DEC_xxx, must be supported by the host
+ *
+ * @return number of bytes decoded, -1 if it is not a md.l line
+ */
+int h_decode_line_with(int impl, const char *line, unsigned int len,
+		       unsigned long *addr, unsigned char *out);
+
+/**
+ * @brief h_decode_supported - is an implementation usable on this host?
+ *
+ * @param impl - H_DEC_xxx
+ *
+ * @return 1 if supported, else 0
+ */
+int h_decode_supported(int impl);
+
+/**
+ * @brief h_decode_name - printable name of an implementation
+ *
+ * @param impl - H_DEC_xxx, or -1 for the one h_decode_line uses
+ *
+ * @return name string
+ */
+const char *h_decode_name(int impl);
+
+#endif				/* __LIB_INCLUDE_H_DECODE_H */
@@ -0,0 +1,94 @@
+/**
+ * @file
+ * @brief Header for the kermit data encoder
+ *
+ * FileName: include/k_encode.h
+ *
+ * Kermit data bytes which are control characters (or the escape
+ * character itself) are prefixed with K_ESCAPE and made printable. The
+ * encoder does this and computes the checksum contribution of the
+ * encoded bytes in one pass. Vectorized versions are picked at runtime
+ * when the host CPU supports them.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#ifndef __LIB_INCLUDE_K_ENCODE_H
+#define __LIB_INCLUDE_K_ENCODE_H
+
+#define SPACE			0x20
+#define K_ESCAPE		0x23
+
+/** Encoder implementations */
+#define K_ENC_SCALAR		0
+#define K_ENC_SSE2		1
+#define K_ENC_AVX2		2
+#define K_ENC_MAX		3
+
+/**
+ * @brief k_encode - escape a buffer of kermit data
+ *
+ * @param out - output buffer, must be able to hold (2 * size) bytes
+ * @param in - binary data to encode
+ * @param size - number of bytes in in
+ * @param sum - running checksum, the encoded bytes are added to it
+ *
+ * @return number of bytes written to out
+ */
+unsigned int k_encode(unsigned char *out, const unsigned char *in,
+		      unsigned int size, unsigned int *sum);
+
+/**
+ * @brief k_encode_with - same as k_encode using a specific implementation
+ *
+ * @param impl - K_ENC_xxx, must be supported by the host
+ *
+ * @return number of bytes written to out
+ */
+unsigned int k_encode_with(int impl, unsigned char *out,
+			   const unsigned char *in, unsigned int size,
+			   unsigned int *sum);
+
+/**
+ * @brief k_encode_supported - is an implementation usable on this host?
+ *
+ * @param impl - K_ENC_xxx
+ *
+ * @return 1 if supported, else 0
+ */
+int k_encode_supported(int impl);
+
+/**
+ * @brief k_encode_init - pick the implementation and build its tables
+ *
+ * k_encode otherwise does this on its first call, unsynchronised: call
+ * it before threads encode at once.
+ */
+void k_encode_init(void);
+
+/**
+ * @brief k_encode_name - printable name of an implementation
+ *
+ * @param impl - K_ENC_xxx, or -1 for the one k_encode uses
+ *
+ * @return name string
+ */
+const char *k_encode_name(int impl);
+
+#endif				/* __LIB_INCLUDE_K_ENCODE_H */
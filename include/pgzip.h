@@ -0,0 +1,75 @@
+/**
+ * @file
+ * @brief Header for the parallel gzip compressor
+ *
+ * FileName: include/pgzip.h
+ *
+ * Data is cut in blocks which are deflated on all cores at once, each
+ * with the 32K of data before it as dictionary, and ended on a byte
+ * boundary with a sync flush. The blocks put one after the other are a
+ * single deflate stream, which goes in a gzip wrapper any gunzip (such as
+ * U-Boot's unzip) takes. Needs zlib.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#ifndef __LIB_INCLUDE_PGZIP_H
+#define __LIB_INCLUDE_PGZIP_H
+
+/**
+ * @brief pgz_threads - number of compression threads to use
+ *
+ * @return online CPUs (1 if threads are not supported)
+ */
+int pgz_threads(void);
+
+/**
+ * @brief pgz_auto_level - pick a level which keeps up with the line
+ *
+ * A sample of the data is compressed at decreasing levels, the highest
+ * one whose speed over all threads is at least twice the line rate wins.
+ *
+ * @param in - data (a sample of its start is used)
+ * @param size - size of data
+ * @param threads - threads the data will be compressed with
+ * @param line_rate - bytes/s the line carries
+ * @param speed - if not NULL, gets the measured bytes/s of the level
+ *
+ * @return compression level 1..9
+ */
+int pgz_auto_level(const unsigned char *in, unsigned long size, int threads,
+		   unsigned long line_rate, double *speed);
+
+/**
+ * @brief pgz_compress - compress to a gzip stream on several threads
+ *
+ * @param in - data
+ * @param size - size of data
+ * @param level - compression level 1..9
+ * @param threads - threads to use
+ * @param out_size - gets the size of the gzip stream
+ * @param crc - gets the crc32 of the data (as in the gzip trailer)
+ *
+ * @return gzip stream (to free() once done) or NULL on error
+ */
+unsigned char *pgz_compress(const unsigned char *in, unsigned long size,
+			    int level, int threads, unsigned long *out_size,
+			    unsigned int *crc);
+
+#endif				/* __LIB_INCLUDE_PGZIP_H */
@@ -35,16 +35,30 @@ signed char s_configure(unsigned long baud_rate, unsigned char parity,
 signed char s_close(void);
 signed int s_read_remaining(void);
 signed int s_read(unsigned char *p_buffer, unsigned long size);
+signed int s_read_timeout(unsigned char *p_buffer, unsigned long size,
+			  unsigned int timeout_ms);
 signed int s_write(unsigned char *p_buffer, unsigned long size);
 signed int s_getc(void);
 signed int s_putc(char x);
 signed int s_flush(unsigned int *rx_left, unsigned int *tx_left);
 signed int s_break(int sec_stay, int sec_post);
+signed int s_set_timeouts(unsigned int first_ms, unsigned int idle_ms,
+			  unsigned int total_ms);
+int s_timeout_which(void);
+#ifndef __WIN32__
+int s_fd(void);
+#endif
 
 #define SERIAL_OK 0
 #define SERIAL_FAILED -1
 #define SERIAL_TIMEDOUT -2
 
+/* s_timeout_which: the s_set_timeouts deadline which ended a read */
+#define SERIAL_TMO_NONE 0
+#define SERIAL_TMO_FIRST 1
+#define SERIAL_TMO_IDLE 2
+#define SERIAL_TMO_TOTAL 3
+
 #define NOPARITY 0
 #define ODDPARITY 1
 #define EVENPARITY 2
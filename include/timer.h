@@ -0,0 +1,53 @@
+/**
+ * @file
+ * @brief Header for OS independent monotonic time helpers
+ *
+ * FileName: include/timer.h
+ *
+ * Used for timeouts, transfer statistics and benchmarks. Time is
+ * monotonic and is never affected by wall clock changes.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#ifndef __LIB_INCLUDE_TIMER_H
+#define __LIB_INCLUDE_TIMER_H
+
+/**
+ * @brief t_now_us - monotonic time stamp
+ *
+ * @return microseconds since an arbitrary (fixed) point in the past
+ */
+unsigned long long t_now_us(void);
+
+/**
+ * @brief t_sleep_ms - sleep for a definite time
+ *
+ * @param ms - delay in milliseconds
+ */
+void t_sleep_ms(unsigned int ms);
+
+/**
+ * @brief t_sleep_us - sleep for a short definite time
+ *
+ * @param us - delay in microseconds (rounded up to ms on windows)
+ */
+void t_sleep_us(unsigned long us);
+
+#endif				/* __LIB_INCLUDE_TIMER_H */
@@ -0,0 +1,46 @@
+/**
+ * @file
+ * @brief Protocol of the umux console multiplexer
+ *
+ * FileName: include/umux.h
+ *
+ * umux owns a serial port and serves it on a UNIX socket. A client sends
+ * one hello line, gets one reply line, and from there on the connection
+ * is the raw console in both directions:
+ * @li UMUX_WATCH: console output only, starting with what the daemon
+ * still holds of the past. Anything sent is dropped.
+ * @li UMUX_LEASE: exclusive access, the reply comes once all the leases
+ * asked for before are over. Output starts at the reply, and what is
+ * sent goes to the port. The lease ends when the connection is closed.
+ *
+ * The reply is UMUX_OK followed by the baudrate of the port (always 8N1).
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#ifndef __LIB_INCLUDE_UMUX_H
+#define __LIB_INCLUDE_UMUX_H
+
+#define UMUX_WATCH	"UMUX watch\n"
+#define UMUX_LEASE	"UMUX lease\n"
+#define UMUX_OK		"OK "
+/* longest hello or reply line */
+#define UMUX_LINE_MAX	64
+
+#endif				/* __LIB_INCLUDE_UMUX_H */
@@ -0,0 +1,257 @@
+/**
+ * @file
+ * @brief console capture file
+ *
+ * FileName: lib/capture.c
+ *
+ * Implements the APIs in include/capture.h
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef __WIN32__
+#include <pthread.h>
+/* Write the file from a thread of its own */
+#define CAP_THREAD
+#endif
+
+#include <capture.h>
+#include <timer.h>
+#include <common.h>
+
+/* Ring size, and the most the writer takes out at once */
+#define CAP_RING_SIZE		(1024 * 1024)
+#define CAP_CHUNK		(64 * 1024)
+/* Room for a time stamp or a drop notice */
+#define CAP_STAMP_MAX		64
+
+static struct {
+	FILE *fp;
+	unsigned char *ring;
+	/** write and read positions, free running */
+	unsigned long head;
+	unsigned long tail;
+	unsigned long long start;
+	int line_start;
+	/** bytes dropped: not noted in the file yet, and in total */
+	unsigned long pending_drop;
+	unsigned long dropped;
+	int stop;
+#ifdef CAP_THREAD
+	pthread_t writer;
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+#endif
+} cap;
+
+/**
+ * @brief cap_put - copy into the ring, the caller checked the room
+ *
+ * @param buf - data
+ * @param len - length
+ */
+static void cap_put(const void *buf, unsigned long len)
+{
+	unsigned long pos = cap.head % CAP_RING_SIZE;
+	unsigned long first = (len > CAP_RING_SIZE - pos) ?
+	    CAP_RING_SIZE - pos : len;
+
+	memcpy(cap.ring + pos, buf, first);
+	memcpy(cap.ring, (const unsigned char *)buf + first, len - first);
+	cap.head += len;
+}
+
+/**
+ * @brief cap_drain - write out the ring
+ *
+ * Called with the lock held, which is let go around the file write.
+ */
+static void cap_drain(void)
+{
+	unsigned char chunk[CAP_CHUNK];
+	unsigned long len, pos, first;
+
+	while (cap.head != cap.tail) {
+		len = cap.head - cap.tail;
+		if (len > CAP_CHUNK)
+			len = CAP_CHUNK;
+		pos = cap.tail % CAP_RING_SIZE;
+		first = (len > CAP_RING_SIZE - pos) ? CAP_RING_SIZE - pos : len;
+		memcpy(chunk, cap.ring + pos, first);
+		memcpy(chunk + first, cap.ring, len - first);
+		cap.tail += len;
+#ifdef CAP_THREAD
+		pthread_mutex_unlock(&cap.lock);
+#endif
+		fwrite(chunk, 1, len, cap.fp);
+#ifdef CAP_THREAD
+		pthread_mutex_lock(&cap.lock);
+#endif
+	}
+}
+
+#ifdef CAP_THREAD
+/**
+ * @brief cap_writer - write the ring to the file as it fills
+ *
+ * @param arg - unused
+ *
+ * @return NULL
+ */
+static void *cap_writer(void *arg)
+{
+	pthread_mutex_lock(&cap.lock);
+	while (1) {
+		cap_drain();
+		if (cap.stop)
+			break;
+		/* a slow file must not hold up cap_write in the read loop */
+		pthread_mutex_unlock(&cap.lock);
+		fflush(cap.fp);
+		pthread_mutex_lock(&cap.lock);
+		/* data or stop may have come during the flush */
+		if (cap.head == cap.tail && !cap.stop)
+			pthread_cond_wait(&cap.ready, &cap.lock);
+	}
+	pthread_mutex_unlock(&cap.lock);
+	return NULL;
+}
+#endif
+
+/**
+ * @brief cap_open - start capturing to a file
+ *
+ * @param name - file to write (truncated)
+ *
+ * @return 0 or error
+ */
+signed int cap_open(const char *name)
+{
+	memset(&cap, 0, sizeof(cap));
+	cap.ring = malloc(CAP_RING_SIZE);
+	if (cap.ring == NULL) {
+		APP_ERROR("failed to allocate capture buffer\n")
+		    return -1;
+	}
+	cap.fp = fopen(name, "wb");
+	if (cap.fp == NULL) {
+		APP_ERROR("Cannot open capture file '%s'\n", name)
+		    perror(NULL);
+		free(cap.ring);
+		cap.ring = NULL;
+		return -1;
+	}
+	cap.start = t_now_us();
+	cap.line_start = 1;
+#ifdef CAP_THREAD
+	pthread_mutex_init(&cap.lock, NULL);
+	pthread_cond_init(&cap.ready, NULL);
+	if (pthread_create(&cap.writer, NULL, cap_writer, NULL)) {
+		APP_ERROR("Cannot start capture thread\n")
+		    fclose(cap.fp);
+		cap.fp = NULL;
+		free(cap.ring);
+		cap.ring = NULL;
+		return -1;
+	}
+#endif
+	return 0;
+}
+
+/**
+ * @brief cap_write - capture received data, never blocks
+ *
+ * @param buf - data
+ * @param len - length of data
+ */
+void cap_write(const unsigned char *buf, unsigned int len)
+{
+	char stamp[CAP_STAMP_MAX];
+	double now;
+	unsigned int i;
+	int n;
+
+	if (cap.fp == NULL)
+		return;
+	now = (t_now_us() - cap.start) / 1000000.0;
+#ifdef CAP_THREAD
+	pthread_mutex_lock(&cap.lock);
+#endif
+	for (i = 0; i < len; i++) {
+		n = 0;
+		if (cap.pending_drop &&
+		    CAP_RING_SIZE - (cap.head - cap.tail) >= CAP_STAMP_MAX * 2) {
+			n = sprintf(stamp, "%s[%12.6f] <%lu bytes dropped>\n",
+				    cap.line_start ? "" : "\n", now,
+				    cap.pending_drop);
+			cap_put(stamp, n);
+			cap.pending_drop = 0;
+			cap.line_start = 1;
+			n = 0;
+		}
+		if (cap.line_start)
+			n = sprintf(stamp, "[%12.6f] ", now);
+		if (cap.pending_drop ||
+		    CAP_RING_SIZE - (cap.head - cap.tail) < (unsigned)n + 1) {
+			cap.pending_drop++;
+			cap.dropped++;
+			continue;
+		}
+		if (n)
+			cap_put(stamp, n);
+		cap_put(buf + i, 1);
+		cap.line_start = (buf[i] == '\n');
+	}
+#ifdef CAP_THREAD
+	pthread_cond_signal(&cap.ready);
+	pthread_mutex_unlock(&cap.lock);
+#else
+	cap_drain();
+#endif
+}
+
+/**
+ * @brief cap_close - write out what is left and close the file
+ *
+ * @return bytes dropped because the ring was full
+ */
+unsigned long cap_close(void)
+{
+	if (cap.fp == NULL)
+		return 0;
+#ifdef CAP_THREAD
+	pthread_mutex_lock(&cap.lock);
+	cap.stop = 1;
+	pthread_cond_signal(&cap.ready);
+	pthread_mutex_unlock(&cap.lock);
+	pthread_join(cap.writer, NULL);
+	pthread_cond_destroy(&cap.ready);
+	pthread_mutex_destroy(&cap.lock);
+#endif
+	if (cap.pending_drop)
+		fprintf(cap.fp, "\n<%lu bytes dropped>\n", cap.pending_drop);
+	fclose(cap.fp);
+	cap.fp = NULL;
+	free(cap.ring);
+	cap.ring = NULL;
+	return cap.dropped;
+}
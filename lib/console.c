@@ -0,0 +1,661 @@
+/**
+ * @file
+ * @brief U-Boot console helpers
+ *
+ * FileName: lib/console.c
+ *
+ * Implements the APIs in include/console.h on top of include/serial.h
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef __WIN32__
+#include <regex.h>
+#define CON_REGEX
+#endif
+
+#include <serial.h>
+#include <console.h>
+#include <timer.h>
+#include <common.h>
+
+/* regex patterns are marked with this prefix */
+#define CON_REGEX_PREFIX	"re:"
+/* longest line kept for regex patterns, the rest is not looked at */
+#define CON_LINE_MAX		512
+#define CON_ALPHABET		256
+/* Echo is written out at each newline, when full, or after this long */
+#define CON_OUT_SIZE		4096
+#define CON_FLUSH_MS		50
+/* Paced sending: wait for each echo, then retry the line after a ^U */
+#define CON_ECHO_MS		500
+#define CON_PACE_RETRIES	3
+#define CON_KILL_LINE		0x15
+#define CON_KILL_QUIET_MS	100
+
+/**
+ * A pattern waited for
+ */
+struct con_pattern {
+	char *text;
+	int code;
+	int regex;
+#ifdef CON_REGEX
+	regex_t re;
+#endif
+};
+
+/**
+ * Aho-Corasick automaton for the literal patterns, plus the regexes
+ */
+struct con_match {
+	struct con_pattern *pat;
+	int pats;
+	/** goto function, with the failure transitions folded in once built */
+	int (*next)[CON_ALPHABET];
+	int *fail;
+	/** first pattern (in the order added) ending at a node, -1 for none */
+	int *out;
+	int nodes;
+	int built;
+	/** current node and line received so far */
+	int state;
+	char line[CON_LINE_MAX];
+	unsigned int line_len;
+};
+
+/************* VARS   ***************/
+static int con_echo = 1;
+/* echo not written out yet, and when it has to be */
+static char con_out[CON_OUT_SIZE];
+static unsigned int con_out_len;
+static unsigned long long con_out_due;
+/* gets all the data received */
+static void (*con_tap) (const unsigned char *buf, unsigned int len);
+/* characters sent ahead of their echo, 0 to send lines at once */
+static unsigned int con_pace;
+
+/************* LOCAL FUNCTIONS ***************/
+
+/**
+ * @brief con_match_add_pattern - add a pattern to a matcher
+ *
+ * @param m - matcher
+ * @param text - pattern
+ * @param code - code returned when it matches
+ * @param regex - 1 if text is an extended regex for a whole line
+ *
+ * @return 0 or error
+ */
+static signed int con_match_add_pattern(struct con_match *m, const char *text,
+					int code, int regex)
+{
+	struct con_pattern *pat;
+
+	if (!*text || code < 0) {
+		APP_ERROR("Empty pattern or bad code %d\n", code)
+		    return SERIAL_FAILED;
+	}
+	pat = realloc(m->pat, (m->pats + 1) * sizeof(*pat));
+	if (pat == NULL) {
+		APP_ERROR("failed to allocate pattern\n")
+		    return SERIAL_FAILED;
+	}
+	m->pat = pat;
+	pat += m->pats;
+	memset(pat, 0, sizeof(*pat));
+	pat->code = code;
+	pat->regex = regex;
+	if (regex) {
+#ifdef CON_REGEX
+		if (regcomp(&pat->re, text, REG_EXTENDED | REG_NOSUB)) {
+			APP_ERROR("Bad regular expression '%s'\n", text)
+			    return SERIAL_FAILED;
+		}
+#else
+		APP_ERROR("Regular expressions are not supported here\n")
+		    return SERIAL_FAILED;
+#endif
+	}
+	pat->text = strdup(text);
+	if (pat->text == NULL) {
+#ifdef CON_REGEX
+		if (regex)
+			regfree(&pat->re);
+#endif
+		APP_ERROR("failed to allocate pattern\n")
+		    return SERIAL_FAILED;
+	}
+	m->pats++;
+	m->built = 0;
+	return 0;
+}
+
+/**
+ * @brief con_match_build - build the automaton of the literal patterns
+ *
+ * The trie of the patterns gets its failure links breadth first, and the
+ * missing transitions are filled from them, so that matching takes a
+ * single lookup per character.
+ *
+ * @param m - matcher
+ *
+ * @return 0 or error
+ */
+static signed int con_match_build(struct con_match *m)
+{
+	int i, c, u, v, max = 1, head = 0, tail = 0;
+	int *queue;
+	const unsigned char *t;
+
+	for (i = 0; i < m->pats; i++)
+		if (!m->pat[i].regex)
+			max += strlen(m->pat[i].text);
+	free(m->next);
+	free(m->fail);
+	free(m->out);
+	m->next = malloc(max * sizeof(*m->next));
+	m->fail = calloc(max, sizeof(*m->fail));
+	m->out = malloc(max * sizeof(*m->out));
+	queue = malloc(max * sizeof(*queue));
+	if (m->next == NULL || m->fail == NULL || m->out == NULL ||
+	    queue == NULL) {
+		free(queue);
+		APP_ERROR("failed to allocate matcher\n")
+		    return SERIAL_FAILED;
+	}
+	memset(m->next, 0xFF, max * sizeof(*m->next));
+	memset(m->out, 0xFF, max * sizeof(*m->out));
+	m->nodes = 1;
+	/* trie */
+	for (i = 0; i < m->pats; i++) {
+		if (m->pat[i].regex)
+			continue;
+		u = 0;
+		for (t = (unsigned char *)m->pat[i].text; *t; t++) {
+			if (m->next[u][*t] < 0)
+				m->next[u][*t] = m->nodes++;
+			u = m->next[u][*t];
+		}
+		if (m->out[u] < 0)
+			m->out[u] = i;
+	}
+	/* failure links and transitions, breadth first */
+	for (c = 0; c < CON_ALPHABET; c++) {
+		v = m->next[0][c];
+		if (v < 0) {
+			m->next[0][c] = 0;
+		} else {
+			m->fail[v] = 0;
+			queue[tail++] = v;
+		}
+	}
+	while (head < tail) {
+		u = queue[head++];
+		/* a pattern ending at the failure node ends here too */
+		if (m->out[m->fail[u]] >= 0 &&
+		    (m->out[u] < 0 || m->out[m->fail[u]] < m->out[u]))
+			m->out[u] = m->out[m->fail[u]];
+		for (c = 0; c < CON_ALPHABET; c++) {
+			v = m->next[u][c];
+			if (v < 0) {
+				m->next[u][c] = m->next[m->fail[u]][c];
+			} else {
+				m->fail[v] = m->next[m->fail[u]][c];
+				queue[tail++] = v;
+			}
+		}
+	}
+	free(queue);
+	m->built = 1;
+	return 0;
+}
+
+/**
+ * @brief con_match_char - feed a received character to the matcher
+ *
+ * @param m - matcher
+ * @param c - character
+ *
+ * @return index of the pattern which matched, else -1
+ */
+static int con_match_char(struct con_match *m, unsigned char c)
+{
+#ifdef CON_REGEX
+	int i;
+#endif
+
+	m->state = m->next[m->state][c];
+	if (m->out[m->state] >= 0)
+		return m->out[m->state];
+	if (c == '\r')
+		return -1;
+	if (c != '\n') {
+		if (m->line_len < CON_LINE_MAX - 1)
+			m->line[m->line_len++] = c;
+		return -1;
+	}
+	m->line[m->line_len] = '\0';
+	m->line_len = 0;
+#ifdef CON_REGEX
+	for (i = 0; i < m->pats; i++)
+		if (m->pat[i].regex &&
+		    !regexec(&m->pat[i].re, m->line, 0, NULL, 0))
+			return i;
+#endif
+	return -1;
+}
+
+/**
+ * @brief con_out_flush - write out the echo buffered
+ */
+static void con_out_flush(void)
+{
+	if (!con_out_len)
+		return;
+	fwrite(con_out, 1, con_out_len, stdout);
+	fflush(stdout);
+	con_out_len = 0;
+}
+
+/**
+ * @brief con_out_put - echo a received character
+ *
+ * @param c - character
+ */
+static void con_out_put(char c)
+{
+	if (!con_out_len)
+		con_out_due = t_now_us() + CON_FLUSH_MS * 1000ULL;
+	con_out[con_out_len++] = c;
+	if (c == '\n' || con_out_len == CON_OUT_SIZE)
+		con_out_flush();
+}
+
+/**
+ * @brief con_getc - get a character, writing out the echo meanwhile
+ *
+ * A partial line (such as the prompt) is echoed once it is CON_FLUSH_MS
+ * old even if nothing else comes.
+ *
+ * @param deadline - time to give up at, 0 for no limit other than the ones
+ *	set with s_set_timeouts
+ *
+ * @return character, SERIAL_TIMEDOUT or SERIAL_FAILED
+ */
+static signed int con_getc(unsigned long long deadline)
+{
+	unsigned long long now, limit;
+	unsigned char c;
+	int ret;
+
+	while (1) {
+		limit = deadline;
+		if (con_out_len && (!limit || con_out_due < limit))
+			limit = con_out_due;
+		if (!limit)
+			return s_getc();
+		now = t_now_us();
+		if (deadline && now >= deadline)
+			return SERIAL_TIMEDOUT;
+		if (now < limit) {
+			ret = s_read_timeout(&c, 1, (limit - now + 999) / 1000);
+			if (ret > 0)
+				return c;
+			if (ret != SERIAL_TIMEDOUT ||
+			    s_timeout_which() != SERIAL_TMO_NONE)
+				return ret;
+			continue;
+		}
+		con_out_flush();
+	}
+}
+
+/**
+ * @brief con_seen - pass on a character which is not matched against
+ *
+ * @param c - character
+ */
+static void con_seen(unsigned char c)
+{
+	if (con_tap)
+		con_tap(&c, 1);
+	if (con_echo)
+		con_out_put(c);
+}
+
+/**
+ * @brief con_send_paced - send a command line no faster than it echoes
+ *
+ * At most con_pace characters go out ahead of their echo. A character
+ * which echoes wrong (one was lost, the one after it came back) or not at
+ * all means the line is damaged: it is killed with ^U and sent again.
+ *
+ * @param cmd - command to send, the enter key is added
+ *
+ * @return SERIAL_OK or error
+ */
+static signed int con_send_paced(const char *cmd)
+{
+	unsigned int len = strlen(cmd), sent, echoed, n, retry;
+	unsigned char kill = CON_KILL_LINE;
+	int ret;
+
+	for (retry = 0; retry <= CON_PACE_RETRIES; retry++) {
+		if (retry) {
+			APP_ERROR("\nEcho of '%s' went wrong, sending it "
+				  "again\n", cmd)
+			if (s_write(&kill, 1) < 0)
+				return SERIAL_FAILED;
+			/* drop the erase sequence and anything else which came */
+			while ((ret = con_getc(t_now_us() +
+					       CON_KILL_QUIET_MS * 1000ULL)) >= 0)
+				con_seen(ret);
+			if (ret != SERIAL_TIMEDOUT)
+				return SERIAL_FAILED;
+		}
+		sent = echoed = 0;
+		while (echoed < len) {
+			if (sent < len && sent - echoed < con_pace) {
+				n = con_pace - (sent - echoed);
+				if (n > len - sent)
+					n = len - sent;
+				if (s_write((unsigned char *)cmd + sent, n) < 0)
+					return SERIAL_FAILED;
+				sent += n;
+			}
+			ret = con_getc(t_now_us() + CON_ECHO_MS * 1000ULL);
+			if (ret == SERIAL_TIMEDOUT)
+				break;
+			if (ret < 0)
+				return SERIAL_FAILED;
+			con_seen(ret);
+			if (ret != (unsigned char)cmd[echoed])
+				break;
+			echoed++;
+		}
+		if (echoed == len)
+			return (s_write((unsigned char *)"\n", 1) < 0) ?
+			    SERIAL_FAILED : SERIAL_OK;
+	}
+	APP_ERROR("Echo of '%s' still wrong after %d retries\n", cmd,
+		  CON_PACE_RETRIES)
+	return SERIAL_FAILED;
+}
+
+/**************** EXPOSED FUNCTIONS  ****************/
+
+/**
+ * @brief con_set_echo - should received console data be shown?
+ *
+ * @param echo - 1 to dump received characters on stdout (default), 0 not to
+ */
+void con_set_echo(int echo)
+{
+	con_echo = echo;
+}
+
+/**
+ * @brief con_set_tap - have all received data passed to a function
+ *
+ * @param tap - function getting the data, such as cap_write; NULL for none
+ */
+void con_set_tap(void (*tap) (const unsigned char *buf, unsigned int len))
+{
+	con_tap = tap;
+}
+
+/**
+ * @brief con_set_pace - send command lines no faster than they echo
+ *
+ * @param window - characters sent ahead of their echo, 0 to write lines at
+ *	once (default)
+ */
+void con_set_pace(unsigned int window)
+{
+	con_pace = window;
+}
+
+/**
+ * @brief con_send_cmd - send a command line to U-Boot
+ *
+ * @param cmd - command to send, the enter key is added
+ *
+ * @return SERIAL_OK or error
+ */
+signed int con_send_cmd(const char *cmd)
+{
+	int ret = 0;
+	char *buffer;
+	int len = strlen(cmd);
+	if (con_pace)
+		return con_send_paced(cmd);
+	buffer = calloc(len + 2, 1);
+	if (buffer == NULL) {
+		APP_ERROR("failed to allocate %d bytes\n", len + 2)
+		    perror("fail reason:");
+		return SERIAL_FAILED;
+	}
+	/* The command */
+	strcpy(buffer, cmd);
+	/* The enter key */
+	strcat(buffer, "\n");
+
+	ret = s_write((unsigned char *)buffer, strlen(buffer));
+	free(buffer);
+	if (ret < 0)
+		return SERIAL_FAILED;
+	return SERIAL_OK;
+}
+
+/**
+ * @brief con_match_new - create an empty matcher
+ *
+ * @return matcher or NULL
+ */
+struct con_match *con_match_new(void)
+{
+	struct con_match *m = calloc(1, sizeof(*m));
+
+	if (m == NULL) {
+		APP_ERROR("failed to allocate matcher\n")
+		    return NULL;
+	}
+	return m;
+}
+
+/**
+ * @brief con_match_add - add a pattern to wait for
+ *
+ * @param m - matcher
+ * @param pattern - string to find, or "re:" and an extended regular
+ *	expression matched against each complete line
+ * @param code - value con_match_wait returns when this pattern is found
+ *	(0 or more)
+ *
+ * @return 0 or error
+ */
+signed int con_match_add(struct con_match *m, const char *pattern, int code)
+{
+	if (!strncmp(pattern, CON_REGEX_PREFIX, strlen(CON_REGEX_PREFIX)))
+		return con_match_add_pattern(m, pattern +
+					     strlen(CON_REGEX_PREFIX), code, 1);
+	return con_match_add_pattern(m, pattern, code, 0);
+}
+
+/**
+ * @brief con_match_wait - wait for any of the patterns from U-Boot
+ *
+ * All patterns are looked for at once in the data received. The first
+ * one to complete wins; for patterns completing on the same character,
+ * the one added first.
+ *
+ * @param m - matcher
+ * @param capture - if not NULL, gets the text received till the match
+ *	(the tail of it if it does not fit), NUL terminated
+ * @param capture_size - size of capture buffer
+ * @param timeout_ms - time to wait for, 0 for no limit other than the
+ *	ones set with s_set_timeouts
+ *
+ * @return code of the pattern found, SERIAL_TIMEDOUT or SERIAL_FAILED
+ */
+signed int con_match_wait(struct con_match *m, char *capture,
+			  unsigned int capture_size, unsigned int timeout_ms)
+{
+	unsigned long long deadline = timeout_ms ?
+	    t_now_us() + timeout_ms * 1000ULL : 0;
+	unsigned int cap_idx = 0;
+	unsigned char current_char;
+	int ret = 0, found = -1;
+
+	if (!m->pats)
+		return SERIAL_FAILED;
+	if (!m->built && con_match_build(m))
+		return SERIAL_FAILED;
+	m->state = 0;
+	m->line_len = 0;
+	while (found < 0) {
+		ret = con_getc(deadline);
+		current_char = (unsigned char)ret;
+		if (ret == SERIAL_TIMEDOUT)
+			break;
+		if (ret < 0) {
+			APP_ERROR("Failed to read character\n")
+			    break;
+		}
+		if (con_tap)
+			con_tap(&current_char, 1);
+		found = con_match_char(m, current_char);
+		if (capture && capture_size > 1) {
+			/* keep the latest half when full */
+			if (cap_idx == capture_size - 1) {
+				memmove(capture, capture + cap_idx / 2,
+					cap_idx - cap_idx / 2);
+				cap_idx -= cap_idx / 2;
+			}
+			capture[cap_idx++] = current_char;
+		}
+		/* Dump the character to user screen */
+		if (con_echo)
+			con_out_put(current_char);
+	}
+	con_out_flush();
+	if (capture && capture_size)
+		capture[cap_idx] = '\0';
+	if (found < 0)
+		return ret;
+	return m->pat[found].code;
+}
+
+/**
+ * @brief con_match_text - the pattern which returns a code
+ *
+ * @param m - matcher
+ * @param code - code of the pattern
+ *
+ * @return the first pattern added with this code, NULL if none
+ */
+const char *con_match_text(struct con_match *m, int code)
+{
+	int i;
+
+	for (i = 0; i < m->pats; i++)
+		if (m->pat[i].code == code)
+			return m->pat[i].text;
+	return NULL;
+}
+
+/**
+ * @brief con_match_free - release a matcher
+ *
+ * @param m - matcher
+ */
+void con_match_free(struct con_match *m)
+{
+	int i;
+
+	if (m == NULL)
+		return;
+	for (i = 0; i < m->pats; i++) {
+#ifdef CON_REGEX
+		if (m->pat[i].regex)
+			regfree(&m->pat[i].re);
+#endif
+		free(m->pat[i].text);
+	}
+	free(m->pat);
+	free(m->next);
+	free(m->fail);
+	free(m->out);
+	free(m);
+}
+
+/**
+ * @brief con_expect_timeout - wait for a string from U-Boot, for a while
+ *
+ * @param expected - string to wait for
+ * @param capture - if not NULL, gets the text received till the match
+ *	(the tail of it if it does not fit), NUL terminated
+ * @param capture_size - size of capture buffer
+ * @param timeout_ms - time to wait for, 0 for no limit other than the
+ *	ones set with s_set_timeouts
+ *
+ * @return 0 on match, SERIAL_TIMEDOUT or SERIAL_FAILED
+ */
+signed int con_expect_timeout(const char *expected, char *capture,
+			      unsigned int capture_size,
+			      unsigned int timeout_ms)
+{
+	struct con_match *m;
+	int ret;
+
+	if (!*expected) {
+		if (capture && capture_size)
+			capture[0] = '\0';
+		return 0;
+	}
+	m = con_match_new();
+	if (m == NULL)
+		return SERIAL_FAILED;
+	/* taken literally, even if it looks like a regex */
+	ret = con_match_add_pattern(m, expected, 0, 0);
+	if (!ret)
+		ret = con_match_wait(m, capture, capture_size, timeout_ms);
+	con_match_free(m);
+	return ret;
+}
+
+/**
+ * @brief con_expect - wait for a string from U-Boot
+ *
+ * @param expected - string to wait for
+ * @param capture - if not NULL, gets the text received till the match
+ *	(the tail of it if it does not fit), NUL terminated
+ * @param capture_size - size of capture buffer
+ *
+ * @return 0 on match, else error
+ */
+signed int con_expect(const char *expected, char *capture,
+		      unsigned int capture_size)
+{
+	return con_expect_timeout(expected, capture, capture_size, 0);
+}
@@ -0,0 +1,109 @@
+/**
+ * @file
+ * @brief Picks SIMD implementations at runtime
+ *
+ * FileName: lib/cpu_dispatch.c
+ *
+ * Implements the APIs in include/cpu_dispatch.h
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#include <stddef.h>
+
+#include <cpu_dispatch.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CPU_DISPATCH_X86
+#endif
+
+/**
+ * @brief cpu_has - does the host CPU have a feature?
+ *
+ * @param feature - CPU_xxx
+ *
+ * @return 1 if it has, else 0
+ */
+int cpu_has(int feature)
+{
+	if (feature == CPU_ANY)
+		return 1;
+#ifdef CPU_DISPATCH_X86
+	__builtin_cpu_init();
+	if (feature == CPU_SSE2)
+		return __builtin_cpu_supports("sse2");
+	if (feature == CPU_AVX2)
+		return __builtin_cpu_supports("avx2");
+#endif
+	return 0;
+}
+
+/**
+ * @brief cpu_dispatch_supported - is an implementation usable on this host?
+ *
+ * @param d - implementations
+ * @param impl - index
+ *
+ * @return 1 if supported, else 0
+ */
+int cpu_dispatch_supported(const struct cpu_dispatch *d, int impl)
+{
+	if (impl < 0 || impl >= d->count)
+		return 0;
+	return cpu_has(d->impls[impl].feature);
+}
+
+/**
+ * @brief cpu_dispatch_select - pick the best implementation for this host
+ *
+ * @param d - implementations
+ *
+ * @return index of the implementation
+ */
+int cpu_dispatch_select(struct cpu_dispatch *d)
+{
+	int impl;
+
+	if (d->best >= 0)
+		return d->best;
+	if (d->init != NULL)
+		d->init();
+	for (impl = d->count - 1; impl > 0; impl--)
+		if (cpu_dispatch_supported(d, impl))
+			break;
+	d->best = impl;
+	return impl;
+}
+
+/**
+ * @brief cpu_dispatch_name - printable name of an implementation
+ *
+ * @param d - implementations
+ * @param impl - index, or -1 for the one picked
+ *
+ * @return name string
+ */
+const char *cpu_dispatch_name(struct cpu_dispatch *d, int impl)
+{
+	if (impl < 0)
+		impl = cpu_dispatch_select(d);
+	if (impl >= d->count)
+		return "unknown";
+	return d->impls[impl].name;
+}
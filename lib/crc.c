@@ -0,0 +1,118 @@
+/**
+ * @file
+ * @brief checksum helpers
+ *
+ * FileName: lib/crc.c
+ *
+ * Implements the APIs in include/crc.h
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#include <crc.h>
+
+/* Reflected CRC32 polynomial */
+#define CRC32_POLY	0xEDB88320
+/* CCITT polynomial, not reflected */
+#define CRC16_POLY	0x1021
+
+static unsigned int crc32_table[256];
+static unsigned short crc16_table[256];
+
+/**
+ * @brief crc32_init - build the lookup table on first use
+ */
+static void crc32_init(void)
+{
+	unsigned int i, j, c;
+
+	for (i = 0; i < 256; i++) {
+		c = i;
+		for (j = 0; j < 8; j++)
+			c = (c & 1) ? (c >> 1) ^ CRC32_POLY : c >> 1;
+		crc32_table[i] = c;
+	}
+}
+
+/**
+ * @brief crc32_update - update a running CRC32 (IEEE 802.3)
+ *
+ * @param crc - CRC of previous data, 0 to start with
+ * @param buf - data
+ * @param len - size of data
+ *
+ * @return updated CRC
+ */
+unsigned int crc32_update(unsigned int crc, const unsigned char *buf,
+			  unsigned int len)
+{
+	if (!crc32_table[1])
+		crc32_init();
+	crc = ~crc;
+	while (len--)
+		crc = crc32_table[(crc ^ *buf++) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+/**
+ * @brief crc16_init - build the lookup table on first use
+ */
+static void crc16_init(void)
+{
+	unsigned int i, j;
+	unsigned short c;
+
+	for (i = 0; i < 256; i++) {
+		c = i << 8;
+		for (j = 0; j < 8; j++)
+			c = (c & 0x8000) ? (c << 1) ^ CRC16_POLY : c << 1;
+		crc16_table[i] = c;
+	}
+}
+
+/**
+ * @brief crc_init - build the lookup tables
+ *
+ * Must be called before the CRCs are used from more than one thread, the
+ * lazy set up on first use is not thread safe.
+ */
+void crc_init(void)
+{
+	crc32_init();
+	crc16_init();
+}
+
+/**
+ * @brief crc16_update - update a running CRC-16/XMODEM (CCITT, 0x1021)
+ *
+ * @param crc - CRC of previous data, 0 to start with
+ * @param buf - data
+ * @param len - size of data
+ *
+ * @return updated CRC
+ */
+unsigned short crc16_update(unsigned short crc, const unsigned char *buf,
+			    unsigned int len)
+{
+	if (!crc16_table[1])
+		crc16_init();
+	while (len--)
+		crc = crc16_table[((crc >> 8) ^ *buf++) & 0xFF] ^ (crc << 8);
+	return crc;
+}
@@ -29,6 +29,8 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include "file.h"
 #include <common.h>
@@ -146,3 +148,60 @@ int f_seek(long offset)
 	F_INFO("seek operation returned %d\n", ret);
 	return ret;
 }
+
+/**
+ * @brief f_map - map a whole file to memory, read only
+ *
+ * Independent of the file opened with f_open. The pages are read in as
+ * they are first touched, read ahead for a sequential pass.
+ *
+ * @param f_name file name
+ * @param size gets the size of the file
+ *
+ * @return the mapping, NULL on error (or for an empty file)
+ */
+const unsigned char *f_map(const char *f_name, unsigned long *size)
+{
+	struct stat f_stat;
+	void *map;
+	int fd;
+
+	fd = open(f_name, O_RDONLY);
+	if (fd < 0) {
+		F_ERROR("could not open file %s\n", f_name);
+		return NULL;
+	}
+	if (fstat(fd, &f_stat) || !f_stat.st_size) {
+		F_ERROR("could not stat %s or empty file\n", f_name);
+		close(fd);
+		return NULL;
+	}
+	map = mmap(NULL, f_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	/* the mapping holds on to the file */
+	close(fd);
+	if (map == MAP_FAILED) {
+		F_ERROR("could not map file %s\n", f_name);
+		return NULL;
+	}
+	madvise(map, f_stat.st_size, MADV_SEQUENTIAL);
+	*size = f_stat.st_size;
+	F_INFO("file %s mapped, %lu bytes\n", f_name, *size);
+	return map;
+}
+
+/**
+ * @brief f_unmap - unmap a file mapped with f_map
+ *
+ * @param map mapping
+ * @param size size of the file
+ *
+ * @return pass/fail
+ */
+signed char f_unmap(const unsigned char *map, unsigned long size)
+{
+	if (munmap((void *)map, size)) {
+		F_ERROR("could not unmap file\n");
+		return FILE_ERROR;
+	}
+	return FILE_OK;
+}
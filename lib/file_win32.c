@@ -174,3 +174,88 @@ signed int f_read(unsigned char *buffer, unsigned int read_size)
 
 	return total_read;
 }
+
+/**
+ * @brief f_seek - seek to location in file
+ *
+ * @param offset in file
+ *
+ * @return status
+ */
+int f_seek(long offset)
+{
+	if (Fhandle == INVALID_HANDLE_VALUE) {
+		F_ERROR("File not opened to seek!\n");
+		return FILE_ERROR;
+	}
+	if (SetFilePointer(Fhandle, offset, NULL, FILE_BEGIN) ==
+	    INVALID_SET_FILE_POINTER) {
+		F_ERROR("Seek to %ld failed! error = %i\n", offset,
+			(int)GetLastError());
+		return FILE_ERROR;
+	}
+	return FILE_OK;
+}
+
+/**
+ * @brief f_map - map a whole file to memory, read only
+ *
+ * Independent of the file opened with f_open.
+ *
+ * @param f_name file name
+ * @param size gets the size of the file
+ *
+ * @return the mapping, NULL on error (or for an empty file)
+ */
+const unsigned char *f_map(const char *f_name, unsigned long *size)
+{
+	HANDLE MF, Mapping;
+	DWORD High, Low;
+	void *map = NULL;
+
+	MF = CreateFile(f_name, GENERIC_READ, FILE_SHARE_READ, NULL,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (MF == INVALID_HANDLE_VALUE) {
+		F_ERROR("%s: Could not open file: Error=%i\n", f_name,
+			(int)GetLastError());
+		return NULL;
+	}
+	Low = GetFileSize(MF, &High);
+	if (High || Low == 0xFFFFFFFF || !Low) {
+		F_ERROR("%s: High %d Low %d - cannot map\n", f_name,
+			(unsigned int)High, (unsigned int)Low);
+		CloseHandle(MF);
+		return NULL;
+	}
+	Mapping = CreateFileMapping(MF, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (Mapping != NULL) {
+		map = MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+		/* the view holds on to the file */
+		CloseHandle(Mapping);
+	}
+	CloseHandle(MF);
+	if (map == NULL) {
+		F_ERROR("%s: Could not map file: Error=%i\n", f_name,
+			(int)GetLastError());
+		return NULL;
+	}
+	*size = Low;
+	return map;
+}
+
+/**
+ * @brief f_unmap - unmap a file mapped with f_map
+ *
+ * @param map mapping
+ * @param size size of the file
+ *
+ * @return pass/fail
+ */
+signed char f_unmap(const unsigned char *map, unsigned long size)
+{
+	if (!UnmapViewOfFile(map)) {
+		F_ERROR("Could not unmap file: Error=%i\n", (int)GetLastError());
+		return FILE_ERROR;
+	}
+	return FILE_OK;
+}
@@ -0,0 +1,264 @@
+/**
+ * @file
+ * @brief U-Boot memory dump decoder with runtime selected SIMD versions
+ *
+ * FileName: lib/h_decode.c
+ *
+ * Implements the APIs in include/h_decode.h
+ *
+ * The scalar decoder walks the words of a line a hex digit at a time.
+ * The SSE2 decoder takes full lines (4 words, the bulk of any dump): the
+ * 32 digits are gathered next to each other, classified and converted 16
+ * at a time, and paired up into bytes with 16 bit shifts. Anything else
+ * (the last line of a dump, lines which are not md.l output) goes to the
+ * scalar decoder.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#include <string.h>
+
+#include <h_decode.h>
+#include <cpu_dispatch.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define H_DECODE_X86
+#include <immintrin.h>
+#endif
+
+/* "80000000: " then words of 8 digits, each after a space */
+#define H_ADDR_DIGITS		8
+#define H_WORD_DIGITS		8
+#define H_FIRST_WORD		(H_ADDR_DIGITS + 2)
+#define H_WORD_STEP		(H_WORD_DIGITS + 1)
+#define H_WORDS_MAX		(H_DEC_LINE_MAX / 4)
+
+typedef int (*h_decode_fn) (const char *line, unsigned int len,
+			    unsigned long *addr, unsigned char *out);
+
+/**
+ * @brief h_hex8 - value of 8 hex digits
+ *
+ * @param p - digits
+ * @param value - gets the value
+ *
+ * @return 0 or -1 if one is not a hex digit
+ */
+static inline int h_hex8(const char *p, unsigned long *value)
+{
+	unsigned long v = 0;
+	unsigned char c;
+	int i;
+
+	for (i = 0; i < H_WORD_DIGITS; i++) {
+		c = p[i];
+		if (c >= '0' && c <= '9')
+			c -= '0';
+		else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+			c = (c | 0x20) - 'a' + 10;
+		else
+			return -1;
+		v = (v << 4) | c;
+	}
+	*value = v;
+	return 0;
+}
+
+/**
+ * @brief h_decode_scalar - word at a time decoder, works everywhere
+ */
+static int h_decode_scalar(const char *line, unsigned int len,
+			   unsigned long *addr, unsigned char *out)
+{
+	unsigned int pos = H_FIRST_WORD, n = 0;
+	unsigned long w;
+	char end;
+
+	if (len < H_FIRST_WORD + H_WORD_DIGITS || line[H_ADDR_DIGITS] != ':' ||
+	    h_hex8(line, addr))
+		return -1;
+	/* the ASCII column comes after more than one space */
+	while (n < H_DEC_LINE_MAX && pos + H_WORD_DIGITS <= len &&
+	       line[pos - 1] == ' ' && !h_hex8(line + pos, &w)) {
+		end = (pos + H_WORD_DIGITS < len) ? line[pos + H_WORD_DIGITS] :
+		    ' ';
+		if (end != ' ' && end != '\r')
+			break;
+		out[n++] = w & 0xFF;
+		out[n++] = (w >> 8) & 0xFF;
+		out[n++] = (w >> 16) & 0xFF;
+		out[n++] = (w >> 24) & 0xFF;
+		pos += H_WORD_STEP;
+	}
+	return n ? (int)n : -1;
+}
+
+#ifdef H_DECODE_X86
+/**
+ * @brief h_nibbles_sse2 - hex digits to their values
+ *
+ * @param v - 16 characters
+ * @param valid - cleared if one of them is not a hex digit
+ *
+ * @return the 16 values
+ */
+__attribute__ ((target("sse2")))
+static inline __m128i h_nibbles_sse2(__m128i v, int *valid)
+{
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i five = _mm_set1_epi8(5);
+	__m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+	__m128i l = _mm_sub_epi8(_mm_or_si128(v, _mm_set1_epi8(0x20)),
+				 _mm_set1_epi8('a'));
+	/* unsigned d <= 9 and l <= 5 */
+	__m128i is_d = _mm_cmpeq_epi8(_mm_max_epu8(d, nine), nine);
+	__m128i is_l = _mm_cmpeq_epi8(_mm_max_epu8(l, five), five);
+
+	if (_mm_movemask_epi8(_mm_or_si128(is_d, is_l)) != 0xFFFF)
+		*valid = 0;
+	return _mm_or_si128(_mm_and_si128(is_d, d),
+			    _mm_and_si128(is_l,
+					  _mm_add_epi8(l, _mm_set1_epi8(10))));
+}
+
+/**
+ * @brief h_bytes_sse2 - pair up 16 digit values to 8 bytes
+ *
+ * @param n - values, first digit of a byte in the even lanes
+ *
+ * @return one byte in each 16 bit lane, each word in little endian order
+ */
+__attribute__ ((target("sse2")))
+static inline __m128i h_bytes_sse2(__m128i n)
+{
+	__m128i b = _mm_or_si128(_mm_slli_epi16
+				 (_mm_and_si128(n, _mm_set1_epi16(0xFF)), 4),
+				 _mm_srli_epi16(n, 8));
+
+	/* the 4 bytes of each word the other way round */
+	b = _mm_shufflelo_epi16(b, _MM_SHUFFLE(0, 1, 2, 3));
+	return _mm_shufflehi_epi16(b, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+__attribute__ ((target("sse2")))
+static int h_decode_sse2(const char *line, unsigned int len,
+			 unsigned long *addr, unsigned char *out)
+{
+	char digits[H_DEC_LINE_MAX * 2];
+	int valid = 1, i;
+	__m128i lo, hi;
+
+	/* a full line, with the ASCII column after it */
+	if (len <= H_FIRST_WORD + H_WORDS_MAX * H_WORD_STEP ||
+	    line[H_ADDR_DIGITS] != ':' ||
+	    line[H_FIRST_WORD + H_WORDS_MAX * H_WORD_STEP - 1] != ' ' ||
+	    line[H_FIRST_WORD + H_WORDS_MAX * H_WORD_STEP] != ' ')
+		return h_decode_scalar(line, len, addr, out);
+	for (i = 0; i < H_WORDS_MAX; i++) {
+		if (line[H_FIRST_WORD + i * H_WORD_STEP - 1] != ' ')
+			return h_decode_scalar(line, len, addr, out);
+		memcpy(digits + i * H_WORD_DIGITS,
+		       line + H_FIRST_WORD + i * H_WORD_STEP, H_WORD_DIGITS);
+	}
+	if (h_hex8(line, addr))
+		return -1;
+	lo = h_nibbles_sse2(_mm_loadu_si128((const __m128i *)digits), &valid);
+	hi = h_nibbles_sse2(_mm_loadu_si128((const __m128i *)(digits + 16)),
+			    &valid);
+	if (!valid)
+		return h_decode_scalar(line, len, addr, out);
+	_mm_storeu_si128((__m128i *) out,
+			 _mm_packus_epi16(h_bytes_sse2(lo), h_bytes_sse2(hi)));
+	return H_DEC_LINE_MAX;
+}
+#endif				/* H_DECODE_X86 */
+
+static const struct cpu_impl h_decode_impls[H_DEC_MAX] = {
+	[H_DEC_SCALAR] = {"scalar", CPU_ANY},
+	[H_DEC_SSE2] = {"sse2", CPU_SSE2},
+};
+
+static const h_decode_fn h_decode_fns[H_DEC_MAX] = {
+	[H_DEC_SCALAR] = h_decode_scalar,
+#ifdef H_DECODE_X86
+	[H_DEC_SSE2] = h_decode_sse2,
+#endif
+};
+
+/* Best implementation for this host, picked on first use */
+static struct cpu_dispatch h_decode_dispatch = {
+	.impls = h_decode_impls,
+	.count = H_DEC_MAX,
+	.best = -1,
+};
+
+/**
+ * @brief h_decode_supported - is an implementation usable on this host?
+ *
+ * @param impl - H_DEC_xxx
+ *
+ * @return 1 if supported, else 0
+ */
+int h_decode_supported(int impl)
+{
+	return cpu_dispatch_supported(&h_decode_dispatch, impl);
+}
+
+/**
+ * @brief h_decode_name - printable name of an implementation
+ *
+ * @param impl - H_DEC_xxx, or -1 for the one h_decode_line uses
+ *
+ * @return name string
+ */
+const char *h_decode_name(int impl)
+{
+	return cpu_dispatch_name(&h_decode_dispatch, impl);
+}
+
+/**
+ * @brief h_decode_line_with - same as h_decode_line using a specific
+ * implementation
+ *
+ * @param impl - H_DEC_xxx, must be supported by the host
+ *
+ * @return number of bytes decoded, -1 if it is not a md.l line
+ */
+int h_decode_line_with(int impl, const char *line, unsigned int len,
+		       unsigned long *addr, unsigned char *out)
+{
+	return h_decode_fns[impl] (line, len, addr, out);
+}
+
+/**
+ * @brief h_decode_line - decode a line of md.l output
+ *
+ * @param line - the line, without its end of line
+ * @param len - length of line
+ * @param addr - gets the address the line starts at
+ * @param out - gets the bytes, must be able to hold H_DEC_LINE_MAX
+ *
+ * @return number of bytes decoded, -1 if it is not a md.l line
+ */
+int h_decode_line(const char *line, unsigned int len, unsigned long *addr,
+		  unsigned char *out)
+{
+	return h_decode_fns[cpu_dispatch_select(&h_decode_dispatch)] (line, len,
+								    addr, out);
+}
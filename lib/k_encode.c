@@ -0,0 +1,387 @@
+/**
+ * @file
+ * @brief kermit data encoder with runtime selected SIMD implementations
+ *
+ * FileName: lib/k_encode.c
+ *
+ * Implements the APIs in include/k_encode.h
+ *
+ * The scalar encoder walks the data a byte at a time. The vector
+ * encoders classify 16 (SSE2) or 32 (AVX2) bytes at a time: blocks
+ * without any character to escape are copied as is, blocks with escapes
+ * are converted in the vector unit and expanded with one copy per run
+ * of plain characters. The checksum is accumulated with sum of absolute
+ * differences against zero in both cases.
+ *
+ * Only the low 8 bits of the checksum matter to kermit, so it does not
+ * matter if characters are summed as signed or unsigned.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#include <string.h>
+
+#include <k_encode.h>
+#include <cpu_dispatch.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define K_ENCODE_X86
+#include <immintrin.h>
+#endif
+
+#define escape_it(ch)		((ch) ^ 0x40)
+
+typedef unsigned int (*k_encode_fn) (unsigned char *out,
+				     const unsigned char *in,
+				     unsigned int size, unsigned int *sum);
+
+/**
+ * @brief should_escape - decides if a binary character should be escaped
+ * as per kermit protocol
+ *
+ * Escape is a concept which prefixes '#' in front of a converted character
+ * The idea is to deny CONTROL characters from going over serial port directly.
+ * so all characters 0 to 31 and 127 ASCII code is considered control
+ * characters
+ *
+ * @param out - character to be analyzed
+ *
+ * @return 1 if it should be escaped, else 0
+ */
+static inline int should_escape(unsigned char out)
+{
+	unsigned char a = out & 0x7F;	/* Get low 7 bits of character */
+	/* If data is control prefix, OR
+	 * Data is the escape character itself
+	 */
+	if ((a < SPACE || a == 0x7F)
+	    || (a == K_ESCAPE))
+		return 1;
+	return 0;
+}
+
+/**
+ * @brief k_escape - provide escape character convertion
+ *
+ * @param out - character to be escaped
+ *
+ * @return -escaped character
+ */
+static inline unsigned char k_escape(unsigned char out)
+{
+	unsigned char a = out & 0x7F;	/* Get low 7 bits of character */
+	if (a != K_ESCAPE)
+		out = escape_it(out);	/* and make character printable. */
+	/* Escape character send as is */
+	return out;
+}
+
+/**
+ * @brief k_encode_scalar - byte at a time encoder, works everywhere
+ */
+static unsigned int k_encode_scalar(unsigned char *out,
+				    const unsigned char *in,
+				    unsigned int size, unsigned int *sum)
+{
+	unsigned int count;
+	unsigned int new_size = 0;
+	unsigned int s = 0;
+
+	for (count = 0; count < size; count++) {
+		unsigned char c = in[count];
+		/* handle kermit escape character in buffer */
+		if (should_escape(c)) {
+			out[new_size++] = K_ESCAPE;
+			s += K_ESCAPE;
+			c = k_escape(c);
+		}
+		out[new_size++] = c;
+		s += c;
+	}
+	*sum += s;
+	return new_size;
+}
+
+#ifdef K_ENCODE_X86
+/* pshufb control and output length to expand 8 characters by escape mask */
+static unsigned char k_expand_shuf[256][16];
+static unsigned char k_expand_len[256];
+
+/**
+ * @brief k_expand_init - build the escape expansion tables
+ *
+ * Source of the shuffle is the 8 converted characters followed by 8
+ * K_ESCAPE characters, so index 8 stands for the escape prefix.
+ */
+static void k_expand_init(void)
+{
+	unsigned int mask, j, o;
+
+	for (mask = 0; mask < 256; mask++) {
+		o = 0;
+		for (j = 0; j < 8; j++) {
+			if (mask & (1 << j))
+				k_expand_shuf[mask][o++] = 8;
+			k_expand_shuf[mask][o++] = j;
+		}
+		k_expand_len[mask] = o;
+		while (o < 16)
+			k_expand_shuf[mask][o++] = 8;
+	}
+}
+
+/**
+ * @brief k_expand - write a converted block with escape prefixes
+ *
+ * Branch free so that the mix of escaped and plain characters does not
+ * matter.
+ *
+ * @param out - output buffer
+ * @param conv - converted block (escaped characters already made printable)
+ * @param mask - bit n set if character n needs an escape prefix
+ * @param len - block length
+ *
+ * @return number of bytes written
+ */
+static inline unsigned int k_expand(unsigned char *out,
+				    const unsigned char *conv,
+				    unsigned int mask, unsigned int len)
+{
+	unsigned int j, o = 0, esc;
+
+	for (j = 0; j < len; j++) {
+		esc = (mask >> j) & 1;
+		out[o] = K_ESCAPE;
+		out[o + esc] = conv[j];
+		o += 1 + esc;
+	}
+	return o;
+}
+
+__attribute__ ((target("sse2")))
+static unsigned int k_encode_sse2(unsigned char *out,
+				  const unsigned char *in,
+				  unsigned int size, unsigned int *sum)
+{
+	const __m128i low7 = _mm_set1_epi8(0x7F);
+	const __m128i space = _mm_set1_epi8(SPACE);
+	const __m128i del = _mm_set1_epi8(0x7F);
+	const __m128i esc = _mm_set1_epi8(K_ESCAPE);
+	const __m128i flip = _mm_set1_epi8(0x40);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc = zero;
+	unsigned char conv[16];
+	unsigned int i = 0, o = 0, s = 0;
+
+	for (; i + 16 <= size; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + i));
+		__m128i a = _mm_and_si128(v, low7);
+		__m128i is_esc = _mm_cmpeq_epi8(a, esc);
+		__m128i need = _mm_or_si128(_mm_cmplt_epi8(a, space),
+					    _mm_or_si128(_mm_cmpeq_epi8(a, del),
+							 is_esc));
+		unsigned int mask = _mm_movemask_epi8(need);
+
+		if (!mask) {
+			_mm_storeu_si128((__m128i *) (out + o), v);
+			acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+			o += 16;
+			continue;
+		}
+		/* The escape character itself goes as is, rest flip bit 6 */
+		v = _mm_xor_si128(v,
+				  _mm_and_si128(_mm_andnot_si128(is_esc, need),
+						flip));
+		acc = _mm_add_epi64(acc, _mm_sad_epu8(v, zero));
+		s += K_ESCAPE * __builtin_popcount(mask);
+		_mm_storeu_si128((__m128i *) conv, v);
+		o += k_expand(out + o, conv, mask, 16);
+	}
+	s += _mm_cvtsi128_si32(acc) +
+	    _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc, acc));
+	*sum += s;
+	return o + k_encode_scalar(out + o, in + i, size - i, sum);
+}
+
+__attribute__ ((target("avx2")))
+static unsigned int k_encode_avx2(unsigned char *out,
+				  const unsigned char *in,
+				  unsigned int size, unsigned int *sum)
+{
+	const __m256i low7 = _mm256_set1_epi8(0x7F);
+	const __m256i space = _mm256_set1_epi8(SPACE);
+	const __m256i del = _mm256_set1_epi8(0x7F);
+	const __m256i esc = _mm256_set1_epi8(K_ESCAPE);
+	const __m256i flip = _mm256_set1_epi8(0x40);
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i acc = zero;
+	__m128i acc128;
+	unsigned int i = 0, o = 0, s = 0, j;
+
+	for (; i + 32 <= size; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(in + i));
+		__m256i a = _mm256_and_si256(v, low7);
+		__m256i is_esc = _mm256_cmpeq_epi8(a, esc);
+		__m256i need = _mm256_or_si256(_mm256_cmpgt_epi8(space, a),
+					       _mm256_or_si256
+					       (_mm256_cmpeq_epi8(a, del),
+						is_esc));
+		unsigned int mask = _mm256_movemask_epi8(need);
+
+		if (!mask) {
+			_mm256_storeu_si256((__m256i *) (out + o), v);
+			acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+			o += 32;
+			continue;
+		}
+		/* The escape character itself goes as is, rest flip bit 6 */
+		v = _mm256_xor_si256(v,
+				     _mm256_and_si256(_mm256_andnot_si256
+						      (is_esc, need), flip));
+		acc = _mm256_add_epi64(acc, _mm256_sad_epu8(v, zero));
+		s += K_ESCAPE * __builtin_popcount(mask);
+		/* 8 characters at a time; can write up to 16 bytes at o, which
+		 * is always within the 2 * size output buffer */
+		for (j = 0; j < 4; j++) {
+			__m128i half = (j & 2) ?
+			    _mm256_extracti128_si256(v, 1) :
+			    _mm256_castsi256_si128(v);
+			unsigned int m = (mask >> (j * 8)) & 0xFF;
+
+			if (j & 1)
+				half = _mm_srli_si128(half, 8);
+			half = _mm_unpacklo_epi64(half, _mm256_castsi256_si128
+						  (esc));
+			_mm_storeu_si128((__m128i *) (out + o),
+					 _mm_shuffle_epi8(half,
+							  _mm_loadu_si128
+							  ((const __m128i *)
+							   k_expand_shuf[m])));
+			o += k_expand_len[m];
+		}
+	}
+	acc128 = _mm_add_epi64(_mm256_castsi256_si128(acc),
+			       _mm256_extracti128_si256(acc, 1));
+	s += _mm_cvtsi128_si32(acc128) +
+	    _mm_cvtsi128_si32(_mm_unpackhi_epi64(acc128, acc128));
+	*sum += s;
+	return o + k_encode_sse2(out + o, in + i, size - i, sum);
+}
+#endif				/* K_ENCODE_X86 */
+
+static const struct cpu_impl k_encode_impls[K_ENC_MAX] = {
+	[K_ENC_SCALAR] = {"scalar", CPU_ANY},
+	[K_ENC_SSE2] = {"sse2", CPU_SSE2},
+	[K_ENC_AVX2] = {"avx2", CPU_AVX2},
+};
+
+static const k_encode_fn k_encode_fns[K_ENC_MAX] = {
+	[K_ENC_SCALAR] = k_encode_scalar,
+#ifdef K_ENCODE_X86
+	[K_ENC_SSE2] = k_encode_sse2,
+	[K_ENC_AVX2] = k_encode_avx2,
+#endif
+};
+
+/* Best implementation for this host, picked on first use */
+static struct cpu_dispatch k_encode_dispatch = {
+	.impls = k_encode_impls,
+	.count = K_ENC_MAX,
+#ifdef K_ENCODE_X86
+	.init = k_expand_init,
+#endif
+	.best = -1,
+};
+
+/**
+ * @brief k_encode_supported - is an implementation usable on this host?
+ *
+ * @param impl - K_ENC_xxx
+ *
+ * @return 1 if supported, else 0
+ */
+int k_encode_supported(int impl)
+{
+	return cpu_dispatch_supported(&k_encode_dispatch, impl);
+}
+
+/**
+ * @brief k_encode_select - pick the best implementation for this host
+ *
+ * @return K_ENC_xxx
+ */
+static int k_encode_select(void)
+{
+	return cpu_dispatch_select(&k_encode_dispatch);
+}
+
+/**
+ * @brief k_encode_init - pick the implementation and build its tables
+ *
+ * k_encode otherwise does this on its first call, unsynchronised: call
+ * it before threads encode at once.
+ */
+void k_encode_init(void)
+{
+	k_encode_select();
+}
+
+/**
+ * @brief k_encode_name - printable name of an implementation
+ *
+ * @param impl - K_ENC_xxx, or -1 for the one k_encode uses
+ *
+ * @return name string
+ */
+const char *k_encode_name(int impl)
+{
+	return cpu_dispatch_name(&k_encode_dispatch, impl);
+}
+
+/**
+ * @brief k_encode_with - same as k_encode using a specific implementation
+ *
+ * @param impl - K_ENC_xxx, must be supported by the host
+ *
+ * @return number of bytes written to out
+ */
+unsigned int k_encode_with(int impl, unsigned char *out,
+			   const unsigned char *in, unsigned int size,
+			   unsigned int *sum)
+{
+	/* make sure the tables are ready */
+	k_encode_select();
+	return k_encode_fns[impl] (out, in, size, sum);
+}
+
+/**
+ * @brief k_encode - escape a buffer of kermit data
+ *
+ * @param out - output buffer, must be able to hold (2 * size) bytes
+ * @param in - binary data to encode
+ * @param size - number of bytes in in
+ * @param sum - running checksum, the encoded bytes are added to it
+ *
+ * @return number of bytes written to out
+ */
+unsigned int k_encode(unsigned char *out, const unsigned char *in,
+		      unsigned int size, unsigned int *sum)
+{
+	return k_encode_fns[k_encode_select()] (out, in, size, sum);
+}
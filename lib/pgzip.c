@@ -0,0 +1,289 @@
+/**
+ * @file
+ * @brief parallel gzip compressor
+ *
+ * FileName: lib/pgzip.c
+ *
+ * Implements the APIs in include/pgzip.h - the same scheme as pigz.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifndef __WIN32__
+#include <pthread.h>
+#define PGZ_THREADS
+#endif
+
+#include <pgzip.h>
+#include <timer.h>
+
+/* Input per block, and dictionary carried over from the block before */
+#define PGZ_BLOCK		(128 * 1024)
+#define PGZ_DICT		(32 * 1024)
+/* Sample used to pick the level, and how much faster than the line */
+#define PGZ_SAMPLE		(512 * 1024)
+#define PGZ_MARGIN		2
+#define PGZ_THREADS_MAX		64
+
+#define GZIP_HEADER_SIZE	10
+#define GZIP_TRAILER_SIZE	8
+
+/**
+ * Compression job: the blocks are handed out to the threads in order
+ */
+struct pgz_job {
+	const unsigned char *in;
+	unsigned long size;
+	int level;
+	unsigned long blocks;
+	/** next block to take */
+	unsigned long next;
+	/** per block output, size and crc32 */
+	unsigned char **out;
+	unsigned long *out_size;
+	unsigned long *crc;
+	int error;
+#ifdef PGZ_THREADS
+	pthread_mutex_t lock;
+#endif
+};
+
+/**
+ * @brief pgz_block - deflate one block
+ *
+ * @param job - the job
+ * @param n - block number
+ *
+ * @return 0 or error
+ */
+static int pgz_block(struct pgz_job *job, unsigned long n)
+{
+	z_stream strm;
+	unsigned long start = n * PGZ_BLOCK;
+	unsigned long len = (job->size - start > PGZ_BLOCK) ?
+	    PGZ_BLOCK : job->size - start;
+	unsigned long dict = (start > PGZ_DICT) ? PGZ_DICT : start;
+	int last = (n == job->blocks - 1);
+	unsigned long bound;
+	int ret;
+
+	memset(&strm, 0, sizeof(strm));
+	/* raw deflate, the gzip wrapper is put around all blocks */
+	if (deflateInit2(&strm, job->level, Z_DEFLATED, -15, 8,
+			 Z_DEFAULT_STRATEGY) != Z_OK)
+		return -1;
+	if (dict)
+		deflateSetDictionary(&strm, job->in + start - dict, dict);
+	/* a sync flush adds up to 5 bytes, a few more for the end */
+	bound = deflateBound(&strm, len) + 16;
+	job->out[n] = malloc(bound);
+	if (job->out[n] == NULL) {
+		deflateEnd(&strm);
+		return -1;
+	}
+	strm.next_in = (unsigned char *)job->in + start;
+	strm.avail_in = len;
+	strm.next_out = job->out[n];
+	strm.avail_out = bound;
+	ret = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+	job->out_size[n] = bound - strm.avail_out;
+	deflateEnd(&strm);
+	if (ret != (last ? Z_STREAM_END : Z_OK) || strm.avail_in)
+		return -1;
+	job->crc[n] = crc32(0L, job->in + start, len);
+	return 0;
+}
+
+/**
+ * @brief pgz_worker - take blocks till none are left
+ *
+ * @param arg - the job
+ *
+ * @return NULL
+ */
+static void *pgz_worker(void *arg)
+{
+	struct pgz_job *job = arg;
+	unsigned long n;
+
+	while (1) {
+#ifdef PGZ_THREADS
+		pthread_mutex_lock(&job->lock);
+#endif
+		n = job->next++;
+#ifdef PGZ_THREADS
+		pthread_mutex_unlock(&job->lock);
+#endif
+		if (n >= job->blocks)
+			break;
+		if (pgz_block(job, n))
+			job->error = 1;
+	}
+	return NULL;
+}
+
+/**
+ * @brief pgz_threads - number of compression threads to use
+ *
+ * @return online CPUs (1 if threads are not supported)
+ */
+int pgz_threads(void)
+{
+#if defined(PGZ_THREADS) && defined(_SC_NPROCESSORS_ONLN)
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (n < 1)
+		return 1;
+	return (n > PGZ_THREADS_MAX) ? PGZ_THREADS_MAX : n;
+#else
+	return 1;
+#endif
+}
+
+/**
+ * @brief pgz_compress - compress to a gzip stream on several threads
+ *
+ * @param in - data
+ * @param size - size of data
+ * @param level - compression level 1..9
+ * @param threads - threads to use
+ * @param out_size - gets the size of the gzip stream
+ * @param crc - gets the crc32 of the data (as in the gzip trailer)
+ *
+ * @return gzip stream (to free() once done) or NULL on error
+ */
+unsigned char *pgz_compress(const unsigned char *in, unsigned long size,
+			    int level, int threads, unsigned long *out_size,
+			    unsigned int *crc)
+{
+	struct pgz_job job;
+	unsigned char *out = NULL, *p;
+	unsigned long total = GZIP_HEADER_SIZE + GZIP_TRAILER_SIZE, n, len;
+	unsigned long c = 0;
+#ifdef PGZ_THREADS
+	pthread_t tid[PGZ_THREADS_MAX];
+	int i, started = 0;
+#endif
+
+	memset(&job, 0, sizeof(job));
+	job.in = in;
+	job.size = size;
+	job.level = level;
+	/* an empty input still needs its (empty) final block */
+	job.blocks = size ? (size + PGZ_BLOCK - 1) / PGZ_BLOCK : 1;
+	job.out = calloc(job.blocks, sizeof(*job.out));
+	job.out_size = calloc(job.blocks, sizeof(*job.out_size));
+	job.crc = calloc(job.blocks, sizeof(*job.crc));
+	if (job.out == NULL || job.out_size == NULL || job.crc == NULL)
+		goto out;
+#ifdef PGZ_THREADS
+	pthread_mutex_init(&job.lock, NULL);
+	if (threads > PGZ_THREADS_MAX)
+		threads = PGZ_THREADS_MAX;
+	/* this thread works as well */
+	for (i = 1; i < threads && (unsigned long)i < job.blocks; i++) {
+		if (pthread_create(&tid[i], NULL, pgz_worker, &job))
+			break;
+		started = i;
+	}
+	pgz_worker(&job);
+	for (i = 1; i <= started; i++)
+		pthread_join(tid[i], NULL);
+	pthread_mutex_destroy(&job.lock);
+#else
+	pgz_worker(&job);
+#endif
+	if (job.error)
+		goto out;
+
+	for (n = 0; n < job.blocks; n++)
+		total += job.out_size[n];
+	out = malloc(total);
+	if (out == NULL)
+		goto out;
+	/* magic, deflate, no flags, no time, no extra flags, OS unknown */
+	p = out;
+	memcpy(p, "\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\xff",
+	       GZIP_HEADER_SIZE);
+	p += GZIP_HEADER_SIZE;
+	for (n = 0; n < job.blocks; n++) {
+		memcpy(p, job.out[n], job.out_size[n]);
+		p += job.out_size[n];
+		len = (size - n * PGZ_BLOCK > PGZ_BLOCK) ?
+		    PGZ_BLOCK : size - n * PGZ_BLOCK;
+		c = n ? crc32_combine(c, job.crc[n], len) : job.crc[n];
+	}
+	/* crc32 and size, little endian */
+	for (n = 0; n < 4; n++)
+		*p++ = (c >> (8 * n)) & 0xFF;
+	for (n = 0; n < 4; n++)
+		*p++ = (size >> (8 * n)) & 0xFF;
+	*out_size = total;
+	*crc = c;
+out:
+	if (job.out != NULL)
+		for (n = 0; n < job.blocks; n++)
+			free(job.out[n]);
+	free(job.out);
+	free(job.out_size);
+	free(job.crc);
+	return out;
+}
+
+/**
+ * @brief pgz_auto_level - pick a level which keeps up with the line
+ *
+ * @param in - data (a sample of its start is used)
+ * @param size - size of data
+ * @param threads - threads the data will be compressed with
+ * @param line_rate - bytes/s the line carries
+ * @param speed - if not NULL, gets the measured bytes/s of the level
+ *
+ * @return compression level 1..9
+ */
+int pgz_auto_level(const unsigned char *in, unsigned long size, int threads,
+		   unsigned long line_rate, double *speed)
+{
+	unsigned long sample = (size > PGZ_SAMPLE) ? PGZ_SAMPLE : size;
+	unsigned long out_size;
+	unsigned long long start, elapsed;
+	unsigned char *out;
+	unsigned int crc;
+	double rate = 0;
+	int level;
+
+	for (level = Z_BEST_COMPRESSION;; level--) {
+		start = t_now_us();
+		/* one thread: measures the speed of a core */
+		out = pgz_compress(in, sample, level, 1, &out_size, &crc);
+		elapsed = t_now_us() - start;
+		free(out);
+		rate = elapsed ? (double)sample * 1000000.0 / elapsed : 1e12;
+		if (rate * threads >= (double)line_rate * PGZ_MARGIN ||
+		    level == Z_BEST_SPEED)
+			break;
+	}
+	if (speed != NULL)
+		*speed = rate * threads;
+	return level;
+}
@@ -40,8 +40,13 @@
 #include <unistd.h>
 #include <errno.h>
 #include <sys/ioctl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #include <serial.h>
+#include <umux.h>
+#include <timer.h>
 #include <common.h>
 
 /************* CONSTS ***************/
@@ -60,6 +65,137 @@
 static unsigned char port[30];
 static int fd;
 static struct termios oldtio, newtio;
+/* oldtio holds the settings from before the first s_configure */
+static int oldtio_saved;
+/* Deadlines from s_set_timeouts, all in us, 0 for none */
+static struct {
+	unsigned long long first;
+	unsigned long long idle;
+	unsigned long long total;
+	/** when armed, and when the last byte came in */
+	unsigned long long armed;
+	unsigned long long last_rx;
+	int got_first;
+	/** which one made the last read time out */
+	int fired;
+} tmo;
+/* Set if the port is a umux socket, and the baudrate umux runs it at */
+static int mux;
+static unsigned long mux_baud;
+
+/* Rates known to termios here, more are added by newer libc headers */
+static const struct {
+	unsigned long rate;
+	speed_t code;
+} baud_table[] = {
+	{9600, B9600},
+	{19200, B19200},
+	{38400, B38400},
+	{57600, B57600},
+	{115200, B115200},
+#ifdef B230400
+	{230400, B230400},
+#endif
+#ifdef B460800
+	{460800, B460800},
+#endif
+#ifdef B500000
+	{500000, B500000},
+#endif
+#ifdef B576000
+	{576000, B576000},
+#endif
+#ifdef B921600
+	{921600, B921600},
+#endif
+#ifdef B1000000
+	{1000000, B1000000},
+#endif
+#ifdef B1152000
+	{1152000, B1152000},
+#endif
+#ifdef B1500000
+	{1500000, B1500000},
+#endif
+#ifdef B2000000
+	{2000000, B2000000},
+#endif
+#ifdef B2500000
+	{2500000, B2500000},
+#endif
+#ifdef B3000000
+	{3000000, B3000000},
+#endif
+#ifdef B3500000
+	{3500000, B3500000},
+#endif
+#ifdef B4000000
+	{4000000, B4000000},
+#endif
+};
+
+/**
+ * @brief s_mux_open - take the lease on a port shared by umux
+ *
+ * Blocks till the leases asked for before ours are over.
+ *
+ * @param t_port - path of the umux socket
+ *
+ * @return success/fail
+ */
+static signed char s_mux_open(char *t_port)
+{
+	struct sockaddr_un addr;
+	struct pollfd pfd;
+	char line[UMUX_LINE_MAX];
+	unsigned int len = 0;
+	int ret;
+
+	if (strlen(t_port) >= sizeof(addr.sun_path)) {
+		APP_ERROR("socket path %s is too long\n", t_port)
+		    return SERIAL_FAILED;
+	}
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		fd = 0;
+		S_ERROR("failed to create socket\n");
+		return SERIAL_FAILED;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, t_port);
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    write(fd, UMUX_LEASE, strlen(UMUX_LEASE)) < 0) {
+		S_ERROR("failed to connect to %s\n", t_port);
+		close(fd);
+		fd = 0;
+		return SERIAL_FAILED;
+	}
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	if (!poll(&pfd, 1, 1000))
+		printf("Waiting for the lease on %s..\n", t_port);
+	/* byte by byte: the console follows the reply line */
+	while (len < sizeof(line) - 1) {
+		ret = read(fd, line + len, 1);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0 || line[len++] == '\n')
+			break;
+	}
+	line[len] = 0;
+	if (strncmp(line, UMUX_OK, strlen(UMUX_OK)) ||
+	    sscanf(line + strlen(UMUX_OK), "%lu", &mux_baud) != 1) {
+		APP_ERROR("%s: umux did not grant the lease\n", t_port)
+		close(fd);
+		fd = 0;
+		return SERIAL_FAILED;
+	}
+	mux = 1;
+	snprintf((char *)port, sizeof(port), "%s", t_port);
+	S_INFO("Serial port %s shared by umux at %lu\n", port, mux_baud);
+	return SERIAL_OK;
+}
 
 /**************** EXPOSED FUNCTIONS  ****************/
 /**
@@ -73,10 +209,14 @@ signed char s_open(char *t_port)
 {
 	int x;
 	char cmd[200];
+	struct stat st;
 	if (fd) {
 		S_ERROR("Port is already open\n");
 		return SERIAL_FAILED;
 	}
+	/* a socket is a port shared by umux */
+	if (!stat(t_port, &st) && S_ISSOCK(st.st_mode))
+		return s_mux_open(t_port);
 	/* Check if serial port is used by other process */
 
 	/* NOTE: it is a bad idea to use lsof, but the alternative
@@ -115,16 +255,35 @@ signed char s_configure(unsigned long s_baud_rate, unsigned char s_parity,
 			unsigned char s_stop_bits, unsigned char s_data_bits)
 {
 	int ret;
+	unsigned int i;
+	speed_t speed;
 
 	if (!fd) {
 		S_ERROR("terminal is not open!\n");
 		return SERIAL_FAILED;
 	}
-	/* save current port settings */
-	ret = tcgetattr(fd, &oldtio);
-	if (ret < 0) {
-		S_ERROR("failed to set get old attribs\n");
-		return SERIAL_FAILED;
+	/* umux owns the line settings, they can only be checked */
+	if (mux) {
+		if (s_baud_rate != mux_baud || s_parity != NOPARITY ||
+		    s_stop_bits != ONE_STOP_BIT || s_data_bits != 8) {
+			APP_ERROR("%s is shared by umux at %lu 8N1, which "
+				  "cannot be changed\n", port, mux_baud)
+			    return SERIAL_FAILED;
+		}
+		return SERIAL_OK;
+	}
+	/*
+	 * save current port settings - only the first time, a port may be
+	 * reconfigured (eg. baudrate switch) and s_close must still restore
+	 * what was there before we touched it
+	 */
+	if (!oldtio_saved) {
+		ret = tcgetattr(fd, &oldtio);
+		if (ret < 0) {
+			S_ERROR("failed to set get old attribs\n");
+			return SERIAL_FAILED;
+		}
+		oldtio_saved = 1;
 	}
 
 	/* get current settings, and modify as needed */
@@ -134,20 +293,17 @@ signed char s_configure(unsigned long s_baud_rate, unsigned char s_parity,
 		return SERIAL_FAILED;
 	}
 
-	switch (s_baud_rate) {
-	case 57600:
-		s_baud_rate = B57600;
-		break;
-	case 115200:
-		s_baud_rate = B115200;
-		break;
-		/* Add other baudrates - see /usr/include/bits/termios.h */
-	default:
+	/* Add other baudrates to baud_table - see /usr/include/bits/termios.h */
+	for (i = 0; i < sizeof(baud_table) / sizeof(baud_table[0]); i++)
+		if (baud_table[i].rate == s_baud_rate)
+			break;
+	if (i == sizeof(baud_table) / sizeof(baud_table[0])) {
 		S_ERROR("Unknown baudrate %d\n", (unsigned int)s_baud_rate);
 		return SERIAL_FAILED;
 	}
-	cfsetospeed(&newtio, s_baud_rate);
-	cfsetispeed(&newtio, s_baud_rate);
+	speed = baud_table[i].code;
+	cfsetospeed(&newtio, speed);
+	cfsetispeed(&newtio, speed);
 
 	newtio.c_cflag &= ~(CS5 | CS6 | CS7 | CS8);
 	switch (s_data_bits) {
@@ -216,7 +372,8 @@ signed char s_configure(unsigned long s_baud_rate, unsigned char s_parity,
 		S_ERROR("failed to set flush buffers\n");
 		return SERIAL_FAILED;
 	}
-	ret = tcsetattr(fd, TCSANOW, &newtio);
+	/* let data already written go out at the rate it was meant for */
+	ret = tcsetattr(fd, TCSADRAIN, &newtio);
 	if (ret < 0) {
 		S_INFO("tcsetattr -> %s (%d) fd=%d", strerror(errno), ret, fd);
 		S_ERROR("failed to set new attribs\n");
@@ -241,6 +398,12 @@ signed int s_flush(unsigned int *rx_bytes, unsigned int *tx_bytes)
 		S_ERROR("terminal is not open!\n");
 		return SERIAL_FAILED;
 	}
+	if (mux) {
+		unsigned char junk[256];
+		/* drop what umux sent so far */
+		while (recv(fd, junk, sizeof(junk), MSG_DONTWAIT) > 0) ;
+		return SERIAL_OK;
+	}
 	ret = tcflush(fd, TCIFLUSH);
 	if (ret < 0) {
 		S_ERROR("failed to flush buffers2\n");
@@ -263,6 +426,13 @@ signed char s_close(void)
 		S_ERROR("terminal is not open!\n");
 		return SERIAL_FAILED;
 	}
+	/* ends the lease, umux still sends what it got from us */
+	if (mux) {
+		ret = close(fd);
+		fd = 0;
+		mux = 0;
+		return (ret < 0) ? SERIAL_FAILED : SERIAL_OK;
+	}
 	/*
 	 * To prevent switching modes before the last vestiges
 	 * of the data bits have been send, sleep a second.
@@ -285,6 +455,7 @@ signed char s_close(void)
 	}
 	ret = close(fd);
 	fd = 0;
+	oldtio_saved = 0;
 	if (ret < 0) {
 		S_ERROR("failed to close serial file handle\n");
 		return SERIAL_FAILED;
@@ -293,13 +464,122 @@ signed char s_close(void)
 	return SERIAL_OK;
 }
 
+/**
+ * @brief s_next_deadline - earliest deadline set with s_set_timeouts
+ *
+ * @param which - gets the SERIAL_TMO_* of that deadline
+ *
+ * @return deadline in us, 0 if none is set
+ */
+static unsigned long long s_next_deadline(int *which)
+{
+	unsigned long long deadline = 0, d;
+
+	*which = SERIAL_TMO_NONE;
+	if (tmo.total) {
+		deadline = tmo.armed + tmo.total;
+		*which = SERIAL_TMO_TOTAL;
+	}
+	if (!tmo.got_first && tmo.first) {
+		d = tmo.armed + tmo.first;
+		if (!deadline || d < deadline) {
+			deadline = d;
+			*which = SERIAL_TMO_FIRST;
+		}
+	}
+	if (tmo.got_first && tmo.idle) {
+		d = tmo.last_rx + tmo.idle;
+		if (!deadline || d < deadline) {
+			deadline = d;
+			*which = SERIAL_TMO_IDLE;
+		}
+	}
+	return deadline;
+}
+
+/**
+ * @brief s_poll_read - read till size bytes came or a deadline passed
+ *
+ * @param p_buffer buffer
+ * @param size buffer length
+ * @param deadline - deadline of this read in us, 0 for none. The ones
+ *	set with s_set_timeouts apply as well.
+ *
+ * @return bytes read if any (may be less than size), SERIAL_TIMEDOUT if
+ * nothing came in time, else SERIAL_FAILED
+ */
+static signed int s_poll_read(unsigned char *p_buffer, unsigned long size,
+			      unsigned long long deadline)
+{
+	unsigned long long now, limit;
+	unsigned long got = 0;
+	struct pollfd pfd;
+	int ret = 0, which;
+
+	tmo.fired = SERIAL_TMO_NONE;
+	/* return whatever is there, poll does the waiting */
+	if (!mux && (newtio.c_cc[VMIN] || newtio.c_cc[VTIME])) {
+		newtio.c_cc[VMIN] = 0;
+		newtio.c_cc[VTIME] = 0;
+		tcsetattr(fd, TCSANOW, &newtio);
+	}
+	while (got < size) {
+		now = t_now_us();
+		limit = s_next_deadline(&which);
+		if (deadline && (!limit || deadline <= limit)) {
+			limit = deadline;
+			which = SERIAL_TMO_NONE;
+		}
+		if (limit && now >= limit) {
+			tmo.fired = which;
+			break;
+		}
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		/* round up, poll has a ms granularity */
+		ret = poll(&pfd, 1, limit ? (int)((limit - now + 999) / 1000) :
+			   -1);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0) {
+			S_ERROR("failed to poll for data\n");
+			return SERIAL_FAILED;
+		}
+		if (!ret)
+			continue;
+		ret = read(fd, p_buffer + got, size - got);
+		if (ret < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		if (ret < 0) {
+			S_ERROR("failed to read data\n");
+			return SERIAL_FAILED;
+		}
+		if (!ret && mux) {
+			APP_ERROR("%s: umux closed the connection\n", port)
+			    return SERIAL_FAILED;
+		}
+		if (ret) {
+			tmo.got_first = 1;
+			tmo.last_rx = t_now_us();
+		}
+		got += ret;
+	}
+	if (got)
+		tmo.fired = SERIAL_TMO_NONE;
+	return got ? (signed int)got : SERIAL_TIMEDOUT;
+}
+
 /**
  * @brief s_read - serial port read
  *
+ * Waits for the entire buffer, unless a timeout set with s_set_timeouts
+ * passes first.
+ *
  * @param p_buffer buffer
  * @param size buffer length
  *
- * @return bytes read if ok, else SERIAL_FAILED
+ * @return bytes read if ok (less than size only on a timeout),
+ * SERIAL_TIMEDOUT if nothing came in time, else SERIAL_FAILED
  */
 signed int s_read(unsigned char *p_buffer, unsigned long size)
 {
@@ -308,6 +588,11 @@ signed int s_read(unsigned char *p_buffer, unsigned long size)
 		S_ERROR("terminal is not open!\n");
 		return SERIAL_FAILED;
 	}
+	if (mux || tmo.first || tmo.idle || tmo.total) {
+		ret = s_poll_read(p_buffer, size, 0);
+		S_INFO("Serial read requested=%lu, read=%d\n", size, ret);
+		return ret;
+	}
 	/* read entire chunk.. no giving up! */
 	newtio.c_cc[VMIN] = size;
 	newtio.c_cc[VTIME] = VTIME_SET;
@@ -322,6 +607,80 @@ signed int s_read(unsigned char *p_buffer, unsigned long size)
 	return ret;
 }
 
+/**
+ * @brief s_read_timeout - serial port read with a time limit
+ *
+ * Unlike s_read, this does not block for ever on a silent target.
+ *
+ * @param p_buffer buffer
+ * @param size buffer length
+ * @param timeout_ms time to wait for the entire buffer
+ *
+ * @return bytes read if any (may be less than size), SERIAL_TIMEDOUT if
+ * nothing came in time, else SERIAL_FAILED
+ */
+signed int s_read_timeout(unsigned char *p_buffer, unsigned long size,
+			  unsigned int timeout_ms)
+{
+	int ret;
+
+	if (!fd) {
+		S_ERROR("terminal is not open!\n");
+		return SERIAL_FAILED;
+	}
+	ret = s_poll_read(p_buffer, size, t_now_us() + timeout_ms * 1000ULL);
+	S_INFO("Serial read requested=%lu, read=%d timeout=%u\n", size, ret,
+	       timeout_ms);
+	return ret;
+}
+
+/**
+ * @brief s_set_timeouts - bound the reads with deadlines
+ *
+ * All run on the monotonic clock from this call on, and apply to s_read,
+ * s_getc and s_read_timeout till they are set again.
+ *
+ * @param first_ms - time for the first byte to come, 0 for no limit
+ * @param idle_ms - longest silence after that, 0 for no limit
+ * @param total_ms - time for everything, 0 for no limit
+ *
+ * @return SERIAL_OK
+ */
+signed int s_set_timeouts(unsigned int first_ms, unsigned int idle_ms,
+			  unsigned int total_ms)
+{
+	tmo.first = first_ms * 1000ULL;
+	tmo.idle = idle_ms * 1000ULL;
+	tmo.total = total_ms * 1000ULL;
+	tmo.armed = t_now_us();
+	tmo.last_rx = tmo.armed;
+	tmo.got_first = 0;
+	tmo.fired = SERIAL_TMO_NONE;
+	return SERIAL_OK;
+}
+
+/**
+ * @brief s_timeout_which - which deadline ended the last read
+ *
+ * @return SERIAL_TMO_FIRST, SERIAL_TMO_IDLE or SERIAL_TMO_TOTAL if the last
+ * read returned SERIAL_TIMEDOUT because of s_set_timeouts, else
+ * SERIAL_TMO_NONE
+ */
+int s_timeout_which(void)
+{
+	return tmo.fired;
+}
+
+/**
+ * @brief s_fd - file descriptor of the open port, for poll()
+ *
+ * @return descriptor, 0 if the port is not open
+ */
+int s_fd(void)
+{
+	return fd;
+}
+
 /**
  * @brief s_write - write to serial port
  *
@@ -337,6 +696,21 @@ signed int s_write(unsigned char *p_buffer, unsigned long size)
 		S_ERROR("terminal is not open!\n");
 		return SERIAL_FAILED;
 	}
+	if (mux) {
+		unsigned long done = 0;
+		/* nothing to drain, umux paces the port */
+		while (done < size) {
+			ret = write(fd, p_buffer + done, size - done);
+			if (ret < 0 && errno == EINTR)
+				continue;
+			if (ret < 0) {
+				S_ERROR("failed to write data\n");
+				return SERIAL_FAILED;
+			}
+			done += ret;
+		}
+		return done;
+	}
 	ret = write(fd, p_buffer, size);
 	if (ret < 0) {
 		S_ERROR("failed to write data\n");
@@ -378,6 +752,8 @@ signed int s_getc(void)
 	unsigned char x = 0;
 	int ret = 0;
 	ret = s_read(&x, 1);
+	if (ret == SERIAL_TIMEDOUT)
+		return ret;
 	if (ret < 0) {
 		S_ERROR("getc failed-%d\n", ret);
 		return ret;
@@ -421,6 +797,10 @@ signed int s_break(int sec_stay, int sec_post)
 		S_ERROR("terminal is not open!\n");
 		return SERIAL_FAILED;
 	}
+	if (mux) {
+		APP_ERROR("%s: no break through umux\n", port)
+		    return SERIAL_FAILED;
+	}
 
 	ret = ioctl(fd, TIOCSBRK);
 	if (ret < 0)
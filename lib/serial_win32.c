@@ -32,6 +32,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "serial.h"
+#include <timer.h>
 #include <common.h>
 
 /***** TYPES(WINDOWS SPECIFIC) *******/
@@ -67,10 +68,24 @@ static unsigned char port[30];
 static HANDLE h_serial;
 static OVERLAPPED read_overlapped;
 static OVERLAPPED write_overlapped;
+/* Deadlines from s_set_timeouts, all in us, 0 for none */
+static struct {
+	unsigned long long first;
+	unsigned long long idle;
+	unsigned long long total;
+	/** when armed, and when the last byte came in */
+	unsigned long long armed;
+	unsigned long long last_rx;
+	int got_first;
+	/** which one made the last read time out */
+	int fired;
+} tmo;
 
 /**************** HELPERS ****************/
 static signed int reset_comm_error(unsigned int *rx_bytes,
 				   unsigned int *tx_bytes);
+static signed int s_poll_read(unsigned char *p_buffer, unsigned long size,
+			      unsigned long long deadline);
 
 /**************** EXPOSED FUNCTIONS  ****************/
 /**
@@ -132,6 +147,8 @@ signed char s_configure(unsigned long s_baud_rate, unsigned char s_parity,
 
 	S_DEBUG("%d %d %d %d", (unsigned int)s_baud_rate, s_parity, s_stop_bits,
 		s_data_bits);
+	/* On reconfiguration, let data already written go out first */
+	FlushFileBuffers(h_serial);
 	/* Get current configuration of serial port. */
 	if (!GetCommState(h_serial, &dcb)) {
 		S_ERROR("Could not get state of port %s\n", port);
@@ -266,6 +283,8 @@ signed int s_read(unsigned char *p_buffer, unsigned long size)
 		S_ERROR("More than read buffer\n");
 		return SERIAL_FAILED;
 	}
+	if (tmo.first || tmo.idle || tmo.total)
+		return s_poll_read(p_buffer, size, 0);
 	/* Read mask is set already in transmit */
 	do {
 		ret = ReadFile(h_serial, p_buffer, size_to_read, &size,
@@ -294,6 +313,145 @@ signed int s_read(unsigned char *p_buffer, unsigned long size)
 	return ret;
 }
 
+/**
+ * @brief s_next_deadline - earliest deadline set with s_set_timeouts
+ *
+ * @param which - gets the SERIAL_TMO_* of that deadline
+ *
+ * @return deadline in us, 0 if none is set
+ */
+static unsigned long long s_next_deadline(int *which)
+{
+	unsigned long long deadline = 0, d;
+
+	*which = SERIAL_TMO_NONE;
+	if (tmo.total) {
+		deadline = tmo.armed + tmo.total;
+		*which = SERIAL_TMO_TOTAL;
+	}
+	if (!tmo.got_first && tmo.first) {
+		d = tmo.armed + tmo.first;
+		if (!deadline || d < deadline) {
+			deadline = d;
+			*which = SERIAL_TMO_FIRST;
+		}
+	}
+	if (tmo.got_first && tmo.idle) {
+		d = tmo.last_rx + tmo.idle;
+		if (!deadline || d < deadline) {
+			deadline = d;
+			*which = SERIAL_TMO_IDLE;
+		}
+	}
+	return deadline;
+}
+
+/**
+ * @brief s_poll_read - read till size bytes came or a deadline passed
+ *
+ * @param p_buffer buffer
+ * @param size buffer length
+ * @param deadline - deadline of this read in us, 0 for none. The ones
+ *	set with s_set_timeouts apply as well.
+ *
+ * @return bytes read if any (may be less than size), SERIAL_TIMEDOUT if
+ * nothing came in time, else SERIAL_FAILED
+ */
+static signed int s_poll_read(unsigned char *p_buffer, unsigned long size,
+			      unsigned long long deadline)
+{
+	unsigned long long now, limit;
+	unsigned long got = 0;
+	unsigned long size_read;
+	int which;
+
+	tmo.fired = SERIAL_TMO_NONE;
+	/* ReadIntervalTimeout is MAXDWORD: ReadFile returns what is there */
+	while (got < size) {
+		now = t_now_us();
+		limit = s_next_deadline(&which);
+		if (deadline && (!limit || deadline <= limit)) {
+			limit = deadline;
+			which = SERIAL_TMO_NONE;
+		}
+		if (limit && now >= limit) {
+			tmo.fired = which;
+			break;
+		}
+		size_read = 0;
+		ReadFile(h_serial, p_buffer + got, size - got, &size_read,
+			 &read_overlapped);
+		if (!size_read) {
+			Sleep(1);
+			continue;
+		}
+		tmo.got_first = 1;
+		tmo.last_rx = t_now_us();
+		got += size_read;
+	}
+	if (got)
+		tmo.fired = SERIAL_TMO_NONE;
+	return got ? (signed int)got : SERIAL_TIMEDOUT;
+}
+
+/**
+ * @brief s_read_timeout - serial port read with a time limit
+ *
+ * @param p_buffer buffer
+ * @param size buffer length
+ * @param timeout_ms time to wait for the entire buffer
+ *
+ * @return bytes read if any (may be less than size), SERIAL_TIMEDOUT if
+ * nothing came in time, else SERIAL_FAILED
+ */
+signed int s_read_timeout(unsigned char *p_buffer, unsigned long size,
+			  unsigned int timeout_ms)
+{
+	S_DEBUG("%p:%d %d", p_buffer, (unsigned int)size, timeout_ms);
+	if (h_serial == INVALID_HANDLE_VALUE) {
+		S_ERROR("Not opened\n");
+		return SERIAL_FAILED;
+	}
+	return s_poll_read(p_buffer, size, t_now_us() + timeout_ms * 1000ULL);
+}
+
+/**
+ * @brief s_set_timeouts - bound the reads with deadlines
+ *
+ * All run on the monotonic clock from this call on, and apply to s_read,
+ * s_getc and s_read_timeout till they are set again.
+ *
+ * @param first_ms - time for the first byte to come, 0 for no limit
+ * @param idle_ms - longest silence after that, 0 for no limit
+ * @param total_ms - time for everything, 0 for no limit
+ *
+ * @return SERIAL_OK
+ */
+signed int s_set_timeouts(unsigned int first_ms, unsigned int idle_ms,
+			  unsigned int total_ms)
+{
+	tmo.first = first_ms * 1000ULL;
+	tmo.idle = idle_ms * 1000ULL;
+	tmo.total = total_ms * 1000ULL;
+	tmo.armed = t_now_us();
+	tmo.last_rx = tmo.armed;
+	tmo.got_first = 0;
+	tmo.fired = SERIAL_TMO_NONE;
+	return SERIAL_OK;
+}
+
+/**
+ * @brief s_timeout_which - which deadline ended the last read
+ *
+ * @return SERIAL_TMO_FIRST, SERIAL_TMO_IDLE or SERIAL_TMO_TOTAL if the last
+ * read returned SERIAL_TIMEDOUT because of s_set_timeouts, else
+ * SERIAL_TMO_NONE
+ */
+int s_timeout_which(void)
+{
+	return tmo.fired;
+}
+
 /**
  * @brief s_write - write to serial port
  *
@@ -384,6 +542,8 @@ signed int s_getc(void)
 	char x = 0;
 	int ret = 0;
 	ret = s_read(&x, 1);
+	if (ret == SERIAL_TIMEDOUT)
+		return ret;
 	if (ret < 0) {
 		S_ERROR("getc failed-%d\n", ret);
 		return ret;
@@ -0,0 +1,93 @@
+/**
+ * @file
+ * @brief monotonic time helpers for Linux/posix and windows
+ *
+ * FileName: lib/timer.c
+ *
+ * Implements the APIs in include/timer.h
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#ifdef __WIN32__
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#include <timer.h>
+
+/**
+ * @brief t_now_us - monotonic time stamp
+ *
+ * @return microseconds since an arbitrary (fixed) point in the past
+ */
+unsigned long long t_now_us(void)
+{
+#ifdef __WIN32__
+	LARGE_INTEGER freq, count;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (unsigned long long)(count.QuadPart / freq.QuadPart) *
+	    1000000ULL +
+	    (unsigned long long)(count.QuadPart % freq.QuadPart) *
+	    1000000ULL / freq.QuadPart;
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (unsigned long long)now.tv_sec * 1000000ULL +
+	    now.tv_nsec / 1000;
+#endif
+}
+
+/**
+ * @brief t_sleep_ms - sleep for a definite time
+ *
+ * @param ms - delay in milliseconds
+ */
+void t_sleep_ms(unsigned int ms)
+{
+#ifdef __WIN32__
+	Sleep(ms);
+#else
+	struct timespec delay = {
+		.tv_sec = ms / 1000,
+		.tv_nsec = (ms % 1000) * 1000 * 1000,
+	};
+	nanosleep(&delay, NULL);
+#endif
+}
+
+/**
+ * @brief t_sleep_us - sleep for a short definite time
+ *
+ * @param us - delay in microseconds (rounded up to ms on windows)
+ */
+void t_sleep_us(unsigned long us)
+{
+#ifdef __WIN32__
+	Sleep((us + 999) / 1000);
+#else
+	struct timespec delay = {
+		.tv_sec = us / 1000000,
+		.tv_nsec = (us % 1000000) * 1000,
+	};
+	nanosleep(&delay, NULL);
+#endif
+}
@@ -47,57 +47,254 @@
 #include "rev.h"
 #include "file.h"
 #include "f_status.h"
+#include "timer.h"
+#include "crc.h"
 
 /* Texas Instruments */
 #define SEARCH_VENDOR_DEFAULT	0x0451
-/* OMAP3430 */
-#define SEARCH_PRODUCT_DEFAULT	0xD009
+/* 0: any of the boot ROMs in rom_products */
+#define SEARCH_PRODUCT_DEFAULT	0
 /* bConfigurationValue: 1 */
 #define CONFIG_INDEX_DEFAULT	0x1
 /* bInterfaceNumber: 0 */
 #define INTERFACE_INDEX_DEFAULT	0x0
 #define DEVICE_IN_ENDPOINT		0x81
 #define DEVICE_OUT_ENDPOINT		0x1
-#define ASICID_SIZE_OMAP3		69	/* 1+7+4+23+23+11 */
-#define ASICID_SIZE_OMAP4		81	/* 1+7+4+23+35+11 */
+/* The ASIC ID is 69 bytes on OMAP3 (1+7+4+23+23+11), 81 on OMAP4
+ * (1+7+4+23+35+11): it is read into a full high speed packet, the ROM ends
+ * it with a short one, and its size is found from its items */
+#define ASIC_ID_READ_SIZE		512
 #define ASIC_ID_TIMEOUT			100
 #define COMMAND_SIZE			4
 #define GET_ASICID_COMMAND		0xF0030003
 #define DOWNLOAD_COMMAND		0xF0030002
 #define MAX_SIZE				(64 * 1024)
-#define READ_BUFFER_SIZE		4096
+/* The file is sent to the ROM 4K a transfer */
+#define ROM_XFER_SIZE			4096
+/* Bulk transfers kept in flight while the file is sent */
+#define XFER_COUNT			4
+/* a transfer also waits for the ones queued before it */
+#define XFER_TIMEOUT			(ASIC_ID_TIMEOUT * XFER_COUNT)
+/* Bus polling interval when libusb has no hotplug support */
+#define DEVICE_POLL_MS			1
+/* Boards served at once */
+#define BOARDS_MAX			32
+/* "bus-port.port...", USB allows 7 tiers of ports */
+#define PORTS_MAX			7
+#define PATH_SIZE			32
+/* Fixed wait before the download command and before the size, for chips
+ * pusb does not know */
+#define ROM_WAIT_MS			50
+/* A step the ROM does not take yet is tried again, after a backoff doubled
+ * up to BACKOFF_MAX_MS, until READY_TIMEOUT_MS */
+#define BACKOFF_MAX_MS			8
+#define READY_TIMEOUT_MS		1000
+/* ASIC ID: number of items, then each item as type, length and value. The
+ * ID item: 0x01, length 5, 0x01, chip (2 bytes), ch, ROM revision */
+#define ASIC_ID_ITEM_ID			0x01
+#define ASIC_ID_ITEM_ID_SIZE		5
+/* Longest the event loop waits for with nothing due */
+#define IDLE_MS				1000
+/* Second stage: the loader the ROM got enumerates with ids of its own (-l)
+ * within LOADER_WAIT_MS, then takes each image as a header (command,
+ * address, size), the data and the CRC32 of the data, and answers with its
+ * status and the CRC32 of the memory written. The data goes straight from
+ * the file mapping in LOADER_XFER_SIZE transfers */
+#define IMAGES_MAX			8
+#define LOADER_WAIT_MS			5000
+#define LOADER_XFER_SIZE		(64 * 1024)
+#define LOADER_TIMEOUT			1000
+#define LOADER_LOAD_COMMAND		0x4C4F4144	/* "LOAD" */
+#define LOADER_JUMP_COMMAND		0x4A554D50	/* "JUMP" */
+#define LOADER_STATUS_OK		0
+/* What a device on the bus is to us */
+#define DEV_ROM				1
+#define DEV_LOADER			2
+
+/* Board states */
+#define B_FREE				0
+#define B_FOUND				1
+#define B_ASIC_ID			2
+#define B_ASIC_ID_ASK			3
+#define B_ASIC_ID_AGAIN			4
+#define B_COMMAND			5
+#define B_SIZE				6
+#define B_DATA				7
+#define B_LOADER			8
+#define B_LOADER_OPEN			9
+#define B_HEADER			10
+#define B_IMAGE				11
+#define B_CRC				12
+#define B_STATUS			13
+#define B_JUMP				14
+#define B_END				15
+#define B_DONE				16
+
+/**
+ * How a boot ROM takes the download command and the size
+ *
+ * settle_ms is a fixed wait before each, try_ms the timeout of each try:
+ * a ROM not ready yet NAKs the transfer (timeout) or stalls the endpoint,
+ * and the step is tried again after a backoff starting at backoff_ms.
+ */
+struct rom_profile {
+	const char *name;
+	unsigned int settle_ms;
+	unsigned int try_ms;
+	unsigned int backoff_ms;
+};
+
+/* The chips known all take the steps the same way, whatever their ROM
+ * revision: no revision is known to need other waits */
+static const struct rom_profile rom_known = { "known", 0, 10, 1 };
+/* anything else gets the waits pusb always had */
+static const struct rom_profile rom_unknown = {
+	"unknown", ROM_WAIT_MS, ASIC_ID_TIMEOUT, 1
+};
+
+/* Chips from the ASIC ID which get rom_known */
+static const struct {
+	unsigned int chip;
+	const char *name;
+} rom_chips[] = {
+	{0x3430, "OMAP34xx/35xx"},
+	{0x3630, "OMAP36xx/DM37xx"},
+	{0x4430, "OMAP4430"},
+	{0x4460, "OMAP4460"},
+	{0, "unknown"},
+};
 
 /* Print control */
 #define V_PRINT(ARGS...) if (verbose >= 1) printf(ARGS)
 #define N_PRINT(ARGS...) if (verbose >= 0) printf(ARGS)
 
+/**
+ * A board being booted
+ *
+ * The board goes through the boot ROM steps driven by the completion of
+ * its transfers, or by its wake up time for the fixed waits, then through
+ * the images of the loader if there is a second stage. A download keeps
+ * XFER_COUNT transfers submitted straight out of the file mapping: a
+ * completed transfer is resubmitted at once with the next part, and the
+ * CRC32 of the part it sent is computed while the others are on the bus.
+ */
+struct board {
+	libusb_device *dev;
+	libusb_device_handle *udev;
+	/** bus-port path, the same for a board across boots */
+	char path[PATH_SIZE];
+	int state;
+	/** step which failed, B_FREE if none */
+	int failed;
+	/** set once the device is gone from the bus */
+	int left;
+	/** when the fixed wait of the state is over, 0 for none, in us */
+	unsigned long long wake_us;
+	/** boot ROM, from the ASIC ID */
+	unsigned int chip;
+	unsigned int rom_rev;
+	const char *soc;
+	const struct rom_profile *rom;
+	/** current step: start, tries, backoff and endpoint to clear */
+	unsigned long long phase_us;
+	unsigned int tries;
+	unsigned int backoff_ms;
+	int halted;
+	/** time each step took and its tries, for the verbose report */
+	unsigned long long spent[B_DONE];
+	unsigned int tried[B_DONE];
+	/** transfer of the ASIC ID, the command and the size */
+	struct libusb_transfer *ctrl;
+	unsigned char asic_id[ASIC_ID_READ_SIZE];
+	/** bytes of the ASIC ID, once parsed */
+	int asic_id_size;
+	unsigned int word;
+	unsigned long long found_us;
+	unsigned long long first_us;
+	unsigned long long start_us;
+	unsigned long long end_us;
+	/** download */
+	struct libusb_transfer *xfer[XFER_COUNT];
+	unsigned long long submitted[XFER_COUNT];
+	int busy[XFER_COUNT];
+	/** mapping sent, its size, transfer size and timeout */
+	const unsigned char *data;
+	unsigned long size;
+	unsigned int chunk;
+	unsigned int timeout;
+	/** offset of the next transfer, bytes sent and their CRC32 */
+	unsigned long offset;
+	unsigned long done;
+	unsigned int crc;
+	int in_flight;
+	int error;
+	/** completion latency of the transfers, in micro seconds */
+	unsigned long long lat_min;
+	unsigned long long lat_max;
+	unsigned long long lat_sum;
+	unsigned int count;
+	/** second stage: when the ROM stage ended, image being loaded */
+	unsigned long long loader_us;
+	int image;
+	unsigned long loaded;
+	/** loader header sent, and its answer: status, CRC32 */
+	unsigned int header[3];
+	unsigned int reply[2];
+};
+
+/** An image of the second stage */
+struct image {
+	const char *name;
+	unsigned long addr;
+	const unsigned char *data;
+	unsigned long size;
+};
+
+static const char *state_names[] = {
+	[B_FREE] = "free",
+	[B_FOUND] = "open",
+	[B_ASIC_ID] = "ASIC ID",
+	[B_ASIC_ID_ASK] = "ASIC ID request",
+	[B_ASIC_ID_AGAIN] = "ASIC ID",
+	[B_COMMAND] = "download command",
+	[B_SIZE] = "size",
+	[B_DATA] = "download",
+	[B_LOADER] = "loader",
+	[B_LOADER_OPEN] = "loader open",
+	[B_HEADER] = "image header",
+	[B_IMAGE] = "image",
+	[B_CRC] = "image CRC",
+	[B_STATUS] = "loader status",
+	[B_JUMP] = "jump",
+	[B_END] = "end",
+	[B_DONE] = "done",
+};
+
+/* USB product IDs of the boot ROMs: OMAP34xx/35xx/36xx, OMAP4430, OMAP4460 */
+static const unsigned int rom_products[] = { 0xD009, 0xD00F, 0xD010, 0 };
+
 static int verbose = 0;
-static int asicid_size = ASICID_SIZE_OMAP3;
 static unsigned int search_vendor = SEARCH_VENDOR_DEFAULT;
 static unsigned int search_product = SEARCH_PRODUCT_DEFAULT;
 static int config_idx = CONFIG_INDEX_DEFAULT;
-static libusb_device_handle *udev;
 static char *program_name;
-
-/**
- * @brief sleep for a definite time
- *
- * @param ms delay in ms
- *
- * @return none
- */
-static void usb_sleep(unsigned int ms)
-{
-#ifndef __WIN32__
-	struct timespec poll_interval = {
-		.tv_sec = 0,
-		.tv_nsec = ms * 1000 * 1000,
-	};
-	nanosleep(&poll_interval, NULL);
-#else
-	Sleep(ms);
-#endif
-}
+static const unsigned char *rom_data;
+static unsigned int filesize;
+/* Second stage images, the ids of the loader and where it jumps to */
+static struct image images[IMAGES_MAX];
+static int image_count;
+static unsigned int loader_vendor;
+static unsigned int loader_product;
+static unsigned long jump_addr;
+static int jump;
+static struct board boards[BOARDS_MAX];
+/* boards done with, and how many of them failed */
+static int finished;
+static int failed;
+/* Set to show the progress of the download (one board only) */
+static int progress;
+/* Set if libusb reports devices with hotplug events, else the bus is polled */
+static int hotplug;
 
 /******* ACTUAL CONFIGURATION OF THE DEVICE ********************/
 int configure_device(libusb_device_handle *udev)
@@ -112,155 +309,987 @@ int configure_device(libusb_device_handle *udev)
 	return 0;
 }
 
-/* send commands to the boot rom; returns 0 on success */
-static int send_command(libusb_device_handle *udev, unsigned int command)
+/**
+ * @brief board_wait - have the board step again after a fixed wait
+ *
+ * @param b - board
+ * @param state - state to step in
+ * @param ms - wait
+ */
+static void board_wait(struct board *b, int state, unsigned int ms)
 {
-	int ret = 0;
-	int r = libusb_bulk_transfer(udev, DEVICE_OUT_ENDPOINT, (unsigned char *)&command,
-			   sizeof(command), &ret, ASIC_ID_TIMEOUT);
-        if (r != 0)
-	   ret = 0;	
-	if (ret != COMMAND_SIZE) {
-		APP_ERROR
-		    ("CMD:Expected to write %ld, "
-		     "actual write %d - err str: %s\n",
-		     (long int)sizeof(command), ret, strerror(errno));
-	}
+	b->state = state;
+	b->wake_us = t_now_us() + ms * 1000ULL;
+}
 
-	return !(ret == COMMAND_SIZE);
+/**
+ * @brief board_phase - a step is done, go on to the next one
+ *
+ * @param b - board
+ * @param state - next step
+ * @param ms - fixed wait before it
+ */
+static void board_phase(struct board *b, int state, unsigned int ms)
+{
+	unsigned long long now = t_now_us();
+	int done = (b->state == B_ASIC_ID_AGAIN) ? B_ASIC_ID : b->state;
+
+	b->spent[done] = now - b->phase_us;
+	b->tried[done] = b->tries + 1;
+	b->phase_us = now;
+	b->tries = 0;
+	b->backoff_ms = 0;
+	board_wait(b, state, ms);
 }
 
-/*************** ACTUAL TRANSMISSION OF FILE *****************/
-int send_file(libusb_device_handle *udev, char *f_name)
+/**
+ * @brief board_retry - try a step the ROM did not take again
+ *
+ * @param b - board
+ * @param status - transfer status of the try
+ *
+ * @return 1 if it is tried again, 0 if it failed
+ */
+static int board_retry(struct board *b, int status)
 {
-	int ret = 0;
-	unsigned long cur_size = 0;
-	unsigned int filesize;
-	unsigned char asic_buffer[ASICID_SIZE_OMAP4];
-	unsigned char read_buffer[READ_BUFFER_SIZE];
-	int fail = 0;
-	int r;
+	if ((status != LIBUSB_TRANSFER_TIMED_OUT &&
+	     status != LIBUSB_TRANSFER_STALL) ||
+	    t_now_us() - b->phase_us > READY_TIMEOUT_MS * 1000ULL)
+		return 0;
+	/* cleared by the event loop, out of libusb's callbacks */
+	if (status == LIBUSB_TRANSFER_STALL)
+		b->halted = 1;
+	b->backoff_ms = b->backoff_ms ? b->backoff_ms * 2 :
+	    b->rom->backoff_ms;
+	if (b->backoff_ms > BACKOFF_MAX_MS)
+		b->backoff_ms = BACKOFF_MAX_MS;
+	b->tries++;
+	board_wait(b, b->state, b->backoff_ms);
+	return 1;
+}
 
-	filesize = f_size(f_name);
-	if (filesize > MAX_SIZE) {
-		APP_ERROR("Filesize %d >%d max\n",
-			  (unsigned int)filesize, MAX_SIZE);
+/**
+ * @brief asic_id_parse - walk the items of the ASIC ID read
+ *
+ * Gets the chip and ROM revision from the ID item, whatever the SoC puts
+ * around it.
+ *
+ * @param b - board
+ * @param size - bytes read
+ *
+ * @return 0 if it is an ASIC ID with an ID item, else -1
+ */
+static int asic_id_parse(struct board *b, int size)
+{
+	unsigned char *item;
+	int items, pos = 1, found = 0;
+
+	if (size < 1)
 		return -1;
+	for (items = b->asic_id[0]; items; items--) {
+		item = b->asic_id + pos;
+		if (pos + 2 > size || pos + 2 + item[1] > size)
+			return -1;
+		if (item[0] == ASIC_ID_ITEM_ID &&
+		    item[1] >= ASIC_ID_ITEM_ID_SIZE) {
+			b->chip = item[3] << 8 | item[4];
+			b->rom_rev = item[6];
+			found = 1;
+		}
+		pos += 2 + item[1];
 	}
-
-	ret = f_open(f_name);
-	if (ret < 0) {
-		APP_ERROR("error opening file! -%d\n", ret);
+	if (!found)
 		return -1;
+	b->asic_id_size = pos;
+	return 0;
+}
+
+/**
+ * @brief rom_detect - find the profile of the boot ROM from its ASIC ID
+ *
+ * Only the chip picks the profile, the ROM revision is reported.
+ *
+ * @param b - board, ASIC ID parsed
+ */
+static void rom_detect(struct board *b)
+{
+	int i;
+
+	for (i = 0; rom_chips[i].chip; i++)
+		if (rom_chips[i].chip == b->chip)
+			break;
+	b->soc = rom_chips[i].name;
+	b->rom = rom_chips[i].chip ? &rom_known : &rom_unknown;
+	V_PRINT("%s: chip 0x%04X (%s) ROM revision 0x%02X: %s ROM profile\n",
+		b->path, b->chip, b->soc, b->rom_rev, b->rom->name);
+}
+
+/**
+ * @brief board_fail - stop booting a board
+ *
+ * The board is cleaned up by the event loop, once out of libusb's
+ * callbacks.
+ *
+ * @param b - board
+ */
+static void board_fail(struct board *b)
+{
+	b->failed = b->state;
+	board_wait(b, B_END, 0);
+}
+
+/**
+ * @brief board_path - bus-port path of a device, as Linux names it
+ *
+ * @param dev - device
+ * @param path - gets the path, PATH_SIZE long
+ */
+static void board_path(libusb_device *dev, char *path)
+{
+	uint8_t ports[PORTS_MAX];
+	int n, i, pos;
+
+	pos = sprintf(path, "%d", libusb_get_bus_number(dev));
+	n = libusb_get_port_numbers(dev, ports, PORTS_MAX);
+	for (i = 0; i < n; i++)
+		pos += sprintf(path + pos, "%c%d", i ? '.' : '-', ports[i]);
+	if (n <= 0)
+		sprintf(path + pos, ":%d", libusb_get_device_address(dev));
+}
+
+/**
+ * @brief board_found - take a new device on
+ *
+ * @param dev - device, matching the ids searched for
+ */
+static void board_found(libusb_device *dev)
+{
+	struct board *b;
+	int i;
+
+	for (i = 0; i < BOARDS_MAX; i++)
+		if (boards[i].state != B_FREE && boards[i].dev == dev)
+			return;
+	for (i = 0; i < BOARDS_MAX; i++)
+		if (boards[i].state == B_FREE)
+			break;
+	if (i == BOARDS_MAX) {
+		APP_ERROR("More than %d boards, ignoring one\n", BOARDS_MAX);
+		return;
 	}
-	if (verbose >= 0) {
-		f_status_init(filesize, NORMAL_PRINT);
+	b = &boards[i];
+	memset(b, 0, sizeof(*b));
+	b->dev = libusb_ref_device(dev);
+	b->found_us = t_now_us();
+	board_path(dev, b->path);
+	/* opened by the event loop, out of libusb's callbacks */
+	board_wait(b, B_FOUND, 0);
+	V_PRINT("%s: found\n", b->path);
+}
+
+/**
+ * @brief loader_found - take on the loader a board enumerates with
+ *
+ * The loader is matched to the board by its bus-port path. A loader no
+ * board waits for (eg. booted before pusb started) is left alone.
+ *
+ * @param dev - device, matching the loader ids
+ */
+static void loader_found(libusb_device *dev)
+{
+	char path[PATH_SIZE];
+	struct board *b;
+	int i;
+
+	for (i = 0; i < BOARDS_MAX; i++)
+		if (boards[i].state != B_FREE && boards[i].dev == dev)
+			return;
+	board_path(dev, path);
+	for (i = 0; i < BOARDS_MAX; i++)
+		if (boards[i].state == B_LOADER &&
+		    !strcmp(boards[i].path, path))
+			break;
+	if (i == BOARDS_MAX)
+		return;
+	b = &boards[i];
+	/* the ROM device may not be reported gone yet */
+	if (b->dev != NULL)
+		libusb_unref_device(b->dev);
+	b->dev = libusb_ref_device(dev);
+	b->left = 0;
+	/* opened by the event loop, out of libusb's callbacks */
+	board_wait(b, B_LOADER_OPEN, 0);
+	V_PRINT("%s: loader found %.2f ms after the ROM stage\n", b->path,
+		(t_now_us() - b->loader_us) / 1000.0);
+}
+
+/**
+ * @brief board_left - the device of a board is gone from the bus
+ *
+ * A board still booting fails on its transfers. One done with is freed.
+ *
+ * @param dev - device
+ */
+static void board_left(libusb_device *dev)
+{
+	int i;
+
+	for (i = 0; i < BOARDS_MAX; i++) {
+		if (boards[i].state == B_FREE || boards[i].dev != dev)
+			continue;
+		/* the ROM hands over to the loader, which enumerates anew */
+		if (boards[i].state == B_LOADER) {
+			libusb_unref_device(dev);
+			boards[i].dev = NULL;
+			continue;
+		}
+		boards[i].left = 1;
+		if (boards[i].state == B_DONE) {
+			libusb_unref_device(dev);
+			boards[i].state = B_FREE;
+		}
 	}
-	/* Grab the interface for us to send data */
-	ret = libusb_claim_interface(udev, INTERFACE_INDEX_DEFAULT);
-	if (ret) {
-		APP_ERROR("error claiming usb interface %d-%s\n", ret,
-			  strerror(errno));
-		return (ret);
+}
+
+/**
+ * @brief device_wanted - is the device a boot ROM or a loader to serve?
+ *
+ * @param dev - device
+ *
+ * @return DEV_ROM, DEV_LOADER, else 0
+ */
+static int device_wanted(libusb_device *dev)
+{
+	struct libusb_device_descriptor desc;
+	int i;
+
+	if (libusb_get_device_descriptor(dev, &desc))
+		return 0;
+	if (image_count && desc.idVendor == loader_vendor &&
+	    desc.idProduct == loader_product)
+		return DEV_LOADER;
+	if (desc.idVendor != search_vendor)
+		return 0;
+	if (search_product)
+		return (desc.idProduct == search_product) ? DEV_ROM : 0;
+	for (i = 0; rom_products[i]; i++)
+		if (desc.idProduct == rom_products[i])
+			return DEV_ROM;
+	return 0;
+}
+
+/**
+ * @brief device_arrived - take on a device which showed up, if wanted
+ *
+ * @param dev - device
+ */
+static void device_arrived(libusb_device *dev)
+{
+	switch (device_wanted(dev)) {
+	case DEV_ROM:
+		board_found(dev);
+		break;
+	case DEV_LOADER:
+		loader_found(dev);
+		break;
 	}
+}
 
-	/* read ASIC ID */
-	r =
-	  libusb_bulk_transfer(udev, DEVICE_IN_ENDPOINT, asic_buffer, asicid_size, &ret,
+/**
+ * @brief device_event - hotplug callback, called from libusb events
+ *
+ * @return 0 to stay registered
+ */
+static int LIBUSB_CALL device_event(libusb_context *ctx, libusb_device *dev,
+				    libusb_hotplug_event event, void *user_data)
+{
+	if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED)
+		device_arrived(dev);
+	else
+		board_left(dev);
+	return 0;
+}
+
+/**
+ * @brief bus_scan - look for devices arrived and left, without hotplug
+ *
+ * Each scan costs a bus enumeration.
+ */
+static void bus_scan(void)
+{
+	libusb_device **list;
+	ssize_t n, i;
+	int j;
+
+	n = libusb_get_device_list(NULL, &list);
+	if (n < 0)
+		return;
+	for (j = 0; j < BOARDS_MAX; j++) {
+		for (i = 0; i < n; i++)
+			if (list[i] == boards[j].dev)
+				break;
+		if (boards[j].state != B_FREE && boards[j].dev != NULL &&
+		    i == n)
+			board_left(boards[j].dev);
+	}
+	for (i = 0; i < n; i++)
+		device_arrived(list[i]);
+	libusb_free_device_list(list, 1);
+}
+
+static void LIBUSB_CALL ctrl_done(struct libusb_transfer *xfer);
+
+/**
+ * @brief ctrl_submit - submit the transfer of a boot ROM step
+ *
+ * @param b - board
+ * @param state - step
+ * @param endpoint - DEVICE_IN_ENDPOINT or DEVICE_OUT_ENDPOINT
+ * @param data - buffer
+ * @param size - bytes
+ * @param timeout - ms
+ */
+static void ctrl_submit(struct board *b, int state, unsigned char endpoint,
+			unsigned char *data, int size, unsigned int timeout)
+{
+	int r;
+
+	b->state = state;
+	b->wake_us = 0;
+	libusb_fill_bulk_transfer(b->ctrl, b->udev, endpoint, data, size,
+				  ctrl_done, b, timeout);
+	r = libusb_submit_transfer(b->ctrl);
+	if (r) {
+		APP_ERROR("%s: %s: submit failed %d-%s\n", b->path,
+			  state_names[state], r, libusb_error_name(r));
+		board_fail(b);
+	}
+}
+
+/**
+ * @brief ctrl_word - send a command or the size to the boot ROM
+ *
+ * @param b - board
+ * @param state - step
+ * @param word - value sent
+ * @param timeout - ms
+ */
+static void ctrl_word(struct board *b, int state, unsigned int word,
+		      unsigned int timeout)
+{
+	b->word = word;
+	ctrl_submit(b, state, DEVICE_OUT_ENDPOINT, (unsigned char *)&b->word,
+		    sizeof(b->word), timeout);
+}
+
+/**
+ * @brief asic_id_show - print the ASIC ID in verbose mode
+ *
+ * @param b - board
+ */
+static void asic_id_show(struct board *b)
+{
+	int i;
+
+	if (verbose <= 0)
+		return;
+	printf("%s: ASIC ID, %d items:\n", b->path, b->asic_id[0]);
+	for (i = 0; i < b->asic_id_size; i++)
+		printf("%d: 0x%x[%c]\n", i, b->asic_id[i], b->asic_id[i]);
+}
+
+static void stream_start(struct board *b, const unsigned char *data,
+			 unsigned long size, unsigned int chunk,
+			 unsigned int timeout);
+static void loader_status(struct board *b);
+
+/**
+ * @brief ctrl_done - a boot ROM step is done, called from libusb events
+ *
+ * @param xfer - transfer completed
+ */
+static void LIBUSB_CALL ctrl_done(struct libusb_transfer *xfer)
+{
+	struct board *b = xfer->user_data;
+	/* all of it went, even if the timeout fired as the ROM took it */
+	int ok = (xfer->actual_length == xfer->length);
+
+	/* the ASIC ID is shorter than the read, it is checked by its items */
+	if (b->state == B_ASIC_ID || b->state == B_ASIC_ID_AGAIN)
+		ok = (xfer->status == LIBUSB_TRANSFER_COMPLETED &&
+		      !asic_id_parse(b, xfer->actual_length));
+	switch (b->state) {
+	case B_ASIC_ID:
+		if (ok)
+			break;
+		/* if no ASIC ID, request it explicitly */
+		V_PRINT("%s: no ASIC ID, asking for it\n", b->path);
+		ctrl_word(b, B_ASIC_ID_ASK, GET_ASICID_COMMAND,
 			  ASIC_ID_TIMEOUT);
-	if (r != 0)
-	  ret = 0;
-
-	/* if no ASIC ID, request it explicitly */
-	if (ret != asicid_size) {
-		if (send_command(udev, GET_ASICID_COMMAND)) {
-			APP_ERROR("Can't get ASIC ID out of the wretched chip.\n");
-			fail = -1;
-			goto closeup;
+		return;
+	case B_ASIC_ID_ASK:
+		if (!ok) {
+			APP_ERROR("%s: Can't get ASIC ID out of the wretched "
+				  "chip.\n", b->path);
+			board_fail(b);
+			return;
 		}
 		/* now try again */
-		r = libusb_bulk_transfer(udev, DEVICE_IN_ENDPOINT, asic_buffer,
-				    asicid_size, &ret, ASIC_ID_TIMEOUT);
-		if (r != 0)
-		  ret = 0;
-		if (ret != asicid_size) {
-			APP_ERROR("Expected to read %d, read %d - err str: %s\n",
-				  asicid_size, ret, strerror(errno));
-			fail = -1;
-			goto closeup;
+		ctrl_submit(b, B_ASIC_ID_AGAIN, DEVICE_IN_ENDPOINT, b->asic_id,
+			    ASIC_ID_READ_SIZE, ASIC_ID_TIMEOUT);
+		return;
+	default:
+		break;
+	}
+	/* a word sent again would be taken as the next one: only if none of
+	 * it went, a partial write fails */
+	if (!ok && !xfer->actual_length &&
+	    (b->state == B_COMMAND || b->state == B_SIZE) &&
+	    board_retry(b, xfer->status))
+		return;
+	if (!ok) {
+		APP_ERROR("%s: %s: expected %d bytes, transferred %d - status "
+			  "%d\n", b->path, state_names[b->state], xfer->length,
+			  xfer->actual_length, xfer->status);
+		board_fail(b);
+		return;
+	}
+	switch (b->state) {
+	case B_ASIC_ID:
+	case B_ASIC_ID_AGAIN:
+		asic_id_show(b);
+		rom_detect(b);
+		board_phase(b, B_COMMAND, b->rom->settle_ms);
+		break;
+	case B_COMMAND:
+		board_phase(b, B_SIZE, b->rom->settle_ms);
+		break;
+	case B_SIZE:
+		board_phase(b, B_DATA, 0);
+		b->wake_us = 0;
+		stream_start(b, rom_data, filesize, ROM_XFER_SIZE,
+			     XFER_TIMEOUT);
+		break;
+	case B_HEADER:
+		b->state = B_IMAGE;
+		stream_start(b, images[b->image].data, images[b->image].size,
+			     LOADER_XFER_SIZE, LOADER_TIMEOUT);
+		break;
+	case B_CRC:
+		ctrl_submit(b, B_STATUS, DEVICE_IN_ENDPOINT,
+			    (unsigned char *)b->reply, sizeof(b->reply),
+			    LOADER_TIMEOUT);
+		break;
+	case B_STATUS:
+		loader_status(b);
+		break;
+	case B_JUMP:
+		board_wait(b, B_END, 0);
+		break;
+	}
+}
+
+/**
+ * @brief loader_header - send the loader the header of the next image
+ *
+ * @param b - board
+ * @param command - LOADER_LOAD_COMMAND or LOADER_JUMP_COMMAND
+ * @param addr - load or entry address
+ * @param size - bytes to load, 0 for a jump
+ */
+static void loader_header(struct board *b, unsigned int command,
+			  unsigned long addr, unsigned long size)
+{
+	b->header[0] = command;
+	b->header[1] = addr;
+	b->header[2] = size;
+	ctrl_submit(b, (command == LOADER_JUMP_COMMAND) ? B_JUMP : B_HEADER,
+		    DEVICE_OUT_ENDPOINT, (unsigned char *)b->header,
+		    sizeof(b->header), LOADER_TIMEOUT);
+}
+
+/**
+ * @brief loader_status - check the answer of the loader to an image
+ *
+ * The CRC32 the loader computed over the memory it wrote must be the one
+ * of the data sent, computed as it went out of the file mapping.
+ *
+ * @param b - board
+ */
+static void loader_status(struct board *b)
+{
+	struct image *im = &images[b->image];
+	unsigned long long elapsed = b->end_us - b->start_us;
+
+	if (b->reply[0] != LOADER_STATUS_OK || b->reply[1] != b->crc) {
+		APP_ERROR("%s: %s: loader status %u, CRC32 0x%08X, sent "
+			  "0x%08X\n", b->path, im->name, b->reply[0],
+			  b->reply[1], b->crc);
+		board_fail(b);
+		return;
+	}
+	N_PRINT("%s%s: %s: %lu bytes at 0x%08lX in %.2f ms: %.1f KB/s, "
+		"CRC32 0x%08X\n", progress ? "\n" : "", b->path, im->name,
+		im->size, im->addr, elapsed / 1000.0,
+		elapsed ? im->size * 1000.0 / elapsed : 0, b->crc);
+	b->loaded += im->size;
+	if (++b->image < image_count)
+		loader_header(b, LOADER_LOAD_COMMAND, images[b->image].addr,
+			      images[b->image].size);
+	else if (jump)
+		loader_header(b, LOADER_JUMP_COMMAND, jump_addr, 0);
+	else
+		board_wait(b, B_END, 0);
+}
+
+static void LIBUSB_CALL stream_done(struct libusb_transfer *xfer);
+
+/**
+ * @brief stream_submit - send the next part of the data with a transfer
+ *
+ * The transfer points into the file mapping, there is no copy. All boards
+ * send from the one mapping, each at its own offset.
+ *
+ * @param b - board
+ * @param slot - transfer to use, must not be busy
+ *
+ * @return 0 on success (or nothing left to send), else error
+ */
+static int stream_submit(struct board *b, int slot)
+{
+	struct libusb_transfer *xfer = b->xfer[slot];
+	unsigned long size = b->size - b->offset;
+	int r;
+
+	if (!size)
+		return 0;
+	if (size > b->chunk)
+		size = b->chunk;
+	/* an OUT transfer does not write to its buffer */
+	libusb_fill_bulk_transfer(xfer, b->udev, DEVICE_OUT_ENDPOINT,
+				  (unsigned char *)b->data + b->offset, size,
+				  stream_done, b, b->timeout);
+	r = libusb_submit_transfer(xfer);
+	if (r) {
+		APP_ERROR("%s: DDump:submit failed %d-%s\n", b->path, r,
+			  libusb_error_name(r));
+		return -1;
+	}
+	b->submitted[slot] = t_now_us();
+	b->busy[slot] = 1;
+	b->in_flight++;
+	b->offset += size;
+	return 0;
+}
+
+/**
+ * @brief stream_stop - get the transfers still queued back after an error
+ *
+ * @param b - board
+ */
+static void stream_stop(struct board *b)
+{
+	int slot;
+
+	if (!b->error)
+		for (slot = 0; slot < XFER_COUNT; slot++)
+			if (b->busy[slot])
+				libusb_cancel_transfer(b->xfer[slot]);
+	b->error = -1;
+	if (!b->in_flight)
+		board_fail(b);
+}
+
+/**
+ * @brief stream_end - all the data is sent
+ *
+ * The file is done with for the ROM. An image is followed by its CRC32.
+ *
+ * @param b - board
+ */
+static void stream_end(struct board *b)
+{
+	b->end_us = t_now_us();
+	if (b->state == B_IMAGE)
+		ctrl_word(b, B_CRC, b->crc, LOADER_TIMEOUT);
+	else
+		board_wait(b, B_END, 0);
+}
+
+/**
+ * @brief stream_done - transfer completion, called from libusb events
+ *
+ * @param xfer - transfer completed
+ */
+static void LIBUSB_CALL stream_done(struct libusb_transfer *xfer)
+{
+	struct board *b = xfer->user_data;
+	unsigned char *sent = xfer->buffer;
+	unsigned long long latency;
+	int slot, size = xfer->length;
+
+	for (slot = 0; b->xfer[slot] != xfer; slot++) ;
+	latency = t_now_us() - b->submitted[slot];
+	b->busy[slot] = 0;
+	b->in_flight--;
+	if (xfer->status != LIBUSB_TRANSFER_COMPLETED ||
+	    xfer->actual_length != xfer->length) {
+		if (!b->error)
+			APP_ERROR("%s: DDump:Expected to write %d, actual "
+				  "write %d - status %d\n", b->path,
+				  xfer->length, xfer->actual_length,
+				  xfer->status);
+		stream_stop(b);
+		return;
+	}
+	if (!b->count || latency < b->lat_min)
+		b->lat_min = latency;
+	if (latency > b->lat_max)
+		b->lat_max = latency;
+	b->lat_sum += latency;
+	b->count++;
+	b->done += xfer->length;
+	if (progress)
+		f_status_show(b->done);
+	if (b->error) {
+		stream_stop(b);
+		return;
+	}
+	/* queue the next part first, the CRC32 is done while it is sent */
+	if (stream_submit(b, slot)) {
+		stream_stop(b);
+		return;
+	}
+	b->crc = crc32_update(b->crc, sent, size);
+	if (!b->in_flight)
+		stream_end(b);
+}
+
+/**
+ * @brief stream_start - start sending data to a board
+ *
+ * @param b - board, size sent (ROM) or header sent (loader)
+ * @param data - mapping to send
+ * @param size - bytes
+ * @param chunk - bytes per transfer
+ * @param timeout - ms per transfer
+ */
+static void stream_start(struct board *b, const unsigned char *data,
+			 unsigned long size, unsigned int chunk,
+			 unsigned int timeout)
+{
+	int slot;
+
+	b->data = data;
+	b->size = size;
+	b->chunk = chunk;
+	b->timeout = timeout;
+	b->offset = 0;
+	b->done = 0;
+	b->crc = 0;
+	b->count = 0;
+	b->lat_min = b->lat_max = b->lat_sum = 0;
+	if (progress)
+		f_status_init(size, NORMAL_PRINT);
+	b->start_us = t_now_us();
+	for (slot = 0; slot < XFER_COUNT; slot++)
+		if (stream_submit(b, slot)) {
+			stream_stop(b);
+			return;
 		}
+	if (!b->in_flight)
+		stream_end(b);
+}
+
+/**
+ * @brief board_claim - open the device of a board and claim its interface
+ *
+ * @param b - board
+ *
+ * @return 0 on success, else error
+ */
+static int board_claim(struct board *b)
+{
+	int ret, slot;
+
+	ret = libusb_open(b->dev, &b->udev);
+	if (ret) {
+		APP_ERROR("%s: error opening usb device %d-%s\n", b->path, ret,
+			  libusb_error_name(ret));
+		b->udev = NULL;
+		return -1;
+	}
+	if (configure_device(b->udev)) {
+		APP_ERROR("%s: configure dev failed\n", b->path);
+		return -1;
+	}
+	/* Grab the interface for us to send data */
+	ret = libusb_claim_interface(b->udev, INTERFACE_INDEX_DEFAULT);
+	b->ctrl = libusb_alloc_transfer(0);
+	if (ret || b->ctrl == NULL) {
+		APP_ERROR("%s: error claiming usb interface %d-%s\n", b->path,
+			  ret, strerror(errno));
+		return -1;
 	}
-	if (verbose > 0) {
-		int i = 0;
-		printf("ASIC ID:\n");
-		while (i < asicid_size) {
-			printf("%d: 0x%x[%c]\n", i, asic_buffer[i],
-			       asic_buffer[i]);
-			i++;
+	for (slot = 0; slot < XFER_COUNT; slot++) {
+		b->xfer[slot] = libusb_alloc_transfer(0);
+		if (b->xfer[slot] == NULL) {
+			APP_ERROR("%s: error allocating usb transfers\n",
+				  b->path);
+			return -1;
 		}
 	}
-	usb_sleep(50);
-	/* Send the  Continue Peripheral boot command */
-	if (send_command(udev, DOWNLOAD_COMMAND)) {
-		fail = -1;
-		goto closeup;
-	}
-	usb_sleep(50);
-	/* Send in the filesize */
-	r =
-	    libusb_bulk_transfer(udev, DEVICE_OUT_ENDPOINT, (unsigned char *)&filesize,
-			   sizeof(filesize), &ret, ASIC_ID_TIMEOUT);
-	if (r != 0)
-	  ret = 0;
-	if (ret != sizeof(filesize)) {
-		APP_ERROR
-		    ("FSize:Expected to write %ld, "
-		     "actual write %d - err str: %s\n",
-		     (long int)sizeof(filesize), ret, strerror(errno));
-		fail = -1;
-		goto closeup;
-	}
-	/* pump in the data */
-	while (filesize) {
-		int r_size = f_read((unsigned char *)read_buffer,
-				    sizeof(read_buffer));
-		r =
-		    libusb_bulk_transfer(udev, DEVICE_OUT_ENDPOINT, read_buffer,
-				   r_size, &ret, ASIC_ID_TIMEOUT);
-		if (r != 0)
-		  ret = 0; 
-		if (ret != r_size) {
-			APP_ERROR
-			    ("DDump:Expected to write %d, actual write %d %s\n",
-			     r_size, ret, strerror(errno));
-			fail = -1;
-			goto closeup;
+	return 0;
+}
+
+/**
+ * @brief board_close - release the interface and close the device
+ *
+ * @param b - board, no transfer in flight
+ */
+static void board_close(struct board *b)
+{
+	int slot, ret;
+
+	if (b->udev != NULL) {
+		/* a board which booted may have left the bus already */
+		ret = (b->ctrl != NULL) ?
+		    libusb_release_interface(b->udev, INTERFACE_INDEX_DEFAULT) :
+		    0;
+		if (ret && ret != LIBUSB_ERROR_NO_DEVICE && !b->failed) {
+			APP_ERROR("%s: error releasing usb interface %d-%s\n",
+				  b->path, ret, libusb_error_name(ret));
+			b->failed = B_END;
 		}
-		filesize -= r_size;
-		if (verbose >= 0) {
-			cur_size += r_size;
-			f_status_show(cur_size);
+		libusb_close(b->udev);
+		b->udev = NULL;
+	}
+	libusb_free_transfer(b->ctrl);
+	b->ctrl = NULL;
+	for (slot = 0; slot < XFER_COUNT; slot++) {
+		libusb_free_transfer(b->xfer[slot]);
+		b->xfer[slot] = NULL;
+	}
+}
+
+/**
+ * @brief board_open - open a device found and start reading its ASIC ID
+ *
+ * @param b - board
+ */
+static void board_open(struct board *b)
+{
+	if (board_claim(b)) {
+		board_fail(b);
+		return;
+	}
+	/* read ASIC ID */
+	b->phase_us = t_now_us();
+	b->first_us = b->phase_us - b->found_us;
+	ctrl_submit(b, B_ASIC_ID, DEVICE_IN_ENDPOINT, b->asic_id,
+		    ASIC_ID_READ_SIZE, ASIC_ID_TIMEOUT);
+}
+
+/**
+ * @brief loader_open - open the loader and send it the first image
+ *
+ * @param b - board
+ */
+static void loader_open(struct board *b)
+{
+	if (board_claim(b)) {
+		board_fail(b);
+		return;
+	}
+	b->image = 0;
+	loader_header(b, LOADER_LOAD_COMMAND, images[0].addr, images[0].size);
+}
+
+/**
+ * @brief rom_report - print how the download to the ROM went
+ *
+ * @param b - board, file sent
+ */
+static void rom_report(struct board *b)
+{
+	unsigned long long elapsed = b->end_us - b->start_us;
+
+	N_PRINT("%s%s: %lu bytes in %.2f ms: %.1f KB/s, %d transfers "
+		"in flight\n"
+		"%s: first transfer %.2f ms after the device was found "
+		"(%s), transfer completion latency: min %.2f, avg %.2f, "
+		"max %.2f ms over %u transfers\n", progress ? "\n" : "",
+		b->path, b->done, elapsed / 1000.0,
+		elapsed ? b->done * 1000.0 / elapsed : 0, XFER_COUNT,
+		b->path, b->first_us / 1000.0,
+		hotplug ? "hotplug" : "poll", b->lat_min / 1000.0,
+		b->count ? b->lat_sum / 1000.0 / b->count : 0,
+		b->lat_max / 1000.0, b->count);
+	if (b->rom != NULL)
+		V_PRINT("%s: %s: ASIC ID %.2f ms (%u tries), command %.2f ms "
+			"(%u tries), size %.2f ms (%u tries), download %.2f "
+			"ms\n", b->path, b->soc,
+			b->spent[B_ASIC_ID] / 1000.0, b->tried[B_ASIC_ID],
+			b->spent[B_COMMAND] / 1000.0, b->tried[B_COMMAND],
+			b->spent[B_SIZE] / 1000.0, b->tried[B_SIZE],
+			elapsed / 1000.0);
+}
+
+/**
+ * @brief board_end - done with a board or its ROM stage, release it and
+ * report
+ *
+ * @param b - board, no transfer in flight
+ */
+static void board_end(struct board *b)
+{
+	board_close(b);
+	if (!b->failed && !b->loader_us)
+		rom_report(b);
+	if (!b->failed && !b->loader_us && image_count) {
+		/* the ROM device leaves, the loader shows up in its place */
+		b->loader_us = t_now_us();
+		board_wait(b, B_LOADER, LOADER_WAIT_MS);
+		if (b->left) {
+			b->left = 0;
+			board_left(b->dev);
 		}
+		fflush(stdout);
+		return;
 	}
-	/* close the device */
-      closeup:
-	ret = libusb_release_interface(udev, INTERFACE_INDEX_DEFAULT);
-	if (ret) {
-		APP_ERROR("error releasing usb interface %d-%s\n", ret,
-			  strerror(errno));
-		/* Fall thru */
-		fail = ret;
+	finished++;
+	if (b->failed) {
+		failed++;
+		APP_ERROR("%s: failed at the %s step\n", b->path,
+			  state_names[b->failed]);
+	} else if (b->loader_us) {
+		N_PRINT("%s: %d images, %lu bytes loaded %.2f ms after the ROM "
+			"stage\n", b->path, image_count, b->loaded,
+			(t_now_us() - b->loader_us) / 1000.0);
 	}
+	/* results show as they come, also when piped to a log */
+	fflush(stdout);
+	/* kept till the device leaves, so it is not taken on again */
+	b->state = B_DONE;
+	b->wake_us = 0;
+	if (b->dev == NULL)
+		b->state = B_FREE;
+	else if (b->left)
+		board_left(b->dev);
+}
 
-	libusb_close(udev);
+/**
+ * @brief board_step - run what is due on each board
+ *
+ * @return time the next board is due at, 0 for none
+ */
+static unsigned long long board_step(void)
+{
+	unsigned long long now = t_now_us(), next = 0;
+	struct board *b;
+	int i;
 
-	ret = f_close();
-	if (ret) {
-		APP_ERROR("error closing file %d-%s\n", ret, strerror(errno));
-		/* Fall thru */
-		fail = ret;
+	for (i = 0; i < BOARDS_MAX; i++) {
+		b = &boards[i];
+		if (!b->wake_us)
+			continue;
+		if (b->wake_us > now) {
+			if (!next || b->wake_us < next)
+				next = b->wake_us;
+			continue;
+		}
+		b->wake_us = 0;
+		if (b->halted) {
+			V_PRINT("%s: %s: endpoint stalled, clearing\n",
+				b->path, state_names[b->state]);
+			libusb_clear_halt(b->udev, DEVICE_OUT_ENDPOINT);
+			b->halted = 0;
+		}
+		switch (b->state) {
+		case B_FOUND:
+			board_open(b);
+			break;
+		case B_COMMAND:
+			/* Send the  Continue Peripheral boot command */
+			ctrl_word(b, B_COMMAND, DOWNLOAD_COMMAND,
+				  b->rom->try_ms);
+			break;
+		case B_SIZE:
+			/* Send in the filesize */
+			ctrl_word(b, B_SIZE, filesize, b->rom->try_ms);
+			break;
+		case B_LOADER:
+			APP_ERROR("%s: no loader %04X:%04X within %d ms\n",
+				  b->path, loader_vendor, loader_product,
+				  LOADER_WAIT_MS);
+			board_fail(b);
+			break;
+		case B_LOADER_OPEN:
+			loader_open(b);
+			break;
+		case B_END:
+			board_end(b);
+			break;
+		}
+		/* steps may be due at once again */
+		if (b->wake_us && (!next || b->wake_us < next))
+			next = b->wake_us;
+	}
+	return next;
+}
+
+/**
+ * @brief serve - boot boards as they show up
+ *
+ * @param count - boards to boot before returning, 0 to never return
+ */
+static void serve(int count)
+{
+	libusb_hotplug_callback_handle handle;
+	unsigned long long next, now, scan = 0;
+	int vendor = search_vendor;
+	int product = search_product ? (int)search_product :
+	    LIBUSB_HOTPLUG_MATCH_ANY;
+	struct timeval tv;
+
+	/* the loader has ids of its own */
+	if (image_count) {
+		if (loader_vendor != search_vendor)
+			vendor = LIBUSB_HOTPLUG_MATCH_ANY;
+		product = LIBUSB_HOTPLUG_MATCH_ANY;
+	}
+	hotplug = libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG) &&
+	    !libusb_hotplug_register_callback(NULL,
+					      LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED
+					      | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT,
+					      LIBUSB_HOTPLUG_ENUMERATE,
+					      vendor, product,
+					      LIBUSB_HOTPLUG_MATCH_ANY,
+					      device_event, NULL, &handle);
+	if (!hotplug)
+		V_PRINT("No hotplug support, polling every %d ms\n",
+			DEVICE_POLL_MS);
+	while (!count || finished < count) {
+		now = t_now_us();
+		if (!hotplug && now >= scan) {
+			bus_scan();
+			scan = now + DEVICE_POLL_MS * 1000ULL;
+		}
+		next = board_step();
+		if (count && finished >= count)
+			break;
+		now = t_now_us();
+		if (!next || next > now + IDLE_MS * 1000ULL)
+			next = now + IDLE_MS * 1000ULL;
+		if (!hotplug && next > scan)
+			next = scan;
+		next = (next > now) ? next - now : 0;
+		tv.tv_sec = next / 1000000;
+		tv.tv_usec = next % 1000000;
+		libusb_handle_events_timeout_completed(NULL, &tv, NULL);
 	}
-	return fail;
+	if (hotplug)
+		libusb_hotplug_deregister_callback(NULL, handle);
 }
 
 void help(void)
@@ -271,17 +1300,30 @@ void help(void)
 	       "response to ASIC ID over USB\n\n"
 	       "Syntax:\n"
 	       "------\n"
-	       "  %s [-v] [-V] [-d device_ID] -f input_file \n"
+	       "  %s [-v] [-V] [-d device_ID] [-n boards | -D] -f input_file \n"
+	       "        [-l vid:pid -s addr:image [-s addr:image...] [-j addr]]\n"
 	       "Where:\n" "-----\n"
 	       "   -v          : (optional) verbose messages\n"
 	       "   -V          : (optional) verbose messages + usblib debug messages\n"
 	       "   -q          : (optional) Ultra quiet - no outputs other than error\n"
-	       "   -d device_ID: (optional) USB Device id (Uses default of 0x%X)\n"
+	       "   -d device_ID: (optional) USB Device id (default: any OMAP boot ROM,\n"
+	       "                 0xD009, 0xD00F or 0xD010)\n"
+	       "   -n boards   : (optional) boot this many boards, all at once as they\n"
+	       "                 show up, then exit (default 1)\n"
+	       "   -D          : (optional) keep booting boards as they show up, never exit\n"
 	       "   -f input_file: input file to be transmitted to target\n"
+	       "   -l vid:pid  : (optional) USB ids of the loader input_file is, which\n"
+	       "                 takes the images once it enumerates\n"
+	       "   -s addr:image: (optional) image to load at addr with the loader, up\n"
+	       "                 to %d, any size\n"
+	       "   -j addr     : (optional) have the loader jump to addr at the end\n"
 	       "NOTE: it is required to run this program in sudo mode to get access at times\n"
 	       "Usage Example:\n" "-------------\n"
-	       "sudo %s -f F_NAME \n", program_name, search_product,
-	       program_name);
+	       "sudo %s -f F_NAME \n"
+	       "sudo %s -n 16 -f F_NAME \n"
+	       "sudo %s -f LOADER -l 0451:d022 -s 80008000:zImage "
+	       "-s 81000000:rootfs.img -j 80008000\n", program_name, IMAGES_MAX,
+	       program_name, program_name, program_name);
 	REVPRINT();
 	LIC_PRINT();
 }
@@ -289,22 +1331,26 @@ void help(void)
 int main(int argc, char *argv[])
 {
 	char *filename = NULL;
-	int found = 0;
-	int x = 0;
-	int old_dev = 0;
-	int new_dev = 0;
 	/* NOTE: mingw did not like this.. */
 	int c;
-	int filesize = -1;
+	int count = 1;
+	int daemon = 0;
+	int i, pos;
+	unsigned long size = 0;
 
 	program_name = argv[0];
 	/* Options supported:
 	 *  -f input filename - file to send
 	 *  -d deviceID - USB deviceID
+	 *  -n boards - boards to boot
+	 *  -D - boot boards for ever
+	 *  -l vid:pid - loader ids
+	 *  -s addr:image - image for the loader
+	 *  -j addr - loader entry point
 	 *  -v -verbose
 	 *  -q -ultraquiet
 	 */
-	while ((c = getopt(argc, argv, ":vVqd:f:4")) != -1) {
+	while ((c = getopt(argc, argv, ":vVqd:f:4n:Dl:s:j:")) != -1) {
 		switch (c) {
 		case 'q':
 			verbose = -1;
@@ -322,7 +1368,38 @@ int main(int argc, char *argv[])
 			sscanf(optarg, "%x", &search_product);
 			break;
 		case '4':
-			asicid_size = ASICID_SIZE_OMAP4;
+			/* Obsolete: the ASIC ID size is found from its items */
+			break;
+		case 'n':
+			sscanf(optarg, "%d", &count);
+			break;
+		case 'D':
+			daemon = 1;
+			break;
+		case 'l':
+			if (sscanf(optarg, "%x:%x", &loader_vendor,
+				   &loader_product) != 2) {
+				APP_ERROR("Loader ids are vid:pid\n");
+				return -1;
+			}
+			break;
+		case 's':
+			if (image_count == IMAGES_MAX) {
+				APP_ERROR("At most %d images\n", IMAGES_MAX);
+				return -1;
+			}
+			pos = 0;
+			sscanf(optarg, "%lx:%n", &images[image_count].addr,
+			       &pos);
+			if (!pos || !optarg[pos]) {
+				APP_ERROR("Images are addr:file\n");
+				return -1;
+			}
+			images[image_count++].name = optarg + pos;
+			break;
+		case 'j':
+			sscanf(optarg, "%lx", &jump_addr);
+			jump = 1;
 			break;
 		case '?':
 		default:
@@ -332,40 +1409,70 @@ int main(int argc, char *argv[])
 		}
 	}
 	if (filename)
-		filesize = f_size(filename);
+		rom_data = f_map(filename, &size);
 	/* Param validate */
-	if ((NULL == filename) || (filesize == -1)) {
+	if (rom_data == NULL) {
 		APP_ERROR("Missing file to download\n");
 		help();
 		return -2;
 	}
+	if (image_count && !loader_vendor) {
+		APP_ERROR("Images need the loader ids (-l vid:pid)\n");
+		return -2;
+	}
+	if (count < 1) {
+		APP_ERROR("Need at least one board\n");
+		help();
+		return -2;
+	}
+	if (size > MAX_SIZE) {
+		APP_ERROR("Filesize %lu >%d max\n", size, MAX_SIZE);
+		return -1;
+	}
+	filesize = size;
+	/* the loader is told sizes and addresses in 32 bits */
+	for (i = 0; i < image_count; i++) {
+		images[i].data = f_map(images[i].name, &images[i].size);
+		if (images[i].data == NULL) {
+			APP_ERROR("error mapping %s\n", images[i].name);
+			return -1;
+		}
+		if (images[i].size > 0xFFFFFFFFUL ||
+		    images[i].addr > 0xFFFFFFFFUL) {
+			APP_ERROR("%s: too large for the loader\n",
+				  images[i].name);
+			return -1;
+		}
+	}
+	if (daemon)
+		count = 0;
+	progress = (count == 1 && verbose >= 0);
 /*
 	if (verbose == 2) {
 		usb_set_debug(255);
 	}
 	*/
 	libusb_init(NULL);
-	N_PRINT("Waiting for USB device vendorID=0x%X "
-		"and productID=0x%X:\n", search_vendor, search_product);
-	while (1) {
-                udev = libusb_open_device_with_vid_pid(NULL,  search_vendor, search_product);
-		if (udev)
-		  break;
-		/* sleep a bit, just to not do too much busy waiting */
-                usb_sleep(50);
-	}
-	c = configure_device(udev);
-	if (c) {
-		APP_ERROR("configure dev failed\n");
-		goto exit;
-	}
-	c = send_file(udev, filename);
-	if (c) {
-		APP_ERROR("send file failed\n");
-	}
-	if (!c) {
+	if (search_product) {
+		N_PRINT("Waiting for USB device vendorID=0x%X "
+			"and productID=0x%X:\n", search_vendor, search_product);
+	} else {
+		N_PRINT("Waiting for USB device vendorID=0x%X "
+			"and any OMAP boot ROM productID:\n", search_vendor);
+	}
+	serve(count);
+	for (i = 0; i < image_count; i++)
+		f_unmap(images[i].data, images[i].size);
+	if (f_unmap(rom_data, filesize)) {
+		APP_ERROR("error unmapping file %d-%s\n", errno,
+			  strerror(errno));
+		failed++;
+	}
+	if (!failed && count == 1) {
 		N_PRINT("\n%s downloaded successfully to target\n", filename);
+	} else if (count > 1) {
+		N_PRINT("\n%s: %d boards booted, %d failed\n", filename,
+			finished - failed, failed);
 	}
-      exit:
-	return c;
+	return failed ? -1 : 0;
 }
@@ -36,6 +36,9 @@
 #include <string.h>
 #include "rev.h"
 #include "serial.h"
+#include "console.h"
+#include "timer.h"
+#include "capture.h"
 
 #define PORT_ARG	"p"
 #define PORT_ARG_C	'p'
@@ -43,69 +46,67 @@
 #define CMD_ARG_C	'c'
 #define EXP_ARG		"e"
 #define EXP_ARG_C	'e'
+#define FAIL_ARG	"F"
+#define FAIL_ARG_C	'F'
+#define TIMEOUT_ARG	"t"
+#define TIMEOUT_ARG_C	't'
+#define FIRST_ARG	"w"
+#define FIRST_ARG_C	'w'
+#define IDLE_ARG	"i"
+#define IDLE_ARG_C	'i'
+#define SCRIPT_ARG	"s"
+#define SCRIPT_ARG_C	's'
+#define PIPE_ARG	"n"
+#define PIPE_ARG_C	'n'
+#define PROMPT_ARG	"P"
+#define PROMPT_ARG_C	'P'
+#define CAPTURE_ARG	"C"
+#define CAPTURE_ARG_C	'C'
+#define PACE_ARG	"E"
+#define PACE_ARG_C	'E'
 
-/**
- * @brief send_cmd - send the command to uboot
- *
- * @param cmd  - command to send
- *
- * @return - result
- */
-static int send_cmd(char *cmd)
-{
-	int ret = 0;
-	char *buffer;
-	int len = strlen(cmd);
-	buffer = calloc(len + 2, 1);
-	if (buffer == NULL) {
-		APP_ERROR("failed to allocate %d bytes\n", len + 2)
-		    perror("fail reason:");
-		return SERIAL_FAILED;
-	}
-	/* The command */
-	strcpy(buffer, cmd);
-	/* The enter key */
-	strcat(buffer, "\n");
-
-	ret = s_write((unsigned char *)buffer, strlen(buffer));
-	free(buffer);
-	if (ret < 0)
-		return SERIAL_FAILED;
-	return SERIAL_OK;
-}
+/* patterns of each kind */
+#define PATTERNS_MAX	16
+/* exit codes: timeouts, first fail pattern (then +1 each) */
+#define EXIT_TIMEOUT	2
+#define EXIT_TMO_FIRST	3
+#define EXIT_TMO_IDLE	4
+#define EXIT_FAIL_BASE	10
+
+#define DEFAULT_PROMPT	"U-Boot# "
+/* script keywords */
+#define KEY_SEND	"send "
+#define KEY_EXPECT	"expect "
+#define KEY_FAIL	"fail "
+#define KEY_TIMEOUT	"timeout "
+#define KEY_PROMPT	"prompt "
+#define LINE_SIZE	1024
+#define PIPE_MAX	16
+#define PACE_MAX	256
 
 /**
- * @brief get_response - get the response from uboot
- *
- * @param expected - expected string from uboot
- *
- * @return -match or fail
+ * A command and what to wait for after it
  */
-static int get_response(char *expected)
-{
-	int match_idx = 0;
-	int len = strlen(expected);
-	char current_char;
-	int ret = 0;
-	while (match_idx < len) {
-		ret = s_getc();
-		if (ret < 0) {
-			APP_ERROR("Failed to read character\n")
-			    return ret;
-		}
-		current_char = (char)ret;
-		if (current_char == expected[match_idx]) {
-			match_idx++;
-		} else
-			match_idx = 0;
-		/* Dump the character to user screen */
-		printf("%c", current_char);
-		fflush(stdout);
-	}
-	/* Hoorah!! match found */
-	return 0;
+struct step {
+	char *cmd;
+	char *expect[PATTERNS_MAX];
+	int expects;
+	char *fail[PATTERNS_MAX];
+	int fails;
+	/** total timeout in seconds, 0 for none */
+	float timeout;
+	/** prompt to wait for if nothing is expected */
+	char *prompt;
+	/** script line, 0 for the command line */
+	int line;
+};
 
-}
+/************* VARS   ***************/
+static struct step *steps;
+static int step_count;
+static float first, idle, timeout;
+static char *prompt = DEFAULT_PROMPT;
+static int script_mode;
 
 /**
  * @brief usage - help info
@@ -126,19 +127,325 @@ static void usage(char *appname)
 	       "Syntax:\n"
 	       "------\n"
 	       "%s -" PORT_ARG " portName -" CMD_ARG " \"command to send\" -"
-	       EXP_ARG " \"Expect String\"\n\n"
+	       EXP_ARG " \"Expect String\" [-" EXP_ARG " ...]\n\t[-" FAIL_ARG
+	       " \"Fail String\" [-" FAIL_ARG " ...]]\n\t[-" TIMEOUT_ARG
+	       " seconds] [-" FIRST_ARG " seconds] [-" IDLE_ARG " seconds]\n"
+	       "\t[-" CAPTURE_ARG " captureFile] [-" PACE_ARG " window]\n"
+	       "%s -" PORT_ARG " portName -" SCRIPT_ARG " script [-" PIPE_ARG
+	       " depth] [-" PROMPT_ARG " prompt] [-" TIMEOUT_ARG " seconds]\n"
+	       "\t[-" FIRST_ARG " seconds] [-" IDLE_ARG " seconds] [-"
+	       CAPTURE_ARG " captureFile] [-" PACE_ARG " window]\n\n"
 	       "Where:\n" "-----\n"
 	       "portName - RS232 device being used. Example: " PORT_NAME "\n"
 	       "command to send - Command to send to uboot\n"
 	       "Expect string - String to expect from target - on match"
-	       " the application returns\n"
+	       " the application returns\n\t0. Up to %d, all looked for at "
+	       "once\n"
+	       "Fail string - String which means the command failed - on "
+	       "match the application\n\treturns %d for the first, %d for "
+	       "the second..\n"
+	       "\tA string starting with 're:' is a regular expression "
+	       "matched on whole lines\n"
+	       "-" TIMEOUT_ARG " seconds - give up and return %d if no "
+	       "string matched by then\n"
+	       "-" FIRST_ARG " seconds - return %d if the target sent nothing "
+	       "for this long after the\n\tcommand\n"
+	       "-" IDLE_ARG " seconds - return %d if the target went silent "
+	       "for this long\n"
+	       "\tSeconds may have decimals, by default ucmd waits for ever\n"
+	       "script - file of steps run in one session, one per line:\n"
+	       "\t" KEY_SEND "command, then " KEY_EXPECT "string and "
+	       KEY_FAIL "string lines for it,\n"
+	       "\t" KEY_TIMEOUT "seconds and " KEY_PROMPT "string for the "
+	       "steps after. A step\n\twithout expect waits for the prompt\n"
+	       "depth - send up to %d steps which wait for the prompt ahead "
+	       "(default 1)\n"
+	       "prompt - U-Boot prompt (default '" DEFAULT_PROMPT "')\n"
+	       "captureFile - write all received data there, each line "
+	       "with a time stamp\n"
+	       "window - send commands at most this many characters ahead of "
+	       "their echo (up to\n\t%d), and again if the echo is wrong. "
+	       "Not with a depth over 1\n"
 	       "Usage Example:\n" "-------------\n"
 	       "%s -" PORT_ARG " " PORT_NAME " -" CMD_ARG " \"help\" -" EXP_ARG
-	       " \"U-Boot>\"\n", appname, appname);
+	       " \"U-Boot>\"\n"
+	       "%s -" PORT_ARG " " PORT_NAME " -" CMD_ARG " \"bootm\" -" EXP_ARG
+	       " \"Starting kernel\" -" FAIL_ARG " \"Bad Data CRC\" -"
+	       FAIL_ARG " \"re:^Wrong Image\" -" TIMEOUT_ARG " 30\n",
+	       appname, appname, PATTERNS_MAX, EXIT_FAIL_BASE, EXIT_FAIL_BASE + 1,
+	       EXIT_TIMEOUT, EXIT_TMO_FIRST, EXIT_TMO_IDLE, PIPE_MAX, PACE_MAX,
+	       appname, appname);
 	REVPRINT();
 	LIC_PRINT();
 }
 
+/**
+ * @brief step_new - add a step
+ *
+ * @param cmd - command to send
+ * @param line - script line
+ *
+ * @return the step or NULL
+ */
+static struct step *step_new(char *cmd, int line)
+{
+	struct step *step = realloc(steps, (step_count + 1) * sizeof(*step));
+
+	if (step == NULL) {
+		APP_ERROR("failed to allocate step\n")
+		    return NULL;
+	}
+	steps = step;
+	step += step_count++;
+	memset(step, 0, sizeof(*step));
+	step->cmd = cmd;
+	step->timeout = timeout;
+	step->prompt = prompt;
+	step->line = line;
+	return step;
+}
+
+/**
+ * @brief step_pattern - add an expect or fail pattern to a step
+ *
+ * @param list - expect or fail list of the step
+ * @param count - entries in list
+ * @param pattern - pattern
+ *
+ * @return 0 or error
+ */
+static signed int step_pattern(char **list, int *count, char *pattern)
+{
+	if (*count == PATTERNS_MAX) {
+		APP_ERROR("Too many patterns '%s' (max %d)\n", pattern,
+			  PATTERNS_MAX)
+		    return -1;
+	}
+	list[(*count)++] = pattern;
+	return 0;
+}
+
+/**
+ * @brief script_load - read the steps of a script
+ *
+ * Lines are "send command", followed by "expect string" and "fail string"
+ * lines for it, "timeout seconds" and "prompt string" for the steps after.
+ * Empty lines and lines starting with '#' are skipped.
+ *
+ * @param name - script file
+ *
+ * @return 0 or error
+ */
+static signed int script_load(char *name)
+{
+	char buf[LINE_SIZE];
+	struct step *step = NULL;
+	char *line, *arg;
+	int line_no = 0;
+	FILE *fp;
+
+	fp = fopen(name, "r");
+	if (fp == NULL) {
+		APP_ERROR("Cannot open script '%s'\n", name)
+		    perror(NULL);
+		return -1;
+	}
+	while (fgets(buf, sizeof(buf), fp) != NULL) {
+		line_no++;
+		buf[strcspn(buf, "\r\n")] = '\0';
+		if (!buf[0] || buf[0] == '#')
+			continue;
+		line = strdup(buf);
+		if (line == NULL)
+			goto error;
+		arg = strchr(line, ' ');
+		arg = arg ? arg + 1 : line + strlen(line);
+		if (!strncmp(line, KEY_SEND, strlen(KEY_SEND))) {
+			step = step_new(arg, line_no);
+			if (step == NULL)
+				goto error;
+		} else if (step != NULL &&
+			   !strncmp(line, KEY_EXPECT, strlen(KEY_EXPECT))) {
+			if (step_pattern(step->expect, &step->expects, arg))
+				goto error;
+		} else if (step != NULL &&
+			   !strncmp(line, KEY_FAIL, strlen(KEY_FAIL))) {
+			if (step_pattern(step->fail, &step->fails, arg))
+				goto error;
+		} else if (!strncmp(line, KEY_TIMEOUT, strlen(KEY_TIMEOUT))) {
+			sscanf(arg, "%f", &timeout);
+		} else if (!strncmp(line, KEY_PROMPT, strlen(KEY_PROMPT))) {
+			prompt = arg;
+		} else {
+			APP_ERROR("%s:%d: cannot parse '%s'\n", name, line_no,
+				  buf)
+			    goto error;
+		}
+	}
+	fclose(fp);
+	return 0;
+error:
+	fclose(fp);
+	return -1;
+}
+
+/**
+ * @brief step_matcher - the patterns a step waits for
+ *
+ * @param step - step
+ * @param ready - if not NULL, wait for this prompt instead of the expected
+ *	strings (the fail strings still apply)
+ *
+ * @return matcher or NULL
+ */
+static struct con_match *step_matcher(struct step *step, char *ready)
+{
+	struct con_match *match = con_match_new();
+	int i, ret = 0;
+
+	if (match == NULL)
+		return NULL;
+	for (i = 0; i < step->expects && !ready && !ret; i++)
+		ret = con_match_add(match, step->expect[i], 0);
+	if (!step->expects && !ready)
+		ready = step->prompt;
+	if (ready && !ret)
+		ret = con_match_add(match, ready, 0);
+	for (i = 0; i < step->fails && !ret; i++)
+		ret = con_match_add(match, step->fail[i], EXIT_FAIL_BASE + i);
+	if (ret) {
+		con_match_free(match);
+		return NULL;
+	}
+	return match;
+}
+
+/**
+ * @brief step_match - wait for the patterns of a step
+ *
+ * @param step - step
+ * @param ready - if not NULL, wait for this prompt instead
+ *
+ * @return 0 if an expected string came, else the exit code
+ */
+static signed int step_match(struct step *step, char *ready)
+{
+	struct con_match *match = step_matcher(step, ready);
+	int c, tmo, ret;
+
+	if (match == NULL)
+		return -1;
+	s_set_timeouts(first * 1000, idle * 1000, step->timeout * 1000);
+	c = con_match_wait(match, NULL, 0, 0);
+	tmo = s_timeout_which();
+	if (c == SERIAL_TIMEDOUT && tmo == SERIAL_TMO_FIRST) {
+		APP_ERROR("\nNo response in %.1f seconds\n", first)
+		    ret = EXIT_TMO_FIRST;
+	} else if (c == SERIAL_TIMEDOUT && tmo == SERIAL_TMO_IDLE) {
+		APP_ERROR("\nTarget silent for %.1f seconds\n", idle)
+		    ret = EXIT_TMO_IDLE;
+	} else if (c == SERIAL_TIMEDOUT) {
+		APP_ERROR("\nNothing expected in %.1f seconds\n",
+			  step->timeout)
+		    ret = EXIT_TIMEOUT;
+	} else if (c < 0) {
+		APP_ERROR("\nFailed to get expected '%s'\n",
+			  step->expects ? step->expect[0] : step->prompt)
+		    ret = c;
+	} else if (c >= EXIT_FAIL_BASE) {
+		APP_ERROR("\nFailure '%s' found\n", con_match_text(match, c))
+		    ret = c;
+	} else {
+		ret = 0;
+	}
+	con_match_free(match);
+	return ret;
+}
+
+/**
+ * @brief step_wait - wait for the outcome of a step
+ *
+ * After an expected string, the prompt the next command is typed at is
+ * waited for too, unless it was the expected string, so that the prompts
+ * of the steps after are counted right.
+ *
+ * @param step - step
+ * @param next - step after it, NULL if none
+ * @param start - time the step started at
+ *
+ * @return 0 if an expected string came, else the exit code
+ */
+static signed int step_wait(struct step *step, struct step *next,
+			    unsigned long long start)
+{
+	int i, ret;
+
+	ret = step_match(step, NULL);
+	if (!ret && step->expects && next != NULL) {
+		for (i = 0; i < step->expects; i++)
+			if (!strcmp(step->expect[i], next->prompt))
+				break;
+		if (i == step->expects)
+			ret = step_match(step, next->prompt);
+	}
+	if (script_mode)
+		COLOR_PRINT(BLUE, "\n[step %d, line %d: %.3f s] %s"
+			    "\n", (int)(step - steps) + 1, step->line,
+			    (t_now_us() - start) / 1000000.0, step->cmd);
+	return ret;
+}
+
+/**
+ * @brief run_steps - send the commands and check what comes back
+ *
+ * Steps which only wait for the prompt are sent up to pipeline at a time,
+ * and sorted out by counting the prompts coming back.
+ *
+ * @param pipeline - steps sent ahead
+ *
+ * @return 0 if all went as expected, else the exit code of the first step
+ * which did not
+ */
+static signed int run_steps(int pipeline)
+{
+	unsigned long long start, begin = t_now_us();
+	int i = 0, j, k, ret = 0;
+
+	while (i < step_count && !ret) {
+		/* prompt only steps go together */
+		j = i + 1;
+		if (!steps[i].expects)
+			while (j < step_count && j - i < pipeline &&
+			       !steps[j].expects)
+				j++;
+		start = t_now_us();
+		/* the deadlines of the step before are not for the echo */
+		s_set_timeouts(0, 0, 0);
+		for (k = i; k < j; k++) {
+			ret = con_send_cmd(steps[k].cmd);
+			if (ret != SERIAL_OK) {
+				APP_ERROR("Failed to send command '%s'\n",
+					  steps[k].cmd)
+				    return ret;
+			}
+		}
+		for (k = i; k < j && !ret; k++) {
+			ret = step_wait(&steps[k], (k + 1 < step_count) ?
+					&steps[k + 1] : NULL, start);
+			/* the next one of the batch started with this prompt */
+			start = t_now_us();
+		}
+		if (ret && script_mode)
+			APP_ERROR("Step %d (line %d) '%s' failed\n", k,
+				  steps[k - 1].line, steps[k - 1].cmd)
+		i = j;
+	}
+	if (!ret && script_mode)
+		COLOR_PRINT(GREEN, "%d steps in %.3f s\n", step_count,
+			    (t_now_us() - begin) / 1000000.0);
+	return ret;
+}
+
 /**
  * @brief main application entry
  *
@@ -152,14 +459,25 @@ int main(int argc, char **argv)
 	signed char ret = 0;
 	char *port = NULL;
 	char *command = NULL;
-	char *expect = NULL;
+	char *expect[PATTERNS_MAX];
+	char *fail[PATTERNS_MAX];
+	int expects = 0, fails = 0;
+	char *script = NULL;
+	char *capture = NULL;
+	unsigned long dropped;
+	int pipeline = 1;
+	int pace = 0;
+	struct step *step;
 	char *appname = argv[0];
-	int c;
+	int c, i;
 	/* Option validation */
 	opterr = 0;
 
 	while ((c =
-		getopt(argc, argv, PORT_ARG ":" CMD_ARG ":" EXP_ARG ":")) != -1)
+		getopt(argc, argv, PORT_ARG ":" CMD_ARG ":" EXP_ARG ":" FAIL_ARG
+		       ":" TIMEOUT_ARG ":" FIRST_ARG ":" IDLE_ARG ":" SCRIPT_ARG
+		       ":" PIPE_ARG ":" PROMPT_ARG ":" CAPTURE_ARG ":" PACE_ARG
+		       ":")) != -1)
 		switch (c) {
 		case PORT_ARG_C:
 			port = optarg;
@@ -168,11 +486,53 @@ int main(int argc, char **argv)
 			command = optarg;
 			break;
 		case EXP_ARG_C:
-			expect = optarg;
+			if (step_pattern(expect, &expects, optarg))
+				return 1;
+			break;
+		case FAIL_ARG_C:
+			if (step_pattern(fail, &fails, optarg))
+				return 1;
+			break;
+		case TIMEOUT_ARG_C:
+			sscanf(optarg, "%f", &timeout);
+			break;
+		case FIRST_ARG_C:
+			sscanf(optarg, "%f", &first);
+			break;
+		case IDLE_ARG_C:
+			sscanf(optarg, "%f", &idle);
+			break;
+		case SCRIPT_ARG_C:
+			script = optarg;
+			break;
+		case PIPE_ARG_C:
+			sscanf(optarg, "%d", &pipeline);
+			if (pipeline < 1)
+				pipeline = 1;
+			if (pipeline > PIPE_MAX)
+				pipeline = PIPE_MAX;
+			break;
+		case PROMPT_ARG_C:
+			prompt = optarg;
+			break;
+		case CAPTURE_ARG_C:
+			capture = optarg;
+			break;
+		case PACE_ARG_C:
+			sscanf(optarg, "%d", &pace);
+			if (pace < 0)
+				pace = 0;
+			if (pace > PACE_MAX)
+				pace = PACE_MAX;
 			break;
 		case '?':
 			if ((optopt == CMD_ARG_C) || (optopt == EXP_ARG_C)
-			    || (optopt == PORT_ARG_C)) {
+			    || (optopt == PORT_ARG_C) || (optopt == FAIL_ARG_C)
+			    || (optopt == TIMEOUT_ARG_C) || (optopt == FIRST_ARG_C)
+			    || (optopt == IDLE_ARG_C) || (optopt == SCRIPT_ARG_C)
+			    || (optopt == PIPE_ARG_C) || (optopt == PROMPT_ARG_C)
+			    || (optopt == CAPTURE_ARG_C)
+			    || (optopt == PACE_ARG_C)) {
 				APP_ERROR("Option -%c requires an argument.\n",
 					  optopt)
 			} else if (isprint(optopt)) {
@@ -186,11 +546,30 @@ int main(int argc, char **argv)
 		default:
 			abort();
 		}
-	if ((port == NULL) || (command == NULL) || (expect == NULL)) {
+	if ((port == NULL) || ((script == NULL) &&
+				((command == NULL) || (!expects)))) {
 		APP_ERROR("Error: Not Enough Args\n")
 		    usage(appname);
 		return -1;
 	}
+	/* steps sent ahead are echoed after the output of the ones before */
+	if (pace && pipeline > 1) {
+		APP_ERROR("A window cannot be used with a depth over 1\n")
+		    return -1;
+	}
+	if (script != NULL) {
+		script_mode = 1;
+		if (script_load(script))
+			return -1;
+	} else {
+		step = step_new(command, 0);
+		if (step == NULL)
+			return -1;
+		for (i = 0; i < expects; i++)
+			step_pattern(step->expect, &step->expects, expect[i]);
+		for (i = 0; i < fails; i++)
+			step_pattern(step->fail, &step->fails, fail[i]);
+	}
 
 	/* Setup the port */
 	ret = s_open(port);
@@ -212,29 +591,35 @@ int main(int argc, char **argv)
 		APP_ERROR("Failed to flush data\n")
 		    return ret;
 	}
-	/* send the command to uboot */
-	ret = send_cmd(command);
-	if (ret != SERIAL_OK) {
-		s_close();
-		APP_ERROR("Failed to send command '%s'\n", command)
-		    return ret;
-	}
 
-	printf("Output:\n");
-	/* Wait for the response to come from target */
-	ret = get_response(expect);
-	if (ret != SERIAL_OK) {
-		s_close();
-		APP_ERROR("Failed to get expected '%s'\n", expect)
-		    return ret;
+	if (capture != NULL) {
+		if (cap_open(capture)) {
+			s_close();
+			return -1;
+		}
+		con_set_tap(cap_write);
+	}
+	con_set_pace(pace);
+	if (!script_mode)
+		printf("Output:\n");
+	/* send the commands and wait for the expected or fail strings */
+	c = run_steps(pipeline);
+	if (capture != NULL) {
+		con_set_tap(NULL);
+		dropped = cap_close();
+		if (dropped)
+			APP_ERROR("Capture lost %lu bytes, disk too slow\n",
+				  dropped)
 	}
-
 	ret = s_close();
 	if (ret != SERIAL_OK) {
 		APP_ERROR("serial close failed\n")
 		    return ret;
 	}
-	printf("\nMatch Found. Operation completed!\n");
+	if (c)
+		return c;
+	if (!script_mode)
+		printf("\nMatch Found. Operation completed!\n");
 
 	return ret;
 }
@@ -88,18 +88,28 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#ifndef __WIN32__
+#include <pthread.h>
+/* Read and encode packets in a thread of their own */
+#define K_PIPELINE
+#endif
 #include "rev.h"
 #include "serial.h"
 #include "file.h"
 #include "f_status.h"
+#include "k_encode.h"
+#include "timer.h"
+#include "crc.h"
+#include "console.h"
+#ifndef DISABLE_ZLIB
+#include "pgzip.h"
+#endif
 
 #define XON_CHAR		17
 #define XOFF_CHAR		19
 #define START_CHAR		0x01
 #define ETX_CHAR		0x03
 #define END_CHAR		0x0D
-#define SPACE			0x20
-#define K_ESCAPE		0x23
 #define SEND_TYPE		'S'
 #define DATA_TYPE		'D'
 #define ACK_TYPE		'Y'
@@ -107,10 +117,10 @@
 #define BREAK_TYPE		'B'
 #define tochar(x)		((char) (((x) + SPACE) & 0xff))
 #define untochar(x)		((int) (((x) - SPACE) & 0xff))
-#define escape_it(ch)		((ch) ^ 0x40 )
 
 #define SEQ_ERROR		0x40
 #define CHK_ERROR		0x41
+#define TMO_ERROR		0x42
 
 /* Enable Large packet transfers? */
 #undef LARGE_PACKETS_ENABLE
@@ -129,6 +139,20 @@
 #define MAX_CHUNK		100
 #endif
 #define RETRY_MAX		4
+/* Packet size adaption: smallest packet, growth step, window in packets */
+#define K_CHUNK_MIN		16
+#define K_CHUNK_STEP		16
+#define K_WINDOW		16
+/* Inter-packet gap with -g: step and limit */
+#define K_GAP_STEP_US		250
+#define K_GAP_MAX_US		20000
+/* Ack timeout: before the first round trip is measured, and limits */
+#define K_RTO_INIT_US		1000000ULL
+#define K_RTO_MIN_US		5000ULL
+#define K_RTO_MAX_US		5000000ULL
+#define K_RTO_GRANULARITY_US	2000ULL
+/* Frames encoded ahead of the transmitter */
+#define K_QUEUE_DEPTH		32
 #define PRINT_SIZE		100
 
 #define PORT_ARG		"p"
@@ -139,6 +163,84 @@
 #define DLY_ARG_C		'd'
 #define SILENT_STAT_ARG		"q"
 #define SILENT_STAT_C		'q'
+#define BENCH_ARG		"B"
+#define BENCH_ARG_C		'B'
+#define ADDR_ARG		"a"
+#define ADDR_ARG_C		'a'
+#define PROMPT_ARG		"P"
+#define PROMPT_ARG_C		'P'
+#define RESUME_ARG		"r"
+#define RESUME_ARG_C		'r'
+#define PACE_ARG		"g"
+#define PACE_ARG_C		'g'
+#define BAUD_ARG		"b"
+#define BAUD_ARG_C		'b'
+#define ALIGN_ARG		"A"
+#define ALIGN_ARG_C		'A'
+#define ADDR_OUT_ARG		"o"
+#define ADDR_OUT_ARG_C		'o'
+#define UNZIP_ARG		"z"
+#define UNZIP_ARG_C		'z'
+#define DELTA_ARG		"D"
+#define DELTA_ARG_C		'D'
+#define READ_CMD_ARG		"R"
+#define READ_CMD_ARG_C		'R'
+#define ENV_ARG			"E"
+#define ENV_ARG_C		'E'
+#define ENV_FORMAT_ARG		"e"
+#define ENV_FORMAT_ARG_C	'e'
+#define SAVEENV_ARG		"S"
+#define SAVEENV_ARG_C		'S'
+
+/* U-Boot console interaction */
+#define DEFAULT_PROMPT		"U-Boot# "
+#define LOADB_READY		"bps..."
+/* loadb with a baudrate: switch, then confirm with ENTER and ESC */
+#define LOADB_SWITCH		"press ENTER"
+#define LOADB_SWITCH_BACK	"press ESC"
+#define ESC_CHAR		0x1B
+#define CONSOLE_BAUD		115200
+/* U-Boot waits 50ms before and after changing its rate */
+#define BAUD_SETTLE_MS		100
+#define RESUME_MAX		3
+/* Console waits: replies to short commands, and commands that run long */
+#define CON_TIMEOUT_MS		5000
+#define CON_SLOW_TIMEOUT_MS	60000
+/* Abort sequences sent before giving up on getting the prompt back */
+#define ABORT_TRIES		3
+#define CMD_SIZE		100
+#define RESPONSE_SIZE		512
+#define READ_SIZE		4096
+/* Delta mode: several crc32 per command line, kept under U-Boot's CBSIZE */
+#define DELTA_LINE_MAX		180
+#define DELTA_RESPONSE_SIZE	1024
+
+/* Environment import: env import flag of each blob format */
+#define ENV_TEXT		't'
+#define ENV_BINARY		'b'
+#define ENV_CHECKSUM		'c'
+/* crc32 in front of the data of a checksummed environment */
+#define ENV_CRC_SIZE		4
+#define ENV_LINE_MAX		4096
+/* printenv output kept for the compare, more than any U-Boot env */
+#define ENV_PRINT_SIZE		0x100000
+/* What env import and saveenv print when they fail, see k_env_run */
+#define ENV_ERROR		"## Error"
+#define ENV_IMPORT_FAILED	"import failed"
+#define ENV_FAILED		"\nFAILED"
+#define ENV_SAVE_FAILED		"... FAILED"
+#define ENV_SAVE_FAILED_LC	"... failed"
+
+/* Minimum time each encoder is run for in benchmark mode */
+#define BENCH_TIME_US		500000
+
+/* Files sent in one transfer, and default alignment of each */
+#define BLOBS_MAX		8
+#define BLOB_ALIGN		0x1000
+/* -f file@offset */
+#define BLOB_OFFSET_SEP		'@'
+/* what unzip says when it worked */
+#define UNZIP_DONE		"Uncompressed size:"
 
 #ifdef LARGE_PACKETS_ENABLE
 struct kermit_data_header_large {
@@ -176,480 +278,1926 @@ struct kermit_ack_nack_type {
 	unsigned char eol;
 };
 
-static unsigned int delay;
-/**
- * @brief s1_getpacket - get a packet from the target
- *  s_read is expected to be blocking in this case
- * @param packet  - the buffer to which data is stored
- * @param size  the size of the packet
- */
-static void s1_getpacket(char *packet, int size)
-{
-#ifdef CONSOLE_TEST
-	while (size) {
-		*packet = console_getc();
-		packet++;
-		size--;
-	}
-#else
-	memset((void *)packet, 0x00, size);
-	if (delay)
-#ifndef __WIN32__
-		usleep(1000 * delay);
+/** Worst case frame: header, every data byte escaped, checksum, end */
+#ifdef LARGE_PACKETS_ENABLE
+#define K_FRAME_MAX	(sizeof(struct kermit_data_header_large) + \
+			 (MAX_CHUNK * 2) + 2)
 #else
-		Sleep(delay);
+#define K_FRAME_MAX	(sizeof(struct kermit_data_header_small) + \
+			 (MAX_CHUNK * 2) + 2)
 #endif
-	s_read((unsigned char *)packet, size);
-#endif
-}
 
 /**
- * @brief s1_sendpacket - send a data packet to the target
+ * Encoded data packet, ready to go on the wire
+ */
+struct k_frame {
+	/** sequence number of the packet */
+	unsigned char sequence;
+	/** file bytes carried in the packet */
+	unsigned int data_size;
+	/** bytes on the wire */
+	unsigned int len;
+	unsigned char buf[K_FRAME_MAX];
+};
+
+/**
+ * Queue of encoded frames between the producer and transmitter
  *
- * @param packet - buffer containing the data buffer
- * @param size - size of the buffer
+ * frames[head % K_QUEUE_DEPTH] is the next frame to transmit,
+ * frames[tail % K_QUEUE_DEPTH] the next one the producer fills.
  */
-static void s1_sendpacket(char *packet, int size)
-{
-#ifdef CONSOLE_TEST
-	while (size) {
-		console_putc(*packet);
-		packet++;
-		size--;
-	}
-#else
-	s_write((unsigned char *)packet, size);
+static struct {
+	struct k_frame frames[K_QUEUE_DEPTH];
+	unsigned int head;
+	unsigned int tail;
+	/** producer state: bytes left to read and next sequence number */
+	signed long remaining;
+	unsigned char sequence;
+	/** file bytes per packet the producer uses now, see k_link_adapt */
+	unsigned int chunk;
+	/** 0 - producing, 1 - end of file, <0 - error */
+	signed int status;
+	/** transmitter wants the producer to quit */
+	int stop;
+#ifdef K_PIPELINE
+	pthread_t producer;
+	pthread_mutex_t lock;
+	pthread_cond_t not_empty;
+	pthread_cond_t not_full;
 #endif
-}
+} k_queue;
 
-#ifdef DEBUG
-/* Converts escaped kermit char to binary char
- * This is from loadb.c in U-Boot
+/* Set if loadb is driven from here, see k_download */
+static int console_mode;
+static unsigned long load_addr;
+static char *prompt = DEFAULT_PROMPT;
+static int resume_max = RESUME_MAX;
+/* Set to allow inter-packet gaps */
+static int pacing;
+/* Rate for loadb to switch to for the transfer, 0 for no switch */
+static unsigned long load_baud;
+
+/**
+ * Payload: the files given, laid out one after the other as one image
+ *
+ * A file goes at the offset given with it, else at the end of the file
+ * before rounded up to blob_align. Gaps are sent as zeros.
  */
-static char ktrans(char in)
-{
-	if ((in & 0x60) == 0x40) {
-		return (char)(in & ~0x40);
-	} else if ((in & 0x7f) == 0x3f) {
-		return (char)(in | 0x40);
-	} else
-		return in;
-}
-#endif
+static struct blob {
+	char *name;
+	/** offset in the payload, -1 till laid out */
+	signed long offset;
+	signed long size;
+} blobs[BLOBS_MAX];
+static int blob_count;
+static unsigned long blob_align = BLOB_ALIGN;
+/* file to write the blob addresses to */
+static char *addr_file;
+/* Set to send the payload compressed and unzip it to unzip_addr */
+static int compress;
+static unsigned long unzip_addr;
+/* Set to send only the blocks whose crc32 differs on the target */
+static unsigned long delta_block;
+/* command filling the target RAM with the old image before the compare */
+static char *read_cmd;
+/* key=value file sent as an environment blob and imported with env import */
+static char *env_file;
+static char env_format = ENV_CHECKSUM;
+/* Set to run saveenv after the import */
+static int env_save;
+
+static struct {
+	signed long size;
+	/** read position */
+	signed long pos;
+	/** blob whose file is open, -1 for none */
+	int open;
+	/** payload in memory (compressed) instead of the files */
+	unsigned char *data;
+	/** size and crc32 of the files laid out, before compression */
+	signed long raw_size;
+	unsigned int raw_crc;
+} payload = {
+	.open = -1,
+};
 
 /**
- * @brief should_escape - decides if a binary character should be escaped
- * as per kermit protocol
+ * @brief pl_add - add a file to the payload
  *
- * Escape is a concept which prefixes '#' in front of a converted character
- * The idea is to deny CONTROL characters from going over serial port directly.
- * so all characters 0 to 31 and 127 ASCII code is considered control
- * characters
+ * Only an '@' followed by nothing but a hex number up to the end starts
+ * the offset, names with an '@' of their own are taken as they are.
  *
- * @param out - character to be analyzed
+ * @param arg - file name, optionally followed by @offset (hex)
  *
- * @return -1 if it should be escaped, else 0
+ * @return -success/failure
  */
-static int should_escape(char out)
+static signed int pl_add(char *arg)
 {
-	char a = out & 0x7F;	/* Get low 7 bits of character */
-	/* If data is control prefix, OR
-	 * Data is the escape character itself
-	 */
-	if ((a < SPACE || a == 0x7F)
-	    || (a == K_ESCAPE))
-		return 1;
+	char *sep = strrchr(arg, BLOB_OFFSET_SEP);
+	struct blob *b = &blobs[blob_count];
+	char *end;
+	unsigned long offset;
+
+	if (blob_count == BLOBS_MAX) {
+		APP_ERROR("At most %d files can be sent\n", BLOBS_MAX)
+		    return -1;
+	}
+	b->offset = -1;
+	if (sep != NULL && isxdigit((unsigned char)sep[1])) {
+		offset = strtoul(sep + 1, &end, 16);
+		if (*end == 0) {
+			b->offset = offset;
+			*sep = 0;
+		}
+	}
+	b->name = arg;
+	blob_count++;
 	return 0;
 }
 
 /**
- * @brief k_escape - provide escape character convertion
- *
- * @param out - character to be escaped
+ * @brief pl_layout - size the files and place them in the payload
  *
- * @return -escaped character
+ * @return payload size or <0 on error
  */
-static char k_escape(char out)
+static signed long pl_layout(void)
 {
-	char a = out & 0x7F;	/* Get low 7 bits of character */
-	if (a != K_ESCAPE)
-		out = escape_it(out);	/* and make character printable. */
-	/* Escape character send as is */
-	return out;
+	signed long end = 0;
+	int i;
+
+	for (i = 0; i < blob_count; i++) {
+		blobs[i].size = f_size(blobs[i].name);
+		if (blobs[i].size < 0) {
+			APP_ERROR("File Size Operation failed! File %s "
+				  "exists?\n", blobs[i].name)
+			    return -1;
+		}
+		if (blobs[i].offset < 0)
+			blobs[i].offset = (end + blob_align - 1) /
+			    blob_align * blob_align;
+		if (blobs[i].offset < end) {
+			APP_ERROR("%s at 0x%lX overlaps the file before\n",
+				  blobs[i].name, blobs[i].offset)
+			    return -1;
+		}
+		end = blobs[i].offset + blobs[i].size;
+	}
+	payload.size = end;
+	payload.pos = 0;
+	return end;
 }
 
 /**
- * @brief k_send_data_packet_small - send a small data packet
+ * @brief pl_seek - set the position to read the payload from
  *
- * Kermit protocol allows for two types of data packets ->small and large.
- * This function sends a small packet to the target. the identification of a
- * small packet is if length_normal ==0 in which case length_hi and lo are
- * used from k_large structure.
- *
- * @param buffer - buffer to send
- * @param size -size of the buffer to send
- * @param sequence - sequence number of the transmission.
+ * @param offset - offset in the payload
  *
- * @return success/fail
+ * @return -success/failure
  */
-static signed int k_send_data_packet_small(unsigned char *buffer,
-					   unsigned int size,
-					   unsigned char sequence)
+static signed int pl_seek(signed long offset)
 {
-	struct kermit_data_header_small k_small;
-	int sum = 0;
-	int count = 0;
-	int new_size = 0;
-	/* Allocation assuming all need escape characters.. */
-	char *my_new_buffer = calloc(1, (size * 2) + 3);
-	if (my_new_buffer == NULL) {
-		APP_ERROR("failed to allocate memory \n")
-		    perror(NULL);
+	if (offset > payload.size)
 		return -1;
+	if (payload.data != NULL) {
+		payload.pos = offset;
+		return 0;
 	}
-	memset(&k_small, 0, sizeof(struct kermit_data_header_small));
-	k_small.start = START_CHAR;
-	k_small.sequence_number = tochar(sequence);
-	k_small.packet_type = DATA_TYPE;
-	while (count < size) {
-
-		/* handle kermit escape character in buffer */
-		if (should_escape(*(buffer + count))) {
-			*(my_new_buffer + new_size) = K_ESCAPE;
-			sum += *(my_new_buffer + new_size);
-			new_size++;
-			*(my_new_buffer + new_size) =
-			    k_escape(*(buffer + count));
-#ifdef DEBUG
-			printf("escape - Ori=0x%x New = 0x%x ReTrans=0x%x\n",
-			       (0xFF) & (*(buffer + count)),
-			       (0xFF) & *(my_new_buffer + new_size),
-			       (0xFF) & ktrans(*(my_new_buffer + new_size)));
-#endif
-		} else
-			*(my_new_buffer + new_size) = (*(buffer + count));
+	/* reopened and positioned by the next read */
+	if (payload.open >= 0)
+		f_close();
+	payload.open = -1;
+	payload.pos = offset;
+	return 0;
+}
 
-#ifdef DEBUG
-		printf("**>[%d]-%d 0x%02x 0x%02x[%c]\n", count, new_size,
-		       (char)*(buffer + count),
-		       (char)*(my_new_buffer + new_size),
-		       (char)*(my_new_buffer + new_size));
-#endif
-		sum += *(my_new_buffer + new_size);
-		count++;
-		new_size++;
-	}
-	/* Add to cover for sequence, packet type and checksum */
-	k_small.length_normal = tochar((new_size) + 3);
-	sum +=
-	    k_small.length_normal + k_small.sequence_number +
-	    k_small.packet_type;
-	/* Store the checksum for the packet */
-	*(my_new_buffer + new_size) =
-	    tochar((sum + ((sum >> 6) & 0x03)) & 0x3f);
-	new_size++;
-	/* Add end character */
-	*(my_new_buffer + new_size) = END_CHAR;
-	new_size++;
-#ifdef DEBUG
-	{
-		int i = 0;
-		char *buf = (char *)&k_small;
+/**
+ * @brief pl_read - read the payload
+ *
+ * @param buffer - where to read to
+ * @param size - bytes to read
+ *
+ * @return bytes read, short only at the end of payload, <0 on error
+ */
+static signed int pl_read(unsigned char *buffer, unsigned int size)
+{
+	unsigned int done = 0, n;
+	signed long left;
+	signed int ret;
+	int i;
 
-		printf("ksmall\n");
-		for (i = 0; i < sizeof(k_small); i++) {
-			printf("k_small[%d]=0x%x[%c]-%d\n", i, (char)buf[i],
-			       (char)buf[i], untochar(buf[i]));
-		}
-		printf("buffer\n");
-		for (i = 0; i < new_size; i++) {
-			printf("buff[%d]=0x%02x[%c]-%d\n", i,
-			       (char)my_new_buffer[i], (char)my_new_buffer[i],
-			       untochar(my_new_buffer[i]));
+	if (payload.data != NULL) {
+		if (size > payload.size - payload.pos)
+			size = payload.size - payload.pos;
+		memcpy(buffer, payload.data + payload.pos, size);
+		payload.pos += size;
+		return size;
+	}
+	while (done < size && payload.pos < payload.size) {
+		for (i = 0; i < blob_count; i++)
+			if (payload.pos < blobs[i].offset + blobs[i].size)
+				break;
+		left = size - done;
+		if (payload.pos < blobs[i].offset) {
+			/* padding up to the next file */
+			n = (blobs[i].offset - payload.pos < left) ?
+			    blobs[i].offset - payload.pos : left;
+			memset(buffer + done, 0, n);
+		} else {
+			if (payload.open != i) {
+				if (payload.open >= 0)
+					f_close();
+				payload.open = -1;
+				if (f_open(blobs[i].name) != FILE_OK ||
+				    f_seek(payload.pos - blobs[i].offset)) {
+					APP_ERROR("File Open failed!File %s "
+						  "Exists & readable?\n",
+						  blobs[i].name)
+					    return -1;
+				}
+				payload.open = i;
+			}
+			n = (blobs[i].offset + blobs[i].size - payload.pos <
+			     left) ? blobs[i].offset + blobs[i].size -
+			    payload.pos : left;
+			ret = f_read(buffer + done, n);
+			if (ret <= 0)
+				return -1;
+			n = ret;
 		}
+		done += n;
+		payload.pos += n;
 	}
-#endif
-	s1_sendpacket((char *)&k_small, sizeof(k_small));
-	s1_sendpacket(my_new_buffer, new_size);
-	free(my_new_buffer);
+	return done;
+}
 
-	return 0;
+/**
+ * @brief pl_close - done with the payload
+ */
+static void pl_close(void)
+{
+	if (payload.open >= 0 && f_close() != FILE_OK) {
+		APP_ERROR("File Close failed\n")
+	}
+	payload.open = -1;
+	free(payload.data);
+	payload.data = NULL;
 }
 
-#ifdef LARGE_PACKETS_ENABLE
 /**
- * @brief k_send_data_packet_large - send a large data packet
+ * @brief pl_crc - crc32 of the payload as sent
  *
- * Kermit protocol allows for two types of data packets ->small and large.
- * This function sends a large packet to the target. the identification of a
- * large packet is if length_normal ==0 in which case length_hi and lo are
- * used from k_large structure.
+ * @return crc32
+ */
+static unsigned int pl_crc(void)
+{
+	unsigned char buffer[READ_SIZE];
+	unsigned int crc = 0;
+	signed int ret;
+
+	if (pl_seek(0))
+		return 0;
+	while ((ret = pl_read(buffer, READ_SIZE)) > 0)
+		crc = crc32_update(crc, buffer, ret);
+	return crc;
+}
+
+#ifndef DISABLE_ZLIB
+/**
+ * @brief pl_wire_size - bytes the payload takes in kermit packets
  *
- * @param buffer - buffer to send
- * @param size -size of the buffer to send
- * @param sequence - sequence number of the transmission.
+ * @param data - payload
+ * @param size - size of payload
  *
- * @return success/fail
+ * @return bytes on the wire, acks not counted
  */
-static signed int k_send_data_packet_large(unsigned char *buffer,
-					   unsigned int size,
-					   unsigned char sequence)
+static unsigned long pl_wire_size(unsigned char *data, signed long size)
 {
-	struct kermit_data_header_large k_large;
-	int sum = 0;
-	int sum_pkt = 0;
-	int count = 0;
-	int new_size = 0;
-	/* Allocation assuming all need escape characters.. */
-	char *my_new_buffer = calloc(1, (size * 2) + 3);
-	if (my_new_buffer == NULL) {
+	unsigned char out[MAX_CHUNK * 2];
+	unsigned long wire = 0;
+	unsigned int sum;
+	signed long off;
+
+	for (off = 0; off < size; off += MAX_CHUNK) {
+		sum = 0;
+		wire += k_encode(out, data + off, (size - off > MAX_CHUNK) ?
+				 MAX_CHUNK : size - off, &sum) +
+		    sizeof(struct kermit_data_header_small) + 2;
+	}
+	return wire;
+}
+
+/**
+ * @brief pl_compress - replace the payload with its gzip
+ *
+ * All cores compress, at the best level which is still at least twice as
+ * fast as the line (the console rate or the loadb rate).
+ *
+ * @return -success/failure
+ */
+static signed int pl_compress(void)
+{
+	unsigned char *raw;
+	unsigned long gz_size, raw_wire, gz_wire;
+	unsigned long long start, elapsed;
+	unsigned long line_rate = (load_baud ? load_baud : CONSOLE_BAUD) / 10;
+	int threads = pgz_threads();
+	int level;
+	double speed;
+
+	payload.raw_size = payload.size;
+	raw = malloc(payload.size ? payload.size : 1);
+	if (raw == NULL) {
 		APP_ERROR("failed to allocate memory \n")
 		    perror(NULL);
 		return -1;
 	}
-	memset(&k_large, 0, sizeof(struct kermit_data_header_large));
-	k_large.start = START_CHAR;
-	k_large.sequence_number = tochar(sequence);
-	k_large.packet_type = DATA_TYPE;
-	while (count < size) {
-
-		/* handle kermit escape character in buffer */
-		if (should_escape(*(buffer + count))) {
-			*(my_new_buffer + new_size) = K_ESCAPE;
-			sum += *(my_new_buffer + new_size);
-			new_size++;
-			*(my_new_buffer + new_size) =
-			    k_escape(*(buffer + count));
-#ifdef DEBUG
-			printf("escape - Ori=0x%x New = 0x%x ReTrans=0x%x\n",
-			       (0xFF) & (*(buffer + count)),
-			       (0xFF) & *(my_new_buffer + new_size),
-			       (0xFF) & ktrans(*(my_new_buffer + new_size)));
-#endif
-		} else
-			*(my_new_buffer + new_size) = (*(buffer + count));
-
-#ifdef DEBUG
-		printf("**>[%d]-%d 0x%02x 0x%02x[%c]\n", count, new_size,
-		       (char)*(buffer + count),
-		       (char)*(my_new_buffer + new_size),
-		       (char)*(my_new_buffer + new_size));
-#endif
-		sum += *(my_new_buffer + new_size);
-		count++;
-		new_size++;
+	if (pl_seek(0) || pl_read(raw, payload.size) != payload.size) {
+		APP_ERROR("Oops.. file read failed!\n")
+		    free(raw);
+		return -1;
 	}
-	/* Add to cover checksum */
-	new_size += 1;
-	k_large.length_normal = tochar(0x0);
-	k_large.length_hi = new_size / 95;
-	k_large.length_lo = new_size - (k_large.length_hi * 95);
-	k_large.length_hi = tochar(k_large.length_hi);
-	k_large.length_lo = tochar(k_large.length_lo);
-	sum_pkt =
-	    k_large.length_normal + k_large.sequence_number +
-	    k_large.packet_type + k_large.length_lo + k_large.length_hi;
-	k_large.header_checksum =
-	    tochar((sum_pkt + ((sum_pkt >> 6) & 0x03)) & 0x3f);
-	new_size -= 1;
-	sum += sum_pkt + k_large.header_checksum;
-	/* Store the checksum for the packet */
-	*(my_new_buffer + new_size) =
-	    tochar((sum + ((sum >> 6) & 0x03)) & 0x3f);
-	new_size++;
-	/* Add end character */
-	*(my_new_buffer + new_size) = END_CHAR;
-	new_size++;
-#ifdef DEBUG
-	{
-		int i = 0;
-		char *buf = (char *)&k_large;
-
-		printf("klarge\n");
-		for (i = 0; i < sizeof(k_large); i++) {
-			printf("k_large[%d]=0x%x[%c]-%d\n", i, (char)buf[i],
-			       (char)buf[i], untochar(buf[i]));
-		}
-		printf("buffer\n");
-		for (i = 0; i < new_size; i++) {
-			printf("buff[%d]=0x%02x[%c]-%d\n", i,
-			       (char)my_new_buffer[i], (char)my_new_buffer[i],
-			       untochar(my_new_buffer[i]));
-		}
+	pl_close();
+	level = pgz_auto_level(raw, payload.size, threads, line_rate, &speed);
+	start = t_now_us();
+	payload.data = pgz_compress(raw, payload.size, level, threads,
+				    &gz_size, &payload.raw_crc);
+	elapsed = t_now_us() - start;
+	if (payload.data == NULL) {
+		APP_ERROR("Compression failed\n")
+		    free(raw);
+		return -1;
 	}
-#endif
-	s1_sendpacket((char *)&k_large, sizeof(k_large));
-	s1_sendpacket(my_new_buffer, new_size);
-	free(my_new_buffer);
-
+	raw_wire = pl_wire_size(raw, payload.size);
+	gz_wire = pl_wire_size(payload.data, gz_size);
+	free(raw);
+	COLOR_PRINT(BLUE, "Compressed %ld to %lu bytes: level %d, %d threads, "
+		    "%.1f MB/s (line %lu bytes/s)\n"
+		    "Wire: %lu bytes instead of %lu, %lu saved (%.1f%%)\n",
+		    payload.size, gz_size, level, threads,
+		    elapsed ? payload.size / (double)elapsed : 0.0, line_rate,
+		    gz_wire, raw_wire, raw_wire - gz_wire,
+		    raw_wire ? 100.0 * (raw_wire - gz_wire) / raw_wire : 0.0);
+	payload.size = gz_size;
+	payload.pos = 0;
 	return 0;
 }
 #endif
 
 /**
- * @brief print_ack_packet - Debug print of the ack packet from target
+ * @brief pl_report - tell where each file went
  *
- * @param k_ack -ack structure
+ * Addresses are offsets if the load address is not known here. With -o,
+ * they are also written as name=value lines, which "env import -t" as
+ * well as a shell can take, eg. for "bootm $blob0_addr - $blob1_addr".
+ *
+ * @param addr - address the payload is loaded to
+ *
+ * @return -success/failure
  */
-static void print_ack_packet(struct kermit_ack_nack_type *k_ack)
+static signed int pl_report(unsigned long addr)
 {
-	char *buffer = (char *)k_ack;
-	int x = 0;
-	printf("start = 0x%x\n", k_ack->start);
-	printf("length =0x%x %d\n", k_ack->length_norm,
-	       untochar(k_ack->length_norm));
-	printf("sequence_num = 0x%x[%d]\n", k_ack->sequence_number,
-	       untochar(k_ack->sequence_number));
-	printf("packet_type = 0x%x[%c]\n", k_ack->packet_type,
-	       k_ack->packet_type);
-	printf("checksum= 0x%x %d\n", k_ack->checksum,
-	       untochar(k_ack->checksum));
-	printf("eol = 0x%x\n", k_ack->eol);
-	for (x = 0; x < sizeof(struct kermit_ack_nack_type); x++)
-		printf("[%d] 0x%x [%c]\n", x, buffer[x], buffer[x]);
+	FILE *out = NULL;
+	int i;
 
+	if (addr_file != NULL) {
+		out = fopen(addr_file, "w");
+		if (out == NULL) {
+			APP_ERROR("Could not create %s\n", addr_file)
+			    perror(NULL);
+			return -1;
+		}
+	}
+	for (i = 0; i < blob_count; i++) {
+		if (blob_count > 1)
+			COLOR_PRINT(BLUE, "%s: 0x%08lX, 0x%lX bytes\n",
+				    blobs[i].name, addr + blobs[i].offset,
+				    blobs[i].size);
+		if (out != NULL)
+			fprintf(out, "blob%d_addr=0x%08lX\nblob%d_size=0x%lX\n",
+				i, addr + blobs[i].offset, i, blobs[i].size);
+	}
+	if (out != NULL)
+		fclose(out);
+	return 0;
 }
 
 /**
- * @brief kermit_ack_type - Analyse the ack packet
+ * @brief pl_env - make the payload an environment blob built from env_file
  *
- * @param seq_num - sequence number expected
+ * Each non blank line of the file which does not start with '#' is a
+ * key=value entry. The entries are laid out the way "env import" takes
+ * them for env_format:
+ * @li ENV_TEXT: "key=value\n" lines, then a NUL
+ * @li ENV_BINARY: "key=value" strings, each NUL terminated, then a NUL
+ * @li ENV_CHECKSUM: same as ENV_BINARY, after the little endian crc32 of it
  *
- * @return - result
+ * @return payload size or <0 on error
  */
-static signed int kermit_ack_type(int seq_num)
+static signed long pl_env(void)
 {
-	struct kermit_ack_nack_type k_ack;
-	int sum = 0;
-	memset((void *)&k_ack, 0, sizeof(k_ack));
-	s1_getpacket((char *)&k_ack, sizeof(k_ack));
-	sum = k_ack.length_norm + k_ack.sequence_number + k_ack.packet_type;
+	char line[ENV_LINE_MAX];
+	char sep = (env_format == ENV_TEXT) ? '\n' : 0;
+	signed long head = (env_format == ENV_CHECKSUM) ? ENV_CRC_SIZE : 0;
+	signed long size = head, room = ENV_LINE_MAX;
+	unsigned char *data, *more;
+	unsigned int crc;
+	char *entry, *eq;
+	int count = 0, line_no = 0;
+	size_t len;
+	FILE *in;
 
-	/* Check if this is a valid packet by checking checksum */
-	if (k_ack.checksum != tochar((sum + ((sum >> 6) & 0x03)) & 0x3f)) {
-#ifdef DEBUG
-		APP_ERROR("checksum mismatch\n")
-		    print_ack_packet(&k_ack);
-#endif
-		return CHK_ERROR;
-	}
-	/* message for the right seq? */
-	if (untochar(k_ack.sequence_number) != seq_num) {
-		APP_ERROR("sequence_num mismatch. expected [%d] Got %d\n",
-			  seq_num, untochar(k_ack.sequence_number))
-#ifdef DEBUG
-		    print_ack_packet(&k_ack);
-#endif
-		return SEQ_ERROR;
+	in = fopen(env_file, "r");
+	data = malloc(room);
+	if (in == NULL || data == NULL) {
+		APP_ERROR("Could not read %s\n", env_file)
+		    perror(NULL);
+		goto fail;
 	}
-	if (k_ack.packet_type == NACK_TYPE) {
-		APP_ERROR("NACKed!!\n")
-		    return NACK_TYPE;
+	while (fgets(line, sizeof(line), in) != NULL) {
+		line_no++;
+		len = strlen(line);
+		if (len && line[len - 1] != '\n' && !feof(in)) {
+			APP_ERROR("%s:%d: line too long\n", env_file, line_no)
+			    goto fail;
+		}
+		while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			line[--len] = 0;
+		if (!len || line[0] == '#')
+			continue;
+		eq = strchr(line, '=');
+		if (eq == NULL || eq == line) {
+			APP_ERROR("%s:%d: not key=value\n", env_file, line_no)
+			    goto fail;
+		}
+		/* a key given twice would fail the compare after the import */
+		for (entry = (char *)data + head; entry < (char *)data + size;
+		     entry += strcspn(entry, "\n") + 1) {
+			if (!strncmp(entry, line, eq - line + 1)) {
+				APP_ERROR("%s:%d: %.*s given twice\n", env_file,
+					  line_no, (int)(eq - line), line)
+				    goto fail;
+			}
+		}
+		if (size + (signed long)len + 2 > room) {
+			room = (size + len + 2) * 2;
+			more = realloc(data, room);
+			if (more == NULL) {
+				APP_ERROR("failed to allocate memory \n")
+				    goto fail;
+			}
+			data = more;
+		}
+		memcpy(data + size, line, len);
+		size += len;
+		data[size++] = sep;
+		count++;
 	}
-	if (k_ack.packet_type == ACK_TYPE) {
-		return ACK_TYPE;
+	fclose(in);
+	data[size++] = 0;
+	if (!count && sep == 0)
+		data[size++] = 0;
+	if (head) {
+		crc = crc32_update(0, data + head, size - head);
+		data[0] = crc & 0xFF;
+		data[1] = (crc >> 8) & 0xFF;
+		data[2] = (crc >> 16) & 0xFF;
+		data[3] = crc >> 24;
 	}
-	/* other chars */
-	APP_ERROR("Unexpected packet type\n")
-	    print_ack_packet(&k_ack);
-	return -3;
+	COLOR_PRINT(BLUE, "Environment: %d variables, %ld bytes for "
+		    "\"env import -%c\"\n", count, size, env_format);
+	payload.data = data;
+	payload.size = size;
+	payload.pos = 0;
+	return size;
+fail:
+	if (in != NULL)
+		fclose(in);
+	free(data);
+	return -1;
 }
 
 /**
- * @brief k_send_data - send a file to the target using kermit
+ * Ack round trip statistics and retransmission timer, all in micro seconds
  *
- * @param f_name - file name to send
- *
- * @return -success/failure
+ * Smoothed round trip time and its variance are estimated as TCP does
+ * (RFC 6298). Samples are taken only from packets acked without a
+ * retransmit (Karn's algorithm).
  */
-static signed int k_send_data(char *f_name, int silent_status)
-{
-	unsigned char sequence = 0;
-	unsigned int send_size = MAX_CHUNK;
-	unsigned char retry = 0;
-	int ret = 0;
-	signed long ori_size, size = 0;
-	char done_transmit = ETX_CHAR;
-	char buffer[MAX_CHUNK];
+static struct {
+	unsigned long long srtt;
+	unsigned long long rttvar;
+	/** current ack timeout */
+	unsigned long long rto;
+	unsigned long long min;
+	unsigned long long max;
+	unsigned long long total;
+	unsigned long samples;
+	unsigned long timeouts;
+	unsigned long retransmits;
+	/** link quality: bytes of noise dropped, late acks skipped */
+	unsigned long discarded;
+	unsigned long stale_acks;
+} k_rtt;
 
-	ori_size = size = f_size(f_name);
+/**
+ * @brief k_rtt_init - reset the estimator at start of a transfer
+ */
+static void k_rtt_init(void)
+{
+	memset(&k_rtt, 0, sizeof(k_rtt));
+	k_rtt.rto = K_RTO_INIT_US;
+}
 
-	if (size < 0) {
-		APP_ERROR("File Size Operation failed! File exists?\n")
-		    return size;
+/**
+ * @brief k_rtt_sample - account a measured ack round trip time
+ *
+ * @param rtt - time from packet sent to ack received
+ */
+static void k_rtt_sample(unsigned long long rtt)
+{
+	unsigned long long delta;
+
+	if (!k_rtt.samples) {
+		k_rtt.srtt = rtt;
+		k_rtt.rttvar = rtt / 2;
+		k_rtt.min = rtt;
+	} else {
+		delta = (k_rtt.srtt > rtt) ? k_rtt.srtt - rtt :
+		    rtt - k_rtt.srtt;
+		/* rttvar = 3/4 rttvar + 1/4 |srtt - rtt| */
+		k_rtt.rttvar = (3 * k_rtt.rttvar + delta) / 4;
+		/* srtt = 7/8 srtt + 1/8 rtt */
+		k_rtt.srtt = (7 * k_rtt.srtt + rtt) / 8;
 	}
-	if (f_open(f_name) != FILE_OK) {
-		APP_ERROR("File Open failed!File Exists & readable?\n")
-		    return -1;
+	if (rtt < k_rtt.min)
+		k_rtt.min = rtt;
+	if (rtt > k_rtt.max)
+		k_rtt.max = rtt;
+	k_rtt.total += rtt;
+	k_rtt.samples++;
+
+	k_rtt.rto = k_rtt.srtt + ((4 * k_rtt.rttvar > K_RTO_GRANULARITY_US) ?
+				  4 * k_rtt.rttvar : K_RTO_GRANULARITY_US);
+	if (k_rtt.rto < K_RTO_MIN_US)
+		k_rtt.rto = K_RTO_MIN_US;
+	if (k_rtt.rto > K_RTO_MAX_US)
+		k_rtt.rto = K_RTO_MAX_US;
+}
+
+/**
+ * @brief k_rtt_backoff - ack timed out, double the timeout
+ */
+static void k_rtt_backoff(void)
+{
+	k_rtt.timeouts++;
+	k_rtt.rto *= 2;
+	if (k_rtt.rto > K_RTO_MAX_US)
+		k_rtt.rto = K_RTO_MAX_US;
+}
+
+/**
+ * @brief k_rtt_summary - print the round trip statistics of a transfer
+ *
+ * @param size - bytes transferred
+ * @param elapsed - transfer time
+ */
+static void k_rtt_summary(signed long size, unsigned long long elapsed)
+{
+	if (!k_rtt.samples)
+		return;
+	COLOR_PRINT(BLUE, "\nAck RTT(ms): min %.2f avg %.2f max %.2f "
+		    "srtt %.2f rttvar %.2f final timeout %.2f\n"
+		    "Packets retransmitted: %lu (ack timeouts: %lu) - "
+		    "%.0f bytes/s\n"
+		    "Link noise: %lu bytes discarded, %lu late acks\n",
+		    k_rtt.min / 1000.0,
+		    k_rtt.total / 1000.0 / k_rtt.samples,
+		    k_rtt.max / 1000.0, k_rtt.srtt / 1000.0,
+		    k_rtt.rttvar / 1000.0, k_rtt.rto / 1000.0,
+		    k_rtt.retransmits, k_rtt.timeouts,
+		    elapsed ? size * 1000000.0 / elapsed : 0.0,
+		    k_rtt.discarded, k_rtt.stale_acks);
+}
+
+/**
+ * Link quality per window of packets, drives packet size and pacing
+ *
+ * Additive increase, multiplicative decrease: a clean window grows the
+ * packet by K_CHUNK_STEP, a window with more than one NAK, corrupted ack
+ * or timeout halves it. With -g, errors at the smallest packet size add
+ * an inter-packet gap instead, for targets whose RX FIFO overruns, and
+ * clean windows take the gap away before the packet grows again.
+ */
+static struct {
+	/** inter-packet gap */
+	unsigned long gap_us;
+	/** current window */
+	unsigned int packets;
+	unsigned int naks;
+	unsigned int chk_errors;
+	unsigned int timeouts;
+	/** over the transfer */
+	unsigned int chunk_min;
+	unsigned int chunk_max;
+	unsigned long gap_max;
+	unsigned long adjustments;
+} k_link;
+
+/**
+ * @brief k_link_init - start a transfer with full sized, unpaced packets
+ */
+static void k_link_init(void)
+{
+	memset(&k_link, 0, sizeof(k_link));
+	k_queue.chunk = MAX_CHUNK;
+	k_link.chunk_min = k_link.chunk_max = MAX_CHUNK;
+}
+
+/**
+ * @brief k_link_set_chunk - change the packet size for frames to come
+ *
+ * Frames already encoded ahead keep the size they have, see k_link_adapt.
+ *
+ * @param chunk - file bytes per packet
+ */
+static void k_link_set_chunk(unsigned int chunk)
+{
+#ifdef K_PIPELINE
+	pthread_mutex_lock(&k_queue.lock);
+	k_queue.chunk = chunk;
+	pthread_mutex_unlock(&k_queue.lock);
+#else
+	k_queue.chunk = chunk;
+#endif
+	if (chunk < k_link.chunk_min)
+		k_link.chunk_min = chunk;
+	if (chunk > k_link.chunk_max)
+		k_link.chunk_max = chunk;
+	k_link.adjustments++;
+}
+
+/**
+ * @brief k_link_adapt - account a packet, adapt at the end of a window
+ *
+ * Up to K_QUEUE_DEPTH frames are encoded ahead: once the size is lowered,
+ * those still at a larger size are not accounted, else their errors would
+ * halve the size again for what the last halving already answered.
+ *
+ * @param result - ACK_TYPE, NACK_TYPE, TMO_ERROR or SEQ_ERROR of an ack
+ * @param data_size - file bytes in the packet
+ */
+static void k_link_adapt(int result, unsigned int data_size)
+{
+	unsigned int errors;
+	unsigned int chunk = k_queue.chunk;
+
+	if (data_size > chunk) {
+		/* they all come right after the change, nothing else counted */
+		k_link.chk_errors = 0;
+		return;
 	}
-	if (!silent_status)
-		f_status_init(ori_size, NORMAL_PRINT);
-	else
-		COLOR_PRINT(BLUE, "Transfer start (%ld bytes)\n", ori_size);
+	switch (result) {
+	case ACK_TYPE:
+		k_link.packets++;
+		break;
+	case NACK_TYPE:
+	case SEQ_ERROR:
+		k_link.naks++;
+		break;
+	case TMO_ERROR:
+		k_link.timeouts++;
+		break;
+	}
+	if (k_link.packets < K_WINDOW)
+		return;
+	errors = k_link.naks + k_link.chk_errors + k_link.timeouts;
+	if (!errors) {
+		if (k_link.gap_us) {
+			k_link.gap_us /= 2;
+			if (k_link.gap_us < K_GAP_STEP_US)
+				k_link.gap_us = 0;
+			k_link.adjustments++;
+		} else if (chunk < MAX_CHUNK) {
+			chunk += K_CHUNK_STEP;
+			k_link_set_chunk((chunk > MAX_CHUNK) ? MAX_CHUNK : chunk);
+		}
+	} else if (errors > 1) {
+		if (chunk > K_CHUNK_MIN) {
+			chunk /= 2;
+			k_link_set_chunk((chunk < K_CHUNK_MIN) ?
+					 K_CHUNK_MIN : chunk);
+		} else if (pacing && k_link.gap_us < K_GAP_MAX_US) {
+			k_link.gap_us = (k_link.gap_us) ?
+			    k_link.gap_us * 2 : K_GAP_STEP_US;
+			if (k_link.gap_us > K_GAP_MAX_US)
+				k_link.gap_us = K_GAP_MAX_US;
+			if (k_link.gap_us > k_link.gap_max)
+				k_link.gap_max = k_link.gap_us;
+			k_link.adjustments++;
+		}
+	}
+	k_link.packets = k_link.naks = k_link.chk_errors = k_link.timeouts = 0;
+}
+
+/**
+ * @brief k_link_summary - print how packet size and pacing were adapted
+ */
+static void k_link_summary(void)
+{
+	if (!k_link.adjustments)
+		return;
+	COLOR_PRINT(BLUE, "Packet size: %u..%u bytes, final %u - "
+		    "max inter-packet gap %.2fms, final %.2fms\n",
+		    k_link.chunk_min, k_link.chunk_max, k_queue.chunk,
+		    k_link.gap_max / 1000.0, k_link.gap_us / 1000.0);
+}
+
+/**
+ * @brief s1_getpacket - get a packet from the target
+ * @param packet  - the buffer to which data is stored
+ * @param size  the size of the packet
+ * @param timeout_ms - time to wait for it
+ *
+ * @return bytes read, or SERIAL_TIMEDOUT/SERIAL_FAILED
+ */
+static signed int s1_getpacket(char *packet, int size, unsigned int timeout_ms)
+{
+#ifdef CONSOLE_TEST
+	int ret = size;
+
+	while (size) {
+		*packet = console_getc();
+		packet++;
+		size--;
+	}
+	return ret;
+#else
+	return s_read_timeout((unsigned char *)packet, size, timeout_ms);
+#endif
+}
+
+/**
+ * @brief s1_sendpacket - send a data packet to the target
+ *
+ * @param packet - buffer containing the data buffer
+ * @param size - size of the buffer
+ */
+static void s1_sendpacket(char *packet, int size)
+{
+#ifdef CONSOLE_TEST
 	while (size) {
-		send_size = (size > MAX_CHUNK) ? MAX_CHUNK : size;
-		send_size = f_read((unsigned char *)buffer, send_size);
-		if (send_size < 0) {
-			APP_ERROR("Oops.. file read failed!\n")
-			    break;
+		console_putc(*packet);
+		packet++;
+		size--;
+	}
+#else
+	s_write((unsigned char *)packet, size);
+#endif
+}
+
+/**
+ * @brief k_build_data_packet_small - encode a small data packet
+ *
+ * Kermit protocol allows for two types of data packets ->small and large.
+ * This function builds a small packet for the target. the identification of a
+ * small packet is if length_normal ==0 in which case length_hi and lo are
+ * used from k_large structure.
+ *
+ * @param frame - frame to build the packet into
+ * @param buffer - buffer to send
+ * @param size -size of the buffer to send
+ * @param sequence - sequence number of the transmission.
+ */
+static void k_build_data_packet_small(struct k_frame *frame,
+				      unsigned char *buffer,
+				      unsigned int size,
+				      unsigned char sequence)
+{
+	struct kermit_data_header_small k_small;
+	unsigned int sum = 0;
+	unsigned int new_size = 0;
+	/* Encoded data goes right after the header */
+	unsigned char *my_new_buffer = frame->buf + sizeof(k_small);
+
+	memset(&k_small, 0, sizeof(struct kermit_data_header_small));
+	k_small.start = START_CHAR;
+	k_small.sequence_number = tochar(sequence);
+	k_small.packet_type = DATA_TYPE;
+	/* handle kermit escape character in buffer */
+	new_size = k_encode(my_new_buffer, buffer, size, &sum);
+	/* Add to cover for sequence, packet type and checksum */
+	k_small.length_normal = tochar((new_size) + 3);
+	sum +=
+	    k_small.length_normal + k_small.sequence_number +
+	    k_small.packet_type;
+	/* Store the checksum for the packet */
+	*(my_new_buffer + new_size) =
+	    tochar((sum + ((sum >> 6) & 0x03)) & 0x3f);
+	new_size++;
+	/* Add end character */
+	*(my_new_buffer + new_size) = END_CHAR;
+	new_size++;
+	memcpy(frame->buf, &k_small, sizeof(k_small));
+	frame->len = sizeof(k_small) + new_size;
+#ifdef DEBUG
+	{
+		int i = 0;
+
+		printf("ksmall+buffer\n");
+		for (i = 0; i < frame->len; i++) {
+			printf("buff[%d]=0x%02x[%c]-%d\n", i,
+			       frame->buf[i], frame->buf[i],
+			       untochar(frame->buf[i]));
 		}
-		retry = 0;
-		/* we will retry packets to an extent! */
-		do {
+	}
+#endif
+}
+
 #ifdef LARGE_PACKETS_ENABLE
-			if (send_size < 95)
-				ret = k_send_data_packet_small((unsigned char *)
-							       buffer,
-							       send_size,
-							       sequence);
-			else
-				ret = k_send_data_packet_large((unsigned char *)
-							       buffer,
-							       send_size,
-							       sequence);
+/**
+ * @brief k_build_data_packet_large - encode a large data packet
+ *
+ * Kermit protocol allows for two types of data packets ->small and large.
+ * This function builds a large packet for the target. the identification of a
+ * large packet is if length_normal ==0 in which case length_hi and lo are
+ * used from k_large structure.
+ *
+ * @param frame - frame to build the packet into
+ * @param buffer - buffer to send
+ * @param size -size of the buffer to send
+ * @param sequence - sequence number of the transmission.
+ */
+static void k_build_data_packet_large(struct k_frame *frame,
+				      unsigned char *buffer,
+				      unsigned int size,
+				      unsigned char sequence)
+{
+	struct kermit_data_header_large k_large;
+	unsigned int sum = 0;
+	unsigned int sum_pkt = 0;
+	unsigned int new_size = 0;
+	/* Encoded data goes right after the header */
+	unsigned char *my_new_buffer = frame->buf + sizeof(k_large);
+
+	memset(&k_large, 0, sizeof(struct kermit_data_header_large));
+	k_large.start = START_CHAR;
+	k_large.sequence_number = tochar(sequence);
+	k_large.packet_type = DATA_TYPE;
+	/* handle kermit escape character in buffer */
+	new_size = k_encode(my_new_buffer, buffer, size, &sum);
+	/* Add to cover checksum */
+	new_size += 1;
+	k_large.length_normal = tochar(0x0);
+	k_large.length_hi = new_size / 95;
+	k_large.length_lo = new_size - (k_large.length_hi * 95);
+	k_large.length_hi = tochar(k_large.length_hi);
+	k_large.length_lo = tochar(k_large.length_lo);
+	sum_pkt =
+	    k_large.length_normal + k_large.sequence_number +
+	    k_large.packet_type + k_large.length_lo + k_large.length_hi;
+	k_large.header_checksum =
+	    tochar((sum_pkt + ((sum_pkt >> 6) & 0x03)) & 0x3f);
+	new_size -= 1;
+	sum += sum_pkt + k_large.header_checksum;
+	/* Store the checksum for the packet */
+	*(my_new_buffer + new_size) =
+	    tochar((sum + ((sum >> 6) & 0x03)) & 0x3f);
+	new_size++;
+	/* Add end character */
+	*(my_new_buffer + new_size) = END_CHAR;
+	new_size++;
+	memcpy(frame->buf, &k_large, sizeof(k_large));
+	frame->len = sizeof(k_large) + new_size;
+#ifdef DEBUG
+	{
+		int i = 0;
+
+		printf("klarge+buffer\n");
+		for (i = 0; i < frame->len; i++) {
+			printf("buff[%d]=0x%02x[%c]-%d\n", i,
+			       frame->buf[i], frame->buf[i],
+			       untochar(frame->buf[i]));
+		}
+	}
+#endif
+}
+#endif
+
+/**
+ * @brief k_produce_frame - read and encode the next packet of the file
+ *
+ * @param frame - frame to fill up
+ * @param chunk - file bytes to put in the packet at most
+ *
+ * @return bytes of file data in the frame, 0 at end of file, <0 on error
+ */
+static signed int k_produce_frame(struct k_frame *frame, unsigned int chunk)
+{
+	unsigned char buffer[MAX_CHUNK];
+	signed int send_size;
+
+	if (!k_queue.remaining)
+		return 0;
+	send_size = (k_queue.remaining > chunk) ? chunk : k_queue.remaining;
+	send_size = pl_read(buffer, send_size);
+	if (send_size <= 0) {
+		APP_ERROR("Oops.. file read failed!\n")
+		    return -1;
+	}
+#ifdef LARGE_PACKETS_ENABLE
+	if (send_size < 95)
+		k_build_data_packet_small(frame, buffer, send_size,
+					  k_queue.sequence);
+	else
+		k_build_data_packet_large(frame, buffer, send_size,
+					  k_queue.sequence);
 #else
-			ret = k_send_data_packet_small((unsigned char *)
-						       buffer,
-						       send_size, sequence);
+	k_build_data_packet_small(frame, buffer, send_size, k_queue.sequence);
 #endif
-			if (ret < 0) {
-				APP_ERROR("Failedin send\n")
-				    return ret;
+	frame->sequence = k_queue.sequence;
+	frame->data_size = send_size;
+	k_queue.sequence++;
+	/* Roll over sequence number */
+	if (k_queue.sequence > 0x7F)
+		k_queue.sequence = 0;
+	k_queue.remaining -= send_size;
+	return send_size;
+}
+
+#ifdef K_PIPELINE
+/**
+ * @brief k_producer - thread reading and encoding packets ahead of the
+ * transmitter
+ *
+ * @param arg - unused
+ *
+ * @return NULL
+ */
+static void *k_producer(void *arg)
+{
+	signed int ret;
+	int stop;
+	unsigned int chunk;
+	struct k_frame *frame;
+
+	do {
+		pthread_mutex_lock(&k_queue.lock);
+		while (k_queue.tail - k_queue.head == K_QUEUE_DEPTH &&
+		       !k_queue.stop)
+			pthread_cond_wait(&k_queue.not_full, &k_queue.lock);
+		stop = k_queue.stop;
+		chunk = k_queue.chunk;
+		pthread_mutex_unlock(&k_queue.lock);
+		if (stop)
+			break;
+		/* only the producer touches free slots */
+		frame = &k_queue.frames[k_queue.tail % K_QUEUE_DEPTH];
+		ret = k_produce_frame(frame, chunk);
+		pthread_mutex_lock(&k_queue.lock);
+		if (ret > 0)
+			k_queue.tail++;
+		else
+			k_queue.status = ret ? ret : 1;
+		pthread_cond_signal(&k_queue.not_empty);
+		pthread_mutex_unlock(&k_queue.lock);
+	} while (ret > 0);
+	return NULL;
+}
+#endif
+
+/**
+ * @brief k_next_frame - get the next encoded frame to transmit
+ *
+ * @return frame, or NULL at end of file or on error (see k_queue.status)
+ */
+static struct k_frame *k_next_frame(void)
+{
+#ifdef K_PIPELINE
+	struct k_frame *frame = NULL;
+
+	pthread_mutex_lock(&k_queue.lock);
+	while (k_queue.tail == k_queue.head && !k_queue.status)
+		pthread_cond_wait(&k_queue.not_empty, &k_queue.lock);
+	if (k_queue.tail != k_queue.head)
+		frame = &k_queue.frames[k_queue.head % K_QUEUE_DEPTH];
+	pthread_mutex_unlock(&k_queue.lock);
+	return frame;
+#else
+	signed int ret;
+
+	/* No threads: encode just in time */
+	ret = k_produce_frame(&k_queue.frames[0], k_queue.chunk);
+	if (ret <= 0) {
+		k_queue.status = ret ? ret : 1;
+		return NULL;
+	}
+	return &k_queue.frames[0];
+#endif
+}
+
+/**
+ * @brief k_release_frame - the frame at the head of queue was acked
+ */
+static void k_release_frame(void)
+{
+#ifdef K_PIPELINE
+	pthread_mutex_lock(&k_queue.lock);
+	k_queue.head++;
+	pthread_cond_signal(&k_queue.not_full);
+	pthread_mutex_unlock(&k_queue.lock);
+#endif
+}
+
+/**
+ * @brief k_queue_start - start producing frames for a file
+ *
+ * @param offset - file offset to start at
+ * @param size - size of the open file
+ *
+ * @return success/fail
+ */
+static signed int k_queue_start(signed long offset, signed long size)
+{
+	if (pl_seek(offset)) {
+		APP_ERROR("File seek to %ld failed\n", offset)
+		    return -1;
+	}
+	k_queue.remaining = size - offset;
+	k_queue.sequence = 0;
+	k_queue.head = k_queue.tail = 0;
+	k_queue.status = 0;
+	k_queue.stop = 0;
+#ifdef K_PIPELINE
+	pthread_mutex_init(&k_queue.lock, NULL);
+	pthread_cond_init(&k_queue.not_empty, NULL);
+	pthread_cond_init(&k_queue.not_full, NULL);
+	if (pthread_create(&k_queue.producer, NULL, k_producer, NULL)) {
+		APP_ERROR("failed to start the producer thread\n")
+		    return -1;
+	}
+#endif
+	return 0;
+}
+
+/**
+ * @brief k_queue_stop - stop the producer, drop any frames not sent
+ */
+static void k_queue_stop(void)
+{
+#ifdef K_PIPELINE
+	pthread_mutex_lock(&k_queue.lock);
+	k_queue.stop = 1;
+	pthread_cond_signal(&k_queue.not_full);
+	pthread_mutex_unlock(&k_queue.lock);
+	pthread_join(k_queue.producer, NULL);
+	pthread_cond_destroy(&k_queue.not_full);
+	pthread_cond_destroy(&k_queue.not_empty);
+	pthread_mutex_destroy(&k_queue.lock);
+#endif
+}
+
+/**
+ * @brief print_ack_packet - Debug print of the ack packet from target
+ *
+ * @param k_ack -ack structure
+ */
+static void print_ack_packet(struct kermit_ack_nack_type *k_ack)
+{
+	char *buffer = (char *)k_ack;
+	int x = 0;
+	printf("start = 0x%x\n", k_ack->start);
+	printf("length =0x%x %d\n", k_ack->length_norm,
+	       untochar(k_ack->length_norm));
+	printf("sequence_num = 0x%x[%d]\n", k_ack->sequence_number,
+	       untochar(k_ack->sequence_number));
+	printf("packet_type = 0x%x[%c]\n", k_ack->packet_type,
+	       k_ack->packet_type);
+	printf("checksum= 0x%x %d\n", k_ack->checksum,
+	       untochar(k_ack->checksum));
+	printf("eol = 0x%x\n", k_ack->eol);
+	for (x = 0; x < sizeof(struct kermit_ack_nack_type); x++)
+		printf("[%d] 0x%x [%c]\n", x, buffer[x], buffer[x]);
+
+}
+
+/**
+ * @brief kermit_ack_type - Analyse the ack packet
+ *
+ * The ack is picked out of the incoming stream rather than read as fixed
+ * bytes: noise before START_CHAR and packets with a bad length or
+ * checksum are thrown away and the parser resynchronises on the next
+ * START_CHAR. A late ack of the previous packet, left over from a
+ * retransmit, is skipped. No more is read than an ack needs.
+ *
+ * @param seq_num - sequence number expected
+ *
+ * @return - result
+ */
+static signed int kermit_ack_type(int seq_num)
+{
+	struct kermit_ack_nack_type k_ack;
+	unsigned char *win = (unsigned char *)&k_ack;
+	unsigned int have = 0, skip;
+	unsigned long long deadline = t_now_us() + k_rtt.rto, now;
+	int stale_seq = (seq_num) ? seq_num - 1 : 0x7F;
+	int sum = 0;
+	int ret;
+
+	memset((void *)&k_ack, 0, sizeof(k_ack));
+	while (1) {
+		/* fill up an ack worth of bytes from the stream */
+		while (have < sizeof(k_ack)) {
+			now = t_now_us();
+			if (now >= deadline)
+				ret = SERIAL_TIMEDOUT;
+			else
+				ret = s1_getpacket((char *)win + have,
+						   sizeof(k_ack) - have,
+						   (deadline - now + 999) /
+						   1000);
+			if (ret == SERIAL_FAILED)
+				return -1;
+			if (ret <= 0) {
+				k_rtt.discarded += have;
+				return TMO_ERROR;
 			}
-			ret = kermit_ack_type(sequence);
+			have += ret;
+		}
+		/* resynchronise on the start marker */
+		for (skip = 0; skip < have && win[skip] != START_CHAR; skip++)
+			;
+		if (skip) {
+			k_rtt.discarded += skip;
+			have -= skip;
+			memmove(win, win + skip, have);
+			continue;
+		}
+		sum = k_ack.length_norm + k_ack.sequence_number +
+		    k_ack.packet_type;
+
+		/* Check if this is a valid packet by length and checksum */
+		if (k_ack.length_norm != tochar(3) ||
+		    k_ack.checksum !=
+		    tochar((sum + ((sum >> 6) & 0x03)) & 0x3f)) {
+#ifdef DEBUG
+			APP_ERROR("checksum mismatch\n")
+			    print_ack_packet(&k_ack);
+#endif
+			/* not an ack, look for the next start marker */
+			k_rtt.discarded++;
+			k_link.chk_errors++;
+			have--;
+			memmove(win, win + 1, have);
+			continue;
+		}
+		/* ack of the packet before, ours may still come */
+		if (k_ack.packet_type == ACK_TYPE &&
+		    untochar(k_ack.sequence_number) == stale_seq) {
+			k_rtt.stale_acks++;
+			have = 0;
+			continue;
+		}
+		break;
+	}
+	/* message for the right seq? */
+	if (untochar(k_ack.sequence_number) != seq_num) {
+		APP_ERROR("sequence_num mismatch. expected [%d] Got %d\n",
+			  seq_num, untochar(k_ack.sequence_number))
+#ifdef DEBUG
+		    print_ack_packet(&k_ack);
+#endif
+		return SEQ_ERROR;
+	}
+	if (k_ack.packet_type == NACK_TYPE) {
+		APP_ERROR("NACKed!!\n")
+		    return NACK_TYPE;
+	}
+	if (k_ack.packet_type == ACK_TYPE) {
+		return ACK_TYPE;
+	}
+	/* other chars */
+	APP_ERROR("Unexpected packet type\n")
+	    print_ack_packet(&k_ack);
+	return -3;
+}
+
+/**
+ * @brief k_send_data - send the open file to the target using kermit
+ *
+ * Packets are read and encoded ahead by the producer into a queue of
+ * frames, the loop here only puts them on the wire and handles the acks.
+ * A retransmit sends the same, already encoded, frame again. Every ack
+ * feeds k_link_adapt, which sizes the packets still to be encoded.
+ *
+ * @param offset - file offset to start at
+ * @param ori_size - file size
+ * @param silent_status - no progress display
+ * @param acked - updated with the file offset acked by the target
+ *
+ * @return -success/failure
+ */
+static signed int k_send_data(signed long offset, signed long ori_size,
+			      int silent_status, signed long *acked)
+{
+	unsigned char retry = 0;
+	int ret = 0;
+	signed long size = ori_size - offset;
+	char done_transmit = ETX_CHAR;
+	struct k_frame *frame;
+	unsigned long long start, sent;
+
+	*acked = offset;
+	k_link_init();
+	if (k_queue_start(offset, ori_size))
+		return -1;
+	k_rtt_init();
+	start = t_now_us();
+	while ((frame = k_next_frame()) != NULL) {
+		retry = 0;
+		/* we will retry packets to an extent! */
+		do {
+			if (k_link.gap_us)
+				t_sleep_us(k_link.gap_us);
+			s1_sendpacket((char *)frame->buf, frame->len);
+			sent = t_now_us();
+			ret = kermit_ack_type(frame->sequence);
 			if (ret < 0) {
 				APP_ERROR("Failedin ack %d\n", ret)
-				    return ret;
+				    goto out;
+			}
+			k_link_adapt(ret, frame->data_size);
+			if (ret == ACK_TYPE) {
+				if (!retry)
+					k_rtt_sample(t_now_us() - sent);
+				break;
 			}
-			if (ret != ACK_TYPE) {
-				retry++;
+			if (ret == TMO_ERROR) {
+				k_rtt_backoff();
+				/* drop any partial or late ack */
+				s_flush(NULL, NULL);
 			}
-		} while ((ret != ACK_TYPE) && (retry < RETRY_MAX));
+			retry++;
+			if (retry < RETRY_MAX)
+				k_rtt.retransmits++;
+		} while (retry < RETRY_MAX);
 		if (retry == RETRY_MAX) {
 			APP_ERROR("Failed after %d retries in sequence %d - "
 				  "success send = %ld bytes\n",
-				  RETRY_MAX, sequence, (ori_size - size))
-			    return -1;
+				  RETRY_MAX, frame->sequence,
+				  (ori_size - size))
+			    ret = -1;
+			goto out;
 		}
-		sequence++;
-		/* Roll over sequence number */
-		if (sequence > 0x7F)
-			sequence = 0;
-
-		size -= send_size;
+		size -= frame->data_size;
+		*acked = ori_size - size;
+		k_release_frame();
 		if (!silent_status)
 			f_status_show(ori_size - size);
 	}
+	if (k_queue.status < 0) {
+		ret = k_queue.status;
+		goto out;
+	}
+	ret = 0;
 	/* Send the completion char */
 	s1_sendpacket(&done_transmit, 1);
-	if (f_close() != FILE_OK) {
-		APP_ERROR("File Close failed\n")
+out:
+	k_queue_stop();
+	k_rtt_summary(*acked - offset, t_now_us() - start);
+	k_link_summary();
+	return ret;
+}
+
+/**
+ * @brief k_switch_baud - follow U-Boot to a new rate and confirm it
+ *
+ * U-Boot announces the switch at the old rate, changes its own rate and
+ * then waits for the confirmation character at the new rate.
+ *
+ * @param baud - new rate
+ * @param confirm - character U-Boot waits for
+ *
+ * @return -success/failure
+ */
+static signed int k_switch_baud(unsigned long baud, char confirm)
+{
+	/* the rest of the announcement line */
+	if (con_expect_timeout("\n", NULL, 0, CON_TIMEOUT_MS))
+		return -1;
+	if (s_configure(baud, NOPARITY, ONE_STOP_BIT, 8) != SERIAL_OK) {
+		APP_ERROR("Failed to switch the port to %lu bps\n", baud)
+		    return -1;
+	}
+	t_sleep_ms(BAUD_SETTLE_MS);
+	/* garbage received while the two ends were at different rates */
+	s_flush(NULL, NULL);
+	if (s_putc(confirm) < 0) {
+		APP_ERROR("Failed to confirm %lu bps\n", baud)
+		    return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief k_loadb_end - get back to the console rate after loadb
+ *
+ * Once loadb has received ETX and reported the size, it switches back to
+ * the console rate if it was started with a baudrate.
+ *
+ * @return -success/failure
+ */
+static signed int k_loadb_end(void)
+{
+	if (!load_baud)
+		return 0;
+	if (con_expect_timeout(LOADB_SWITCH_BACK, NULL, 0, CON_TIMEOUT_MS) ||
+	    k_switch_baud(CONSOLE_BAUD, ESC_CHAR)) {
+		APP_ERROR("loadb did not switch back to %d bps\n",
+			  CONSOLE_BAUD)
+		    return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief k_loadb - start a kermit download on the target
+ *
+ * With a load baudrate, loadb is asked to switch to it for the transfer.
+ *
+ * @param addr - address to load to
+ *
+ * @return -success/failure
+ */
+static signed int k_loadb(unsigned long addr)
+{
+	char cmd[CMD_SIZE];
+
+	if (load_baud)
+		sprintf(cmd, "loadb 0x%08lX %lu", addr, load_baud);
+	else
+		sprintf(cmd, "loadb 0x%08lX", addr);
+	if (con_send_cmd(cmd) != SERIAL_OK) {
+		APP_ERROR("Failed to send command '%s'\n", cmd)
+		    return -1;
+	}
+	if (load_baud &&
+	    (con_expect_timeout(LOADB_SWITCH, NULL, 0, CON_TIMEOUT_MS) ||
+	     k_switch_baud(load_baud, '\r'))) {
+		APP_ERROR("loadb did not switch to %lu bps\n", load_baud)
+		    return -1;
+	}
+	/* Wait for the end of loadb's "Ready for binary" line */
+	if (con_expect_timeout(LOADB_READY, NULL, 0, CON_TIMEOUT_MS) ||
+	    con_expect_timeout("\n", NULL, 0, CON_TIMEOUT_MS)) {
+		APP_ERROR("loadb did not start\n")
+		    return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief k_abort - get the target out of an interrupted download
+ *
+ * A control character aborts the packet U-Boot is receiving, ETX out of
+ * packet ends loadb. Wait for the prompt after that, sending the sequence
+ * again if it does not come: a lost ETX leaves loadb waiting, and at the
+ * prompt the control character just gets a new prompt.
+ *
+ * @return -success/failure
+ */
+static signed int k_abort(void)
+{
+	char abort_seq[] = { ETX_CHAR, ETX_CHAR, ETX_CHAR };
+	int tries = 0;
+	signed int ret;
+
+	s1_sendpacket(abort_seq, sizeof(abort_seq));
+	if (k_loadb_end())
+		return -1;
+	while ((ret = con_expect_timeout(prompt, NULL, 0, CON_TIMEOUT_MS)) ==
+	       SERIAL_TIMEDOUT && ++tries < ABORT_TRIES)
+		s1_sendpacket(abort_seq, sizeof(abort_seq));
+	if (ret) {
+		APP_ERROR("No prompt '%s' after abort\n", prompt)
+		    return -1;
+	}
+	s_flush(NULL, NULL);
+	return 0;
+}
+
+/**
+ * @brief k_verify - check the loaded data with U-Boot's crc32 command
+ *
+ * @param addr - load address
+ * @param size - size of the data
+ * @param crc - crc32 the data should have
+ *
+ * @return -success/failure
+ */
+static signed int k_verify(unsigned long addr, signed long size,
+			   unsigned int crc)
+{
+	char cmd[CMD_SIZE];
+	char response[RESPONSE_SIZE];
+	unsigned int target_crc;
+	char *result;
+
+	sprintf(cmd, "crc32 0x%08lX 0x%lX", addr, size);
+	if (con_send_cmd(cmd) != SERIAL_OK ||
+	    con_expect_timeout(prompt, response, sizeof(response),
+			       CON_SLOW_TIMEOUT_MS)) {
+		APP_ERROR("Failed to run '%s'\n", cmd)
+		    return -1;
+	}
+	/* "CRC32 for 80000000 ... 8000ffff ==> 1234abcd" */
+	result = strstr(response, "==>");
+	if (result == NULL || sscanf(result + 3, "%x", &target_crc) != 1) {
+		APP_ERROR("Unexpected crc32 output:\n%s\n", response)
+		    return -1;
+	}
+	if (target_crc != crc) {
+		APP_ERROR("CRC mismatch: target 0x%08x, file 0x%08x\n",
+			  target_crc, crc)
+		    return -1;
+	}
+	COLOR_PRINT(GREEN, "\nCRC32 0x%08x verified on target\n", crc);
+	return 0;
+}
+
+/**
+ * @brief k_unzip - uncompress the payload on the target
+ *
+ * @param src - where the gzip was loaded
+ * @param dst - where it goes
+ * @param size - size uncompressed
+ *
+ * @return -success/failure
+ */
+static signed int k_unzip(unsigned long src, unsigned long dst,
+			  signed long size)
+{
+	char cmd[CMD_SIZE];
+	char response[RESPONSE_SIZE];
+
+	sprintf(cmd, "unzip 0x%08lX 0x%08lX 0x%lX", src, dst, size);
+	if (con_send_cmd(cmd) != SERIAL_OK ||
+	    con_expect_timeout(prompt, response, sizeof(response),
+			       CON_SLOW_TIMEOUT_MS)) {
+		APP_ERROR("Failed to run '%s'\n", cmd)
+		    return -1;
+	}
+	if (strstr(response, UNZIP_DONE) == NULL) {
+		APP_ERROR("'%s' failed:\n%s\n", cmd, response)
+		    return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief k_env_run - run an environment command and check what it says
+ *
+ * The failure messages are waited for along with the prompt, as
+ * "## Error: bad CRC, import failed" or "Writing to MMC(0)... FAILED",
+ * so values or help text with such words in them do not count.
+ *
+ * @param cmd - command
+ * @param timeout_ms - time the command gets to bring the prompt back
+ *
+ * @return -success/failure
+ */
+static signed int k_env_run(const char *cmd, unsigned int timeout_ms)
+{
+	char response[RESPONSE_SIZE];
+	struct con_match *m;
+	signed int ret;
+
+	m = con_match_new();
+	if (m == NULL || con_match_add(m, prompt, 0) ||
+	    con_match_add(m, ENV_ERROR, 1) ||
+	    con_match_add(m, ENV_IMPORT_FAILED, 2) ||
+	    con_match_add(m, ENV_FAILED, 3) ||
+	    con_match_add(m, ENV_SAVE_FAILED, 4) ||
+	    con_match_add(m, ENV_SAVE_FAILED_LC, 5)) {
+		con_match_free(m);
+		return -1;
+	}
+	if (con_send_cmd(cmd) != SERIAL_OK) {
+		con_match_free(m);
+		APP_ERROR("Failed to send command '%s'\n", cmd)
+		    return -1;
+	}
+	ret = con_match_wait(m, response, sizeof(response), timeout_ms);
+	con_match_free(m);
+	if (ret < 0) {
+		APP_ERROR("Failed to run '%s'\n", cmd)
+		    return -1;
+	}
+	if (ret) {
+		APP_ERROR("'%s' failed:\n%s\n", cmd, response)
+		/* the rest of the message, back to the prompt */
+		con_expect_timeout(prompt, NULL, 0, CON_TIMEOUT_MS);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief k_env_import - import the environment blob loaded at load_addr
+ *
+ * After the import (and saveenv if asked for), a single printenv is run
+ * and each entry of the blob must be in its output as a line of its own.
+ *
+ * @param size - size of the blob
+ *
+ * @return -success/failure
+ */
+static signed int k_env_import(signed long size)
+{
+	char sep = (env_format == ENV_TEXT) ? '\n' : 0;
+	char *entry, *end, *found, *response;
+	char cmd[CMD_SIZE];
+	size_t len;
+	int count = 0, ret = 0;
+
+	sprintf(cmd, "env import -%c 0x%08lX 0x%lX", env_format, load_addr,
+		size);
+	if (k_env_run(cmd, CON_TIMEOUT_MS) ||
+	    (env_save && k_env_run("saveenv", CON_SLOW_TIMEOUT_MS)))
+		return -1;
+	response = malloc(ENV_PRINT_SIZE);
+	if (response == NULL) {
+		APP_ERROR("failed to allocate memory \n")
+		    return -1;
+	}
+	if (con_send_cmd("printenv") != SERIAL_OK ||
+	    con_expect_timeout(prompt, response, ENV_PRINT_SIZE,
+			       CON_SLOW_TIMEOUT_MS)) {
+		APP_ERROR("Failed to run 'printenv'\n")
+		    ret = -1;
+		goto out;
+	}
+	entry = (char *)payload.data +
+	    ((env_format == ENV_CHECKSUM) ? ENV_CRC_SIZE : 0);
+	for (; *entry; entry = end + 1, count++) {
+		end = memchr(entry, sep, payload.data + size -
+			     (unsigned char *)entry);
+		len = end - entry;
+		for (found = response; (found = strchr(found, '\n')) != NULL;
+		     found++)
+			if (!strncmp(found + 1, entry, len) &&
+			    (found[len + 1] == '\r' || found[len + 1] == '\n'))
+				break;
+		if (found == NULL) {
+			APP_ERROR("%.*s is not set on the target\n", (int)len,
+				  entry)
+			    ret = -1;
+		}
+	}
+	if (!ret)
+		COLOR_PRINT(GREEN, "%d variables imported%s and verified\n",
+			    count, env_save ? ", saved" : "");
+out:
+	free(response);
+	return ret;
+}
+
+/**
+ * @brief k_transfer - loadb a part of the payload, resuming on failure
+ *
+ * @param start - payload offset to start at, loaded at load_addr + start
+ * @param end - payload offset to stop at
+ * @param silent_status - no progress display
+ *
+ * @return -success/failure, back at the prompt on success
+ */
+static signed int k_transfer(signed long start, signed long end,
+			     int silent_status)
+{
+	signed long offset = start;
+	int resumes = 0;
+	int ret;
+
+	while (1) {
+		ret = k_loadb(load_addr + offset);
+		if (ret)
+			return ret;
+		ret = k_send_data(offset, end, silent_status, &offset);
+		if (!ret)
+			break;
+		if (resumes == resume_max || k_abort())
+			return ret;
+		resumes++;
+		COLOR_PRINT(BLUE, "\nResuming (%d of %d) at offset 0x%lX\n",
+			    resumes, resume_max, offset);
+	}
+	/* loadb reports the size and we are back at the prompt */
+	ret = k_loadb_end();
+	if (!ret)
+		ret = con_expect_timeout(prompt, NULL, 0, CON_TIMEOUT_MS);
+	return ret;
+}
+
+/**
+ * @brief k_delta_query - crc32 of a batch of blocks on the target
+ *
+ * The crc32 commands go on one line separated with ';', so a batch costs
+ * a single round trip.
+ *
+ * @param first - first block
+ * @param count - blocks in the batch
+ * @param size - size of the payload
+ * @param crc - gets the crc32 of each block
+ *
+ * @return -success/failure
+ */
+static signed int k_delta_query(unsigned long first, unsigned long count,
+				signed long size, unsigned int *crc)
+{
+	char cmd[DELTA_LINE_MAX + CMD_SIZE];
+	char response[DELTA_RESPONSE_SIZE];
+	unsigned long n, len, off;
+	char *result = response;
+	int pos = 0;
+
+	for (n = first; n < first + count; n++) {
+		off = n * delta_block;
+		len = (size - off > delta_block) ? delta_block : size - off;
+		pos += sprintf(cmd + pos, "%scrc32 0x%08lX 0x%lX",
+			       (n == first) ? "" : "; ", load_addr + off, len);
+	}
+	if (con_send_cmd(cmd) != SERIAL_OK ||
+	    con_expect_timeout(prompt, response, sizeof(response),
+			       CON_SLOW_TIMEOUT_MS)) {
+		APP_ERROR("Failed to run '%s'\n", cmd)
+		    return -1;
+	}
+	for (n = 0; n < count; n++) {
+		result = strstr(result, "==>");
+		if (result == NULL || sscanf(result + 3, "%x", &crc[n]) != 1) {
+			APP_ERROR("Unexpected crc32 output:\n%s\n", response)
+			    return -1;
+		}
+		result += 3;
 	}
-	if (silent_status)
-		COLOR_PRINT(GREEN, "Transfer complete\n");
 	return 0;
 }
 
+/**
+ * @brief k_delta - send only the blocks which differ on the target
+ *
+ * The payload is cut in delta_block sized blocks. The crc32 of each is
+ * compared with the one U-Boot computes over the same region at the load
+ * address (which read_cmd may fill with the old image first), and runs of
+ * differing blocks are loaded at their offset. The caller verifies the
+ * whole payload after that.
+ *
+ * @param size - size of the payload
+ * @param silent_status - no progress display
+ *
+ * @return -success/failure
+ */
+static signed int k_delta(signed long size, int silent_status)
+{
+	unsigned char buffer[READ_SIZE];
+	unsigned long blocks = (size + delta_block - 1) / delta_block;
+	unsigned long n, first, batch, len, done, changed = 0, runs = 0;
+	unsigned long long start = t_now_us();
+	unsigned int crc, *target;
+	unsigned char *differs;
+	signed long off, sent = 0;
+	int per_line, ret = 0;
+	char probe[CMD_SIZE];
+
+	if (read_cmd != NULL &&
+	    (con_send_cmd(read_cmd) != SERIAL_OK ||
+	     con_expect_timeout(prompt, NULL, 0, CON_SLOW_TIMEOUT_MS))) {
+		APP_ERROR("Failed to run '%s'\n", read_cmd)
+		    return -1;
+	}
+	target = malloc(blocks * sizeof(*target));
+	differs = malloc(blocks);
+	if (target == NULL || differs == NULL) {
+		APP_ERROR("failed to allocate memory \n")
+		    perror(NULL);
+		ret = -1;
+		goto out;
+	}
+	/* as many crc32 commands per line as fit */
+	per_line = DELTA_LINE_MAX /
+	    (sprintf(probe, "; crc32 0x%08lX 0x%lX", load_addr + size,
+		     delta_block));
+	if (per_line < 1)
+		per_line = 1;
+	for (first = 0; first < blocks; first += batch) {
+		batch = (blocks - first > (unsigned long)per_line) ?
+		    (unsigned long)per_line : blocks - first;
+		ret = k_delta_query(first, batch, size, target + first);
+		if (ret)
+			goto out;
+	}
+	if (pl_seek(0)) {
+		ret = -1;
+		goto out;
+	}
+	for (n = 0; n < blocks; n++) {
+		len = (size - n * delta_block > delta_block) ?
+		    delta_block : size - n * delta_block;
+		crc = 0;
+		for (done = 0; done < len; done += ret) {
+			ret = pl_read(buffer, (len - done > READ_SIZE) ?
+				      READ_SIZE : len - done);
+			if (ret <= 0) {
+				APP_ERROR("Oops.. file read failed!\n")
+				    ret = -1;
+				goto out;
+			}
+			crc = crc32_update(crc, buffer, ret);
+		}
+		differs[n] = (crc != target[n]);
+		if (differs[n]) {
+			changed++;
+			sent += len;
+			if (!n || !differs[n - 1])
+				runs++;
+		}
+	}
+	ret = 0;
+	COLOR_PRINT(BLUE, "Delta: %lu of %lu blocks of 0x%lX differ, sending "
+		    "%ld of %ld bytes in %lu runs (compare took %.2f s)\n",
+		    changed, blocks, delta_block, sent, size, runs,
+		    (t_now_us() - start) / 1000000.0);
+	for (n = 0; n < blocks && !ret; n = first) {
+		for (; n < blocks && !differs[n]; n++) ;
+		for (first = n; first < blocks && differs[first]; first++) ;
+		if (n == first)
+			break;
+		off = n * delta_block;
+		len = first * delta_block;
+		ret = k_transfer(off, (len > (unsigned long)size) ? size : len,
+				 silent_status);
+	}
+out:
+	free(target);
+	free(differs);
+	return ret;
+}
+
+/**
+ * @brief k_download - send the payload, resuming interrupted transfers
+ *
+ * Without a load address, the user is expected to have started loadb on
+ * the target. With it, loadb is started here, an interrupted transfer is
+ * resumed with loadb at the first byte not acked, and the result is
+ * verified with crc32 at the end. All files go in the one transfer.
+ *
+ * @param silent_status - no progress display
+ *
+ * @return -success/failure
+ */
+static signed int k_download(int silent_status)
+{
+	signed long size, offset = 0;
+	int ret;
+
+	size = env_file ? pl_env() : pl_layout();
+	if (size < 0)
+		return size;
+#ifndef DISABLE_ZLIB
+	if (compress) {
+		ret = pl_compress();
+		if (ret)
+			goto out;
+		size = payload.size;
+	}
+#endif
+	if (!silent_status)
+		f_status_init(size, NORMAL_PRINT);
+	else
+		COLOR_PRINT(BLUE, "Transfer start (%ld bytes)\n", size);
+
+	if (!console_mode) {
+		ret = k_send_data(0, size, silent_status, &offset);
+		goto out;
+	}
+
+	con_set_echo(0);
+	if (delta_block && size)
+		ret = k_delta(size, silent_status);
+	else
+		ret = k_transfer(0, size, silent_status);
+	if (!ret && compress) {
+		ret = k_unzip(load_addr, unzip_addr, payload.raw_size);
+		if (!ret && payload.raw_size)
+			ret = k_verify(unzip_addr, payload.raw_size,
+				       payload.raw_crc);
+	} else if (!ret && size) {
+		ret = k_verify(load_addr, size, pl_crc());
+	}
+	if (!ret && env_file)
+		ret = k_env_import(size);
+out:
+	if (!ret && silent_status)
+		COLOR_PRINT(GREEN, "Transfer complete\n");
+	pl_close();
+	if (!ret && compress && !console_mode)
+		COLOR_PRINT(BLUE, "Now run: unzip <loadb address> 0x%08lX 0x%lX"
+			    " - crc32 of the result is 0x%08x\n", unzip_addr,
+			    payload.raw_size, payload.raw_crc);
+	if (!ret)
+		ret = pl_report(compress ? unzip_addr : load_addr);
+	return ret;
+}
+
+/**
+ * @brief k_bench - benchmark the kermit encoders on a file
+ *
+ * The file is encoded in MAX_CHUNK sized packets, just like a real
+ * transfer, with every encoder supported by this host. The output of each
+ * encoder is checked against the scalar one.
+ *
+ * @param f_name - file to encode
+ *
+ * @return -success/failure
+ */
+static signed int k_bench(char *f_name)
+{
+	signed long size;
+	unsigned char *data, *ref, *out;
+	unsigned int ref_sum = 0, ref_len = 0;
+	unsigned long long start, elapsed;
+	int impl, ret = 0;
+
+	size = f_size(f_name);
+	if (size <= 0) {
+		APP_ERROR("File Size Operation failed! File exists?\n")
+		    return -1;
+	}
+	if (f_open(f_name) != FILE_OK) {
+		APP_ERROR("File Open failed!File Exists & readable?\n")
+		    return -1;
+	}
+	data = malloc(size);
+	ref = malloc(size * 2);
+	out = malloc(size * 2);
+	if (data == NULL || ref == NULL || out == NULL) {
+		APP_ERROR("failed to allocate memory \n")
+		    perror(NULL);
+		ret = -1;
+		goto out;
+	}
+	if (f_read(data, size) != size) {
+		APP_ERROR("Oops.. file read failed!\n")
+		    ret = -1;
+		goto out;
+	}
+	printf("Encoding %ld bytes in %d byte packets (default: %s)\n",
+	       size, MAX_CHUNK, k_encode_name(-1));
+	for (impl = K_ENC_SCALAR; impl < K_ENC_MAX; impl++) {
+		unsigned long iter = 0;
+		unsigned int sum = 0, len = 0;
+		signed long off;
+
+		if (!k_encode_supported(impl)) {
+			printf("%8s: not supported on this host\n",
+			       k_encode_name(impl));
+			continue;
+		}
+		start = t_now_us();
+		do {
+			sum = 0;
+			len = 0;
+			for (off = 0; off < size; off += MAX_CHUNK)
+				len += k_encode_with(impl, out + len,
+						     data + off,
+						     (size - off > MAX_CHUNK) ?
+						     MAX_CHUNK : size - off,
+						     &sum);
+			iter++;
+			elapsed = t_now_us() - start;
+		} while (elapsed < BENCH_TIME_US);
+		if (impl == K_ENC_SCALAR) {
+			memcpy(ref, out, len);
+			ref_len = len;
+			ref_sum = sum;
+		} else if (len != ref_len || (sum & 0xFF) != (ref_sum & 0xFF)
+			   || memcmp(ref, out, len)) {
+			APP_ERROR("%s encoder output mismatch!\n",
+				  k_encode_name(impl))
+			    ret = -1;
+		}
+		printf("%8s: %9.2f MB/s (%lu bytes on wire, %.2f%% escaped)\n",
+		       k_encode_name(impl),
+		       (double)size * iter / elapsed, (unsigned long)len,
+		       100.0 * (len - size) / size);
+	}
+out:
+	free(data);
+	free(ref);
+	free(out);
+	f_close();
+	return ret;
+}
+
 /**
  * @brief usage help
  *
@@ -672,16 +2220,71 @@ static void usage(char *appname)
 	       "using U-Boot's kermit protocol over serial port\n\n"
 	       "Syntax:\n"
 	       "------\n"
-	       "%s -" PORT_ARG " portName -" DNLD_ARG " fileToDownload"
-	       " [-" DLY_ARG " delay_time] [-" SILENT_STAT_ARG "]\n\n"
+	       "%s -" PORT_ARG " portName -" DNLD_ARG " fileToDownload[@offset]"
+	       " [-" DNLD_ARG " ...] [-" ALIGN_ARG " align]\n\t[-"
+	       ADDR_OUT_ARG " addressFile] [-" DLY_ARG " delay_time] [-"
+	       SILENT_STAT_ARG "]\n"
+	       "\t[-" ADDR_ARG " loadAddress [-" PROMPT_ARG " prompt]"
+	       " [-" RESUME_ARG " resumes]\n\t[-" BAUD_ARG
+	       " loadBaudrate]\n\t[-" DELTA_ARG " blockSize [-" READ_CMD_ARG
+	       " readCommand]]] [-" PACE_ARG "]"
+#ifndef DISABLE_ZLIB
+	       " [-" UNZIP_ARG " unzipAddress]"
+#endif
+	       "\n"
+	       "%s -" PORT_ARG " portName -" ENV_ARG " envFile -" ADDR_ARG
+	       " loadAddress [-" ENV_FORMAT_ARG " t|b|c] [-" SAVEENV_ARG "]\n"
+	       "\t[-" PROMPT_ARG " prompt] [-" RESUME_ARG " resumes] [-"
+	       BAUD_ARG " loadBaudrate]\n"
+	       "%s -" BENCH_ARG " -" DNLD_ARG " fileToEncode\n\n"
 	       "Where:\n" "-----\n"
 	       "portName - RS232 device being used. Example: " PORT_NAME "\n"
-	       "fileToDownload - file to be downloaded\n\n"
-	       "delay_time - delay time in ms for ack reciept(optional)\n\n"
-	       SILENT_STAT_ARG "- quiet status download status\n\n"
+	       "fileToDownload - file to be downloaded. Up to %d files are "
+	       "sent in one transfer,\n\teach at offset (hex) or after the "
+	       "one before rounded up to align\n\t(default 0x%x)\n"
+	       "addressFile - write the address and size of each file "
+	       "there as name=value\n\n"
+	       "delay_time - obsolete and ignored, the ack timeout adapts to "
+	       "the round trip time measured on the link\n\n"
+	       SILENT_STAT_ARG "- quiet status download status\n"
+	       "loadAddress - (hex) run loadb to this address from here, "
+	       "resume interrupted\n\ttransfers and verify the result with "
+	       "crc32. loadb must not be running\n"
+	       "prompt - U-Boot prompt (default '" DEFAULT_PROMPT "')\n"
+	       "resumes - times to resume an interrupted transfer (default "
+	       "%d)\n"
+	       "loadBaudrate - have loadb switch to this rate for the "
+	       "transfer, the console\n\tstays at %d\n"
+	       PACE_ARG " - insert gaps between packets if errors persist at "
+	       "the smallest packet size\n"
+#ifndef DISABLE_ZLIB
+	       "unzipAddress - (hex) send the files gzipped and run unzip "
+	       "to this address\n"
+#endif
+	       "blockSize - (hex) with -" ADDR_ARG ", compare blocks of this "
+	       "size with crc32 and\n\tsend only those which differ from "
+	       "the target memory\n"
+	       "readCommand - command loading the old image to loadAddress "
+	       "before the compare\n\t(eg. \"mmc read ...\")\n"
+	       "envFile - key=value lines ('#' for comments) sent as one "
+	       "environment blob to\n\tloadAddress and imported with env "
+	       "import, then compared with printenv\n"
+	       ENV_FORMAT_ARG " - blob format: t text, b binary, c binary "
+	       "with crc32 (default)\n"
+	       SAVEENV_ARG " - run saveenv after the import\n"
+	       BENCH_ARG " - benchmark kermit encoders on fileToEncode, "
+	       "no port is used\n\n"
 	       "Usage Example:\n" "-------------\n"
-	       "%s -" PORT_ARG " " PORT_NAME " -" DNLD_ARG " " F_NAME "\n",
-	       appname, appname);
+	       "%s -" PORT_ARG " " PORT_NAME " -" DNLD_ARG " " F_NAME "\n"
+	       "%s -" PORT_ARG " " PORT_NAME " -" DNLD_ARG " " F_NAME " -"
+	       ADDR_ARG " 0x80000000\n"
+	       "%s -" PORT_ARG " " PORT_NAME " -" DNLD_ARG " uImage -"
+	       DNLD_ARG " board.dtb -" DNLD_ARG " initrd@0x1000000 -" ADDR_ARG
+	       " 0x80000000 -" ADDR_OUT_ARG " addr.txt\n"
+	       "%s -" PORT_ARG " " PORT_NAME " -" ENV_ARG " board.env -"
+	       ADDR_ARG " 0x80000000 -" SAVEENV_ARG "\n",
+	       appname, appname, appname, BLOBS_MAX, BLOB_ALIGN, RESUME_MAX,
+	       CONSOLE_BAUD, appname, appname, appname, appname);
 	REVPRINT();
 	LIC_PRINT();
 }
@@ -697,33 +2300,99 @@ static void usage(char *appname)
 int main(int argc, char **argv)
 {
 	char *port = NULL;
-	char *download_file = NULL;
 	char *appname = argv[0];
 	int c;
 	int ret = 0;
 	int silent = 0;
+	int bench = 0;
 
+	/* the producer thread encodes and sums along with this one */
+	k_encode_init();
+	crc_init();
 	/* Option validation */
 	opterr = 0;
 
 	while ((c =
 		getopt(argc, argv,
-		       DLY_ARG ":" PORT_ARG ":" DNLD_ARG ":" SILENT_STAT_ARG)) != -1)
+		       DLY_ARG ":" PORT_ARG ":" DNLD_ARG ":" SILENT_STAT_ARG
+		       BENCH_ARG ADDR_ARG ":" PROMPT_ARG ":" RESUME_ARG ":"
+		       PACE_ARG BAUD_ARG ":" ALIGN_ARG ":" ADDR_OUT_ARG ":"
+		       UNZIP_ARG ":" DELTA_ARG ":" READ_CMD_ARG ":" ENV_ARG ":"
+		       ENV_FORMAT_ARG ":" SAVEENV_ARG))
+	       != -1)
 		switch (c) {
 		case DLY_ARG_C:
-			sscanf(optarg, "%d", &delay);
+			/* Obsolete: the ack timeout adapts to the link */
+			COLOR_PRINT(BLUE, "-" DLY_ARG " is ignored, ack timeouts "
+				    "adapt to the measured round trip time\n");
 			break;
 		case PORT_ARG_C:
 			port = optarg;
 			break;
 		case DNLD_ARG_C:
-			download_file = optarg;
+			if (pl_add(optarg))
+				return 1;
 			break;
 		case SILENT_STAT_C:
 			silent = 1;
 			break;
+		case BENCH_ARG_C:
+			bench = 1;
+			break;
+		case ADDR_ARG_C:
+			sscanf(optarg, "%lx", &load_addr);
+			console_mode = 1;
+			break;
+		case PROMPT_ARG_C:
+			prompt = optarg;
+			break;
+		case RESUME_ARG_C:
+			sscanf(optarg, "%d", &resume_max);
+			break;
+		case PACE_ARG_C:
+			pacing = 1;
+			break;
+		case BAUD_ARG_C:
+			sscanf(optarg, "%lu", &load_baud);
+			break;
+		case ALIGN_ARG_C:
+			sscanf(optarg, "%lx", &blob_align);
+			if (!blob_align)
+				blob_align = 1;
+			break;
+		case ADDR_OUT_ARG_C:
+			addr_file = optarg;
+			break;
+#ifndef DISABLE_ZLIB
+		case UNZIP_ARG_C:
+			sscanf(optarg, "%lx", &unzip_addr);
+			compress = 1;
+			break;
+#endif
+		case DELTA_ARG_C:
+			sscanf(optarg, "%lx", &delta_block);
+			break;
+		case READ_CMD_ARG_C:
+			read_cmd = optarg;
+			break;
+		case ENV_ARG_C:
+			env_file = optarg;
+			break;
+		case ENV_FORMAT_ARG_C:
+			env_format = optarg[0];
+			break;
+		case SAVEENV_ARG_C:
+			env_save = 1;
+			break;
 		case '?':
-			if ((optopt == DNLD_ARG_C) || (optopt == PORT_ARG_C)) {
+			if ((optopt == DNLD_ARG_C) || (optopt == PORT_ARG_C)
+			    || (optopt == ADDR_ARG_C) || (optopt == PROMPT_ARG_C)
+			    || (optopt == RESUME_ARG_C) || (optopt == DLY_ARG_C)
+			    || (optopt == BAUD_ARG_C) || (optopt == ALIGN_ARG_C)
+			    || (optopt == ADDR_OUT_ARG_C) || (optopt == UNZIP_ARG_C)
+			    || (optopt == DELTA_ARG_C)
+			    || (optopt == READ_CMD_ARG_C) || (optopt == ENV_ARG_C)
+			    || (optopt == ENV_FORMAT_ARG_C)) {
 				APP_ERROR("Option -%c requires an argument.\n",
 					  optopt)
 			} else if (isprint(optopt)) {
@@ -737,11 +2406,47 @@ int main(int argc, char **argv)
 		default:
 			abort();
 		}
-	if ((port == NULL) || (download_file == NULL)) {
+	if (bench && blob_count)
+		return k_bench(blobs[0].name);
+	if ((port == NULL) || (!blob_count && env_file == NULL)) {
 		APP_ERROR("Error: Not Enough Args\n")
 		    usage(appname);
 		return -1;
 	}
+	if (load_baud && !console_mode) {
+		APP_ERROR("-" BAUD_ARG " needs -" ADDR_ARG " to run loadb\n")
+		    usage(appname);
+		return -1;
+	}
+	if ((delta_block || read_cmd) && (!console_mode || compress)) {
+		APP_ERROR("-" DELTA_ARG " needs -" ADDR_ARG " to query crc32, "
+			  "and does not go with -" UNZIP_ARG "\n")
+		    usage(appname);
+		return -1;
+	}
+	if (env_file && (!console_mode || blob_count || compress ||
+			 delta_block)) {
+		APP_ERROR("-" ENV_ARG " needs -" ADDR_ARG " to run env import, "
+			  "and goes without -" DNLD_ARG ", -" UNZIP_ARG " and -"
+			  DELTA_ARG "\n")
+		    usage(appname);
+		return -1;
+	}
+	if ((env_format != ENV_TEXT && env_format != ENV_BINARY &&
+	     env_format != ENV_CHECKSUM) || (env_save && !env_file)) {
+		APP_ERROR("-" ENV_FORMAT_ARG " takes t, b or c, and -"
+			  SAVEENV_ARG " goes with -" ENV_ARG "\n")
+		    usage(appname);
+		return -1;
+	}
+	if (read_cmd && !delta_block) {
+		APP_ERROR("-" READ_CMD_ARG " is only used with -" DELTA_ARG "\n")
+		    usage(appname);
+		return -1;
+	}
+	/* loadb does not switch at all for the rate it is already at */
+	if (load_baud == CONSOLE_BAUD)
+		load_baud = 0;
 
 	/* Setup the port */
 	ret = s_open(port);
@@ -749,7 +2454,7 @@ int main(int argc, char **argv)
 		APP_ERROR("serial open failed\n")
 		    return ret;
 	}
-	ret = s_configure(115200, NOPARITY, ONE_STOP_BIT, 8);
+	ret = s_configure(CONSOLE_BAUD, NOPARITY, ONE_STOP_BIT, 8);
 	if (ret != SERIAL_OK) {
 		s_close();
 		APP_ERROR("serial configure failed\n")
@@ -757,7 +2462,7 @@ int main(int argc, char **argv)
 	}
 
 	s_flush(NULL, NULL);
-	ret = k_send_data(download_file, silent);
+	ret = k_download(silent);
 	if (ret != 0) {
 		s_close();
 		APP_ERROR("Data transmit failed\n")
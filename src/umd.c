@@ -0,0 +1,484 @@
+/**
+ * @file
+ * @brief Reads target memory back over the U-Boot console
+ *
+ * FileName: src/umd.c
+ *
+ * The memory is read in regions with md.l, each checked with crc32 on
+ * the target. The commands for as many regions as fit go on one line, so
+ * a batch costs a single round trip, and the dump is decoded as it comes
+ * in. A region which arrived damaged is read again.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include "rev.h"
+#include "serial.h"
+#include "console.h"
+#include "timer.h"
+#include "crc.h"
+#include "f_status.h"
+#include "h_decode.h"
+
+#define PORT_ARG	"p"
+#define PORT_ARG_C	'p'
+#define ADDR_ARG	"a"
+#define ADDR_ARG_C	'a'
+#define LEN_ARG		"l"
+#define LEN_ARG_C	'l'
+#define OUT_ARG		"o"
+#define OUT_ARG_C	'o'
+#define REGION_ARG	"s"
+#define REGION_ARG_C	's'
+#define RETRY_ARG	"r"
+#define RETRY_ARG_C	'r'
+#define BAUD_ARG	"b"
+#define BAUD_ARG_C	'b'
+#define PROMPT_ARG	"P"
+#define PROMPT_ARG_C	'P'
+#define QUIET_ARG	"q"
+#define QUIET_ARG_C	'q'
+
+#define DEFAULT_PROMPT	"U-Boot# "
+#define DEFAULT_BAUD	115200
+#define DEFAULT_REGION	0x1000
+#define DEFAULT_RETRIES	3
+/* keep well within U-Boot's console buffer */
+#define LINE_MAX_CMD	180
+#define MARKER_SIZE	32
+/* md.l line of 16 bytes: "80000000: " 4 words, 4 spaces, ASCII, \r\n */
+#define MD_LINE_CHARS	67
+#define DUMP_LINE_SIZE	256
+
+/**
+ * A region read with one md.l, and its crc32 on the target
+ */
+struct region {
+	unsigned long offset;
+	unsigned long len;
+	/** bytes decoded and crc32 the target reported */
+	unsigned long got;
+	unsigned int crc;
+	int crc_seen;
+	int ok;
+};
+
+/************* VARS   ***************/
+static struct region *regions;
+static unsigned long region_count;
+static unsigned long base;
+static unsigned char *data;
+static char *prompt = DEFAULT_PROMPT;
+static unsigned long baud = DEFAULT_BAUD;
+/* batch being read: its regions, and the next one a crc32 belongs to */
+static struct region **batch;
+static unsigned long batch_count, batch_crc;
+/* line of console output being put together */
+static char dump_line[DUMP_LINE_SIZE];
+static unsigned int dump_len;
+static unsigned long lines_bad;
+
+/**
+ * @brief usage - help info
+ *
+ * @param appname my name
+ */
+static void usage(char *appname)
+{
+#ifdef __WIN32__
+#define PORT_NAME "COM1"
+#else
+#define PORT_NAME "/dev/ttyS0"
+#endif
+	printf("App description:\n"
+	       "---------------\n"
+	       "This reads target memory back over the U-Boot console with "
+	       "md.l, checks it with\ncrc32 and writes it to a file\n\n"
+	       "Syntax:\n"
+	       "------\n"
+	       "%s -" PORT_ARG " portName -" ADDR_ARG " address -" LEN_ARG
+	       " length -" OUT_ARG " outputFile [-" REGION_ARG
+	       " regionSize]\n\t[-" RETRY_ARG " retries] [-" BAUD_ARG
+	       " baudRate] [-" PROMPT_ARG " prompt] [-" QUIET_ARG "]\n\n"
+	       "Where:\n" "-----\n"
+	       "portName - RS232 device being used. Example: " PORT_NAME "\n"
+	       "address - (hex) first byte to read, 4 byte aligned\n"
+	       "length - (hex) bytes to read\n"
+	       "outputFile - file to write the memory to\n"
+	       "regionSize - (hex) bytes per md.l and crc32 (default 0x%X). "
+	       "As many regions as fit\n\tgo on one command line\n"
+	       "retries - times a damaged region is read again (default %d)\n"
+	       "baudRate - of the port (default %d)\n"
+	       "prompt - U-Boot prompt (default '" DEFAULT_PROMPT "')\n"
+	       "q - no progress display\n"
+	       "Usage Example:\n" "-------------\n"
+	       "%s -" PORT_ARG " " PORT_NAME " -" ADDR_ARG " 0x80000000 -"
+	       LEN_ARG " 0x10000 -" OUT_ARG " dump.bin\n",
+	       appname, DEFAULT_REGION, DEFAULT_RETRIES, DEFAULT_BAUD, appname);
+	REVPRINT();
+	LIC_PRINT();
+}
+
+/**
+ * @brief dump_parse - use a complete line of console output
+ *
+ * md.l lines of the batch go to their place in data, the crc32 results
+ * to the regions in the order they were asked for.
+ */
+static void dump_parse(void)
+{
+	unsigned char bytes[H_DEC_LINE_MAX];
+	unsigned long addr, off, i;
+	struct region *r;
+	char *crc;
+	int n;
+
+	n = h_decode_line(dump_line, dump_len, &addr, bytes);
+	if (n > 0) {
+		off = addr - base;
+		for (i = 0; i < batch_count; i++) {
+			r = batch[i];
+			if (addr >= base && off >= r->offset &&
+			    off + n <= r->offset + r->len) {
+				memcpy(data + off, bytes, n);
+				r->got += n;
+				return;
+			}
+		}
+		lines_bad++;
+		return;
+	}
+	crc = strstr(dump_line, "==> ");
+	if (crc != NULL && batch_crc < batch_count) {
+		r = batch[batch_crc++];
+		r->crc_seen = (sscanf(crc + 4, "%x", &r->crc) == 1);
+	}
+}
+
+/**
+ * @brief dump_tap - get the console output a byte at a time
+ *
+ * @param buf - data
+ * @param len - bytes in data
+ */
+static void dump_tap(const unsigned char *buf, unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len; i++) {
+		if (buf[i] == '\n') {
+			while (dump_len && dump_line[dump_len - 1] == '\r')
+				dump_len--;
+			dump_line[dump_len] = 0;
+			dump_parse();
+			dump_len = 0;
+		} else if (dump_len < DUMP_LINE_SIZE - 1) {
+			dump_line[dump_len++] = buf[i];
+		}
+	}
+}
+
+/**
+ * @brief read_batch - read some regions with one command line
+ *
+ * An echo of a marker ends the line: the prompt itself could show up in
+ * the ASCII column of the dump.
+ *
+ * @param count - regions in batch
+ * @param id - number of the batch, for the marker
+ *
+ * @return 0 or error (not a damaged region, which is just not ok)
+ */
+static int read_batch(unsigned long count, unsigned long id)
+{
+	char cmd[LINE_MAX_CMD + 2 * MARKER_SIZE];
+	char marker[MARKER_SIZE];
+	struct con_match *m;
+	unsigned long i, chars = 0;
+	unsigned int timeout_ms;
+	struct region *r;
+	int pos = 0, ret;
+
+	for (i = 0; i < count; i++) {
+		r = batch[i];
+		pos += sprintf(cmd + pos, "md.l 0x%08lX 0x%lX; crc32 0x%08lX "
+			       "0x%lX; ", base + r->offset, r->len / 4,
+			       base + r->offset, r->len);
+		r->got = 0;
+		r->crc_seen = 0;
+		chars += (r->len / 16 + 1) * MD_LINE_CHARS;
+	}
+	sprintf(cmd + pos, "echo umd%lu.", id);
+	sprintf(marker, "\numd%lu.", id);
+	batch_count = count;
+	batch_crc = 0;
+	dump_len = 0;
+	/* twice the time the dump takes on the line, and some slack */
+	timeout_ms = chars * 10000.0 / baud * 2 + 3000;
+
+	m = con_match_new();
+	if (m == NULL || con_match_add(m, marker, 0)) {
+		con_match_free(m);
+		return -1;
+	}
+	if (con_send_cmd(cmd) != SERIAL_OK) {
+		con_match_free(m);
+		APP_ERROR("Failed to send '%s'\n", cmd)
+		    return -1;
+	}
+	ret = con_match_wait(m, NULL, 0, timeout_ms);
+	con_match_free(m);
+	if (ret || con_expect_timeout(prompt, NULL, 0, timeout_ms)) {
+		APP_ERROR("No end to '%s'\n", cmd)
+		    return -1;
+	}
+	for (i = 0; i < count; i++) {
+		r = batch[i];
+		r->ok = r->got == r->len && r->crc_seen &&
+		    crc32_update(0, data + r->offset, r->len) == r->crc;
+	}
+	return 0;
+}
+
+/**
+ * @brief read_all - read all the regions not read fine yet
+ *
+ * @param silent - no progress display
+ *
+ * @return number of regions still not ok, -1 on error
+ */
+static long read_all(int silent)
+{
+	char probe[LINE_MAX_CMD];
+	unsigned long i, count = 0, done = 0, todo = 0;
+	static unsigned long id;
+	int per_line;
+
+	/* as many regions per line as fit */
+	per_line = (LINE_MAX_CMD - MARKER_SIZE) /
+	    sprintf(probe, "md.l 0x%08lX 0x%lX; crc32 0x%08lX 0x%lX; ",
+		    base, regions[0].len / 4, base, regions[0].len);
+	if (per_line < 1)
+		per_line = 1;
+	for (i = 0; i < region_count; i++)
+		if (!regions[i].ok)
+			todo += regions[i].len;
+	if (!silent)
+		f_status_init(todo, NORMAL_PRINT);
+	for (i = 0; i <= region_count; i++) {
+		if (i < region_count && !regions[i].ok)
+			batch[count++] = &regions[i];
+		if (!count || (count < per_line && i < region_count))
+			continue;
+		if (read_batch(count, id++))
+			return -1;
+		while (count)
+			done += batch[--count]->len;
+		if (!silent)
+			f_status_show(done);
+	}
+	if (!silent)
+		printf("\n");
+	for (i = 0; i < region_count; i++)
+		if (!regions[i].ok)
+			count++;
+	return count;
+}
+
+/**
+ * @brief main - application entry point
+ *
+ * @param argc - count
+ * @param argv - arguments
+ *
+ * @return 0 or error
+ */
+int main(int argc, char **argv)
+{
+	signed char ret = 0;
+	char *port = NULL;
+	char *out_name = NULL;
+	char *appname = argv[0];
+	unsigned long len = 0, region = DEFAULT_REGION, size, i;
+	unsigned long long start, elapsed;
+	double rate, line_rate, md_rate;
+	int retries = DEFAULT_RETRIES, silent = 0, pass;
+	long bad = 0;
+	FILE *out;
+	int c;
+	/* Option validation */
+	opterr = 0;
+
+	while ((c =
+		getopt(argc, argv, PORT_ARG ":" ADDR_ARG ":" LEN_ARG ":" OUT_ARG
+		       ":" REGION_ARG ":" RETRY_ARG ":" BAUD_ARG ":" PROMPT_ARG
+		       ":" QUIET_ARG)) != -1)
+		switch (c) {
+		case PORT_ARG_C:
+			port = optarg;
+			break;
+		case ADDR_ARG_C:
+			sscanf(optarg, "%lx", &base);
+			break;
+		case LEN_ARG_C:
+			sscanf(optarg, "%lx", &len);
+			break;
+		case OUT_ARG_C:
+			out_name = optarg;
+			break;
+		case REGION_ARG_C:
+			sscanf(optarg, "%lx", &region);
+			break;
+		case RETRY_ARG_C:
+			sscanf(optarg, "%d", &retries);
+			break;
+		case BAUD_ARG_C:
+			sscanf(optarg, "%lu", &baud);
+			break;
+		case PROMPT_ARG_C:
+			prompt = optarg;
+			break;
+		case QUIET_ARG_C:
+			silent = 1;
+			break;
+		case '?':
+			if ((optopt == PORT_ARG_C) || (optopt == ADDR_ARG_C)
+			    || (optopt == LEN_ARG_C) || (optopt == OUT_ARG_C)
+			    || (optopt == REGION_ARG_C) || (optopt == RETRY_ARG_C)
+			    || (optopt == BAUD_ARG_C)
+			    || (optopt == PROMPT_ARG_C)) {
+				APP_ERROR("Option -%c requires an argument.\n",
+					  optopt)
+			} else if (isprint(optopt)) {
+				APP_ERROR("Unknown option `-%c'.\n", optopt)
+			} else {
+				APP_ERROR("Unknown option character `\\x%x'.\n",
+					  optopt)
+			}
+			usage(appname);
+			return 1;
+		default:
+			abort();
+		}
+	if ((port == NULL) || (out_name == NULL) || !len) {
+		APP_ERROR("Error: Not Enough Args\n")
+		    usage(appname);
+		return -1;
+	}
+	if (!baud)
+		baud = DEFAULT_BAUD;
+	if (base & 3) {
+		APP_ERROR("address 0x%08lX is not 4 byte aligned\n", base)
+		    return -1;
+	}
+	/* whole lines of md.l */
+	region = (region + 15) & ~15UL;
+	if (!region)
+		region = DEFAULT_REGION;
+	/* md.l reads words, the bytes past length are not written out */
+	size = (len + 3) & ~3UL;
+	region_count = (size + region - 1) / region;
+	regions = calloc(region_count, sizeof(*regions));
+	batch = calloc(region_count, sizeof(*batch));
+	data = malloc(size);
+	if (regions == NULL || batch == NULL || data == NULL) {
+		APP_ERROR("failed to allocate memory \n")
+		    perror(NULL);
+		return -1;
+	}
+	for (i = 0; i < region_count; i++) {
+		regions[i].offset = i * region;
+		regions[i].len = (size - i * region > region) ?
+		    region : size - i * region;
+	}
+
+	/* Setup the port */
+	ret = s_open(port);
+	if (ret != SERIAL_OK) {
+		APP_ERROR("serial open failed\n")
+		    return ret;
+	}
+	ret = s_configure(baud, NOPARITY, ONE_STOP_BIT, 8);
+	if (ret != SERIAL_OK) {
+		s_close();
+		APP_ERROR("serial configure failed\n")
+		    return ret;
+	}
+	ret = s_flush(NULL, NULL);
+	if (ret != SERIAL_OK) {
+		s_close();
+		APP_ERROR("Failed to flush data\n")
+		    return ret;
+	}
+
+	con_set_echo(0);
+	con_set_tap(dump_tap);
+	start = t_now_us();
+	for (pass = 0; pass <= retries; pass++) {
+		if (pass)
+			printf("%ld regions damaged, reading them again\n",
+			       bad);
+		bad = read_all(silent);
+		if (bad <= 0)
+			break;
+	}
+	elapsed = t_now_us() - start;
+	con_set_tap(NULL);
+	con_set_echo(1);
+	ret = s_close();
+	if (bad) {
+		if (bad > 0)
+			APP_ERROR("%ld regions still damaged after %d retries\n",
+				  bad, retries)
+		return -1;
+	}
+	if (ret != SERIAL_OK) {
+		APP_ERROR("serial close failed\n")
+		    return ret;
+	}
+
+	out = fopen(out_name, "wb");
+	if (out == NULL || fwrite(data, 1, len, out) != len) {
+		APP_ERROR("Failed to write %s\n", out_name)
+		    perror(out_name);
+		if (out != NULL)
+			fclose(out);
+		return -1;
+	}
+	fclose(out);
+
+	rate = elapsed ? len * 1000000.0 / elapsed : 0;
+	line_rate = baud / 10.0;
+	md_rate = line_rate * H_DEC_LINE_MAX / MD_LINE_CHARS;
+	COLOR_PRINT(GREEN, "Read 0x%lX bytes from 0x%08lX in %.3f s: %.0f "
+		    "bytes/s\n", len, base, elapsed / 1000000.0, rate);
+	printf("%.0f%% of the %.0f bytes/s md.l can carry at %lu baud (line "
+	       "%.0f bytes/s), %lu regions verified with crc32, %s decoder\n",
+	       md_rate ? rate * 100 / md_rate : 0, md_rate, baud, line_rate,
+	       region_count, h_decode_name(-1));
+	if (lines_bad)
+		printf("%lu stray md.l lines ignored\n", lines_bad);
+	return 0;
+}
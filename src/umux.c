@@ -0,0 +1,652 @@
+/**
+ * @file
+ * @brief Console multiplexer: shares one serial port between many tools
+ *
+ * FileName: src/umux.c
+ *
+ * umux owns the serial port and serves it on a UNIX socket, see
+ * include/umux.h for the protocol. The port is read straight into a ring,
+ * from which each client is sent on at its own pace - a client too slow
+ * to keep up loses the oldest data, the port is never held back for it.
+ * Only the lease holder writes to the port, the other leases queue up.
+ * The tools of this package take the socket path in place of the port.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "rev.h"
+#include "serial.h"
+#include "timer.h"
+#include "umux.h"
+
+#define PORT_ARG	"p"
+#define PORT_ARG_C	'p'
+#define SOCKET_ARG	"S"
+#define SOCKET_ARG_C	'S'
+#define BAUD_ARG	"b"
+#define BAUD_ARG_C	'b'
+#define LEASE_ARG	"l"
+#define LEASE_ARG_C	'l'
+#define WATCH_ARG	"w"
+#define WATCH_ARG_C	'w'
+
+#define DEFAULT_BAUD	115200
+/* port data kept, and how much of it a new watcher gets */
+#define RING_SIZE	(1024 * 1024)
+#define HISTORY_SIZE	(16 * 1024)
+#define CLIENTS_MAX	32
+/* lease holder data on its way to the port */
+#define TX_SIZE		4096
+
+/* client states */
+#define C_FREE		0
+#define C_HELLO		1
+#define C_WATCH		2
+#define C_WAIT		3
+#define C_LEASE		4
+
+/**
+ * A connection
+ */
+struct client {
+	int fd;
+	int state;
+	/** ring position of the next byte to send it */
+	unsigned long long pos;
+	/** bytes it was too slow for */
+	unsigned long long lost;
+	char hello[UMUX_LINE_MAX];
+	unsigned int hello_len;
+	/** lease: order it was asked in, and when granted in us */
+	unsigned long long ticket;
+	unsigned long long since;
+};
+
+/************* VARS   ***************/
+static unsigned char ring[RING_SIZE];
+/* bytes ever read from the port, ring[head % RING_SIZE] is the next */
+static unsigned long long head;
+static struct client clients[CLIENTS_MAX];
+static struct client *holder;
+static unsigned long long tickets;
+static unsigned char tx[TX_SIZE];
+static unsigned int tx_len, tx_done;
+static int port_fd;
+static unsigned long baud = DEFAULT_BAUD;
+static float lease_max;
+static volatile int quit;
+
+/**
+ * @brief usage - help info
+ *
+ * @param appname my name
+ */
+static void usage(char *appname)
+{
+	printf("App description:\n"
+	       "---------------\n"
+	       "This owns a serial port and shares it on a UNIX socket: all "
+	       "clients see the\nconsole output, one at a time gets to write "
+	       "to it\n\n"
+	       "Syntax:\n"
+	       "------\n"
+	       "%s -" PORT_ARG " portName -" SOCKET_ARG " socketPath [-"
+	       BAUD_ARG " baudRate] [-" LEASE_ARG " seconds]\n"
+	       "%s -" SOCKET_ARG " socketPath -" WATCH_ARG "\n\n"
+	       "Where:\n" "-----\n"
+	       "portName - RS232 device being used. Example: /dev/ttyS0\n"
+	       "socketPath - UNIX socket to serve it on. The other tools take "
+	       "this path as\n\tportName to go through umux\n"
+	       "baudRate - of the port, 8N1 (default %d). Tools going through "
+	       "umux cannot\n\tchange it\n"
+	       "-" LEASE_ARG " seconds - drop a tool which held the port for "
+	       "longer (default never)\n"
+	       "-" WATCH_ARG " - print the console output of an umux already "
+	       "running, starting\n\twith the last %d bytes\n"
+	       "Usage Example:\n" "-------------\n"
+	       "%s -" PORT_ARG " /dev/ttyS0 -" SOCKET_ARG " /tmp/ttyS0.umux &\n"
+	       "%s -" SOCKET_ARG " /tmp/ttyS0.umux -" WATCH_ARG " &\n"
+	       "ucmd -" PORT_ARG " /tmp/ttyS0.umux -c \"version\" -e \"U-Boot# "
+	       "\"\n",
+	       appname, appname, DEFAULT_BAUD, HISTORY_SIZE, appname, appname);
+	REVPRINT();
+	LIC_PRINT();
+}
+
+/**
+ * @brief on_signal - stop serving
+ *
+ * @param sig - signal
+ */
+static void on_signal(int sig)
+{
+	quit = 1;
+}
+
+/**
+ * @brief client_drop - close a connection
+ *
+ * @param c - client
+ * @param why - for the log
+ */
+static void client_drop(struct client *c, char *why)
+{
+	printf("client %d: %s", (int)(c - clients), why);
+	if (c == holder)
+		printf(", lease over");
+	if (c->lost)
+		printf(", lost %llu bytes", c->lost);
+	printf("\n");
+	close(c->fd);
+	if (c == holder)
+		holder = NULL;
+	c->state = C_FREE;
+}
+
+/**
+ * @brief client_reply - send the reply to the hello
+ *
+ * @param c - client
+ *
+ * @return 0 or error
+ */
+static int client_reply(struct client *c)
+{
+	char line[UMUX_LINE_MAX];
+	int len;
+
+	len = snprintf(line, sizeof(line), UMUX_OK "%lu\n", baud);
+	/* nothing else is queued on the socket yet, so it all fits */
+	if (send(c->fd, line, len, MSG_DONTWAIT | MSG_NOSIGNAL) != len) {
+		client_drop(c, "gone before the reply");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief client_hello - take in the hello line
+ *
+ * @param c - client
+ */
+static void client_hello(struct client *c)
+{
+	int ret;
+
+	/* byte by byte, what follows it is not ours to read here */
+	ret = read(c->fd, c->hello + c->hello_len, 1);
+	if (ret < 0 && (errno == EINTR || errno == EAGAIN))
+		return;
+	if (ret <= 0) {
+		client_drop(c, "gone before the hello");
+		return;
+	}
+	if (c->hello[c->hello_len++] != '\n') {
+		if (c->hello_len == sizeof(c->hello) - 1)
+			client_drop(c, "hello too long");
+		return;
+	}
+	c->hello[c->hello_len] = 0;
+	if (!strcmp(c->hello, UMUX_WATCH)) {
+		c->state = C_WATCH;
+		c->pos = (head > HISTORY_SIZE) ? head - HISTORY_SIZE : 0;
+		if (!client_reply(c))
+			printf("client %d: watching\n", (int)(c - clients));
+	} else if (!strcmp(c->hello, UMUX_LEASE)) {
+		c->state = C_WAIT;
+		c->ticket = tickets++;
+		printf("client %d: asked for the lease\n", (int)(c - clients));
+	} else {
+		client_drop(c, "bad hello");
+	}
+}
+
+/**
+ * @brief lease_grant - hand the port to the longest waiting client
+ *
+ * Only once the data of the last holder went out, so that nothing of it
+ * ends up in the output the next one sees as its own.
+ */
+static void lease_grant(void)
+{
+	struct client *next = NULL;
+	int i;
+
+	if (holder != NULL || tx_done < tx_len)
+		return;
+	for (i = 0; i < CLIENTS_MAX; i++)
+		if (clients[i].state == C_WAIT &&
+		    (next == NULL || clients[i].ticket < next->ticket))
+			next = &clients[i];
+	if (next == NULL)
+		return;
+	next->state = C_LEASE;
+	next->pos = head;
+	next->since = t_now_us();
+	holder = next;
+	if (!client_reply(next))
+		printf("client %d: got the lease\n", (int)(next - clients));
+}
+
+/**
+ * @brief client_send - send a client what it has not seen yet
+ *
+ * Straight from the ring, as much as the socket takes now.
+ *
+ * @param c - client
+ */
+static void client_send(struct client *c)
+{
+	unsigned long long avail = head - c->pos;
+	unsigned long idx, len;
+	int ret;
+
+	if (!avail)
+		return;
+	/* overwritten already, skip to the oldest data still there */
+	if (avail > RING_SIZE) {
+		c->lost += avail - RING_SIZE;
+		c->pos = head - RING_SIZE;
+		avail = RING_SIZE;
+	}
+	idx = c->pos % RING_SIZE;
+	len = (avail > RING_SIZE - idx) ? RING_SIZE - idx : avail;
+	ret = send(c->fd, ring + idx, len, MSG_DONTWAIT | MSG_NOSIGNAL);
+	if (ret < 0 && (errno == EINTR || errno == EAGAIN))
+		return;
+	if (ret < 0) {
+		client_drop(c, "gone");
+		return;
+	}
+	c->pos += ret;
+}
+
+/**
+ * @brief port_read - read the port into the ring, pass it on
+ *
+ * @return 0 or error
+ */
+static int port_read(void)
+{
+	unsigned long idx = head % RING_SIZE;
+	int ret, i;
+
+	ret = read(port_fd, ring + idx, RING_SIZE - idx);
+	if (ret < 0 && (errno == EINTR || errno == EAGAIN))
+		return 0;
+	if (ret <= 0) {
+		APP_ERROR("failed to read the port, hung up?\n")
+		    return -1;
+	}
+	head += ret;
+	for (i = 0; i < CLIENTS_MAX; i++)
+		if (clients[i].state == C_WATCH || clients[i].state == C_LEASE)
+			client_send(&clients[i]);
+	return 0;
+}
+
+/**
+ * @brief port_write - write what the lease holder sent to the port
+ *
+ * @return 0 or error
+ */
+static int port_write(void)
+{
+	int ret;
+
+	ret = write(port_fd, tx + tx_done, tx_len - tx_done);
+	if (ret < 0 && (errno == EINTR || errno == EAGAIN))
+		return 0;
+	if (ret < 0) {
+		APP_ERROR("failed to write the port\n")
+		    return -1;
+	}
+	tx_done += ret;
+	if (tx_done == tx_len)
+		tx_done = tx_len = 0;
+	return 0;
+}
+
+/**
+ * @brief client_read - take in data from a client
+ *
+ * Only what the lease holder sends is kept, once the port took the last.
+ *
+ * @param c - client
+ */
+static void client_read(struct client *c)
+{
+	unsigned char junk[TX_SIZE];
+	unsigned char *buf = (c == holder) ? tx : junk;
+	int ret;
+
+	ret = read(c->fd, buf, TX_SIZE);
+	if (ret < 0 && (errno == EINTR || errno == EAGAIN))
+		return;
+	if (ret <= 0) {
+		client_drop(c, "gone");
+		return;
+	}
+	if (c == holder) {
+		tx_len = ret;
+		tx_done = 0;
+	}
+}
+
+/**
+ * @brief client_accept - take a new connection
+ *
+ * @param sock - listening socket
+ */
+static void client_accept(int sock)
+{
+	int fd, i;
+
+	fd = accept(sock, NULL, NULL);
+	if (fd < 0)
+		return;
+	for (i = 0; i < CLIENTS_MAX; i++)
+		if (clients[i].state == C_FREE)
+			break;
+	if (i == CLIENTS_MAX) {
+		APP_ERROR("Too many clients, max %d\n", CLIENTS_MAX)
+		    close(fd);
+		return;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	memset(&clients[i], 0, sizeof(clients[i]));
+	clients[i].fd = fd;
+	clients[i].state = C_HELLO;
+}
+
+/**
+ * @brief serve - the daemon loop
+ *
+ * @param sock - listening socket
+ *
+ * @return 0 or error
+ */
+static int serve(int sock)
+{
+	struct pollfd pfd[CLIENTS_MAX + 2];
+	struct client *owner[CLIENTS_MAX + 2];
+	struct client *c;
+	int n, i, ret;
+
+	while (!quit) {
+		lease_grant();
+		n = 0;
+		pfd[n].fd = sock;
+		pfd[n++].events = POLLIN;
+		pfd[n].fd = port_fd;
+		pfd[n++].events = POLLIN | ((tx_done < tx_len) ? POLLOUT : 0);
+		for (i = 0; i < CLIENTS_MAX; i++) {
+			c = &clients[i];
+			if (c->state == C_FREE)
+				continue;
+			owner[n] = c;
+			pfd[n].fd = c->fd;
+			/* the holder is held back while the port is busy */
+			pfd[n].events = (c != holder || tx_done == tx_len) ?
+			    POLLIN : 0;
+			if ((c->state == C_WATCH || c->state == C_LEASE) &&
+			    c->pos != head)
+				pfd[n].events |= POLLOUT;
+			n++;
+		}
+		ret = poll(pfd, n, lease_max ? 100 : -1);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret < 0) {
+			APP_ERROR("poll failed\n")
+			    return -1;
+		}
+		if (pfd[1].revents & (POLLIN | POLLHUP | POLLERR) &&
+		    port_read())
+			return -1;
+		if (pfd[1].revents & POLLOUT && port_write())
+			return -1;
+		for (i = 2; i < n; i++) {
+			c = owner[i];
+			if (c->state != C_FREE && pfd[i].revents & POLLOUT)
+				client_send(c);
+			if (c->state == C_FREE || !(pfd[i].events & POLLIN) ||
+			    !(pfd[i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			if (c->state == C_HELLO)
+				client_hello(c);
+			else
+				client_read(c);
+		}
+		if (pfd[0].revents & POLLIN)
+			client_accept(sock);
+		if (holder != NULL && lease_max &&
+		    t_now_us() - holder->since > lease_max * 1000000.0)
+			client_drop(holder, "lease expired");
+	}
+	return 0;
+}
+
+/**
+ * @brief sock_open - connect to or listen on the socket
+ *
+ * @param path - socket path
+ * @param server - listen if set, else connect
+ *
+ * @return socket or -1
+ */
+static int sock_open(char *path, int server)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	int sock;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		APP_ERROR("socket path %s is too long\n", path)
+		    return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0) {
+		APP_ERROR("failed to create socket\n")
+		    return -1;
+	}
+	if (!connect(sock, (struct sockaddr *)&addr, sizeof(addr))) {
+		if (!server)
+			return sock;
+		APP_ERROR("%s is served by another umux already\n", path)
+		    close(sock);
+		return -1;
+	}
+	if (!server) {
+		APP_ERROR("failed to connect to %s\n", path)
+		    perror(path);
+		close(sock);
+		return -1;
+	}
+	/* left over from an umux which did not get to clean up */
+	if (!stat(path, &st) && S_ISSOCK(st.st_mode))
+		unlink(path);
+	if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(sock, CLIENTS_MAX)) {
+		APP_ERROR("failed to listen on %s\n", path)
+		    perror(path);
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+/**
+ * @brief watch - print the console output of a running umux
+ *
+ * @param path - socket path
+ *
+ * @return 0 or error
+ */
+static int watch(char *path)
+{
+	char buf[TX_SIZE];
+	int sock, ret, len = 0;
+
+	sock = sock_open(path, 0);
+	if (sock < 0)
+		return -1;
+	if (write(sock, UMUX_WATCH, strlen(UMUX_WATCH)) < 0) {
+		APP_ERROR("failed to send to %s\n", path)
+		    close(sock);
+		return -1;
+	}
+	/* the reply line, then the console */
+	do {
+		ret = read(sock, buf + len, 1);
+	} while (ret == 1 && buf[len] != '\n' && ++len < UMUX_LINE_MAX - 1);
+	buf[len] = 0;
+	if (ret != 1 || strncmp(buf, UMUX_OK, strlen(UMUX_OK))) {
+		APP_ERROR("%s did not take the watch request\n", path)
+		    close(sock);
+		return -1;
+	}
+	while ((ret = read(sock, buf, sizeof(buf))) > 0) {
+		fwrite(buf, 1, ret, stdout);
+		fflush(stdout);
+	}
+	close(sock);
+	return 0;
+}
+
+/**
+ * @brief main - application entry point
+ *
+ * @param argc - count
+ * @param argv - arguments
+ *
+ * @return 0 or error
+ */
+int main(int argc, char **argv)
+{
+	signed char ret = 0;
+	char *port = NULL;
+	char *path = NULL;
+	char *appname = argv[0];
+	int watcher = 0;
+	int sock, c, i;
+	/* Option validation */
+	opterr = 0;
+
+	while ((c =
+		getopt(argc, argv, PORT_ARG ":" SOCKET_ARG ":" BAUD_ARG ":"
+		       LEASE_ARG ":" WATCH_ARG)) != -1)
+		switch (c) {
+		case PORT_ARG_C:
+			port = optarg;
+			break;
+		case SOCKET_ARG_C:
+			path = optarg;
+			break;
+		case BAUD_ARG_C:
+			sscanf(optarg, "%lu", &baud);
+			break;
+		case LEASE_ARG_C:
+			sscanf(optarg, "%f", &lease_max);
+			break;
+		case WATCH_ARG_C:
+			watcher = 1;
+			break;
+		case '?':
+			if ((optopt == PORT_ARG_C) || (optopt == SOCKET_ARG_C)
+			    || (optopt == BAUD_ARG_C) || (optopt == LEASE_ARG_C)) {
+				APP_ERROR("Option -%c requires an argument.\n",
+					  optopt)
+			} else if (isprint(optopt)) {
+				APP_ERROR("Unknown option `-%c'.\n", optopt)
+			} else {
+				APP_ERROR("Unknown option character `\\x%x'.\n",
+					  optopt)
+			}
+			usage(appname);
+			return 1;
+		default:
+			abort();
+		}
+	if ((path == NULL) || (!watcher && (port == NULL))) {
+		APP_ERROR("Error: Not Enough Args\n")
+		    usage(appname);
+		return -1;
+	}
+	if (watcher)
+		return watch(path);
+
+	/* Setup the port */
+	ret = s_open(port);
+	if (ret != SERIAL_OK) {
+		APP_ERROR("serial open failed\n")
+		    return ret;
+	}
+	ret = s_configure(baud, NOPARITY, ONE_STOP_BIT, 8);
+	if (ret != SERIAL_OK) {
+		s_close();
+		APP_ERROR("serial configure failed\n")
+		    return ret;
+	}
+	port_fd = s_fd();
+	fcntl(port_fd, F_SETFL, fcntl(port_fd, F_GETFL) | O_NONBLOCK);
+
+	sock = sock_open(path, 1);
+	if (sock < 0) {
+		s_close();
+		return -1;
+	}
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	signal(SIGPIPE, SIG_IGN);
+	/* the log may well go to a file */
+	setvbuf(stdout, NULL, _IOLBF, 0);
+	printf("Serving %s at %lu on %s\n", port, baud, path);
+
+	c = serve(sock);
+
+	for (i = 0; i < CLIENTS_MAX; i++)
+		if (clients[i].state != C_FREE)
+			close(clients[i].fd);
+	close(sock);
+	unlink(path);
+	ret = s_close();
+	if (ret != SERIAL_OK) {
+		APP_ERROR("serial close failed\n")
+		    return ret;
+	}
+	return c;
+}
@@ -0,0 +1,831 @@
+/**
+ * @file
+ * @brief ymodem/xmodem sender for U-Boot's loady and loadx
+ *
+ * FileName: src/uymodem.c
+ *
+ * Ref: http://git.denx.de/?p=u-boot.git;a=blob;f=common/xyzModem.c
+ *
+ * U-Boot's xyzModem receiver takes 1024 byte blocks (STX) or 128 byte
+ * blocks (SOH), each with a block number, its complement and a CRC-16,
+ * the data itself is not escaped. Compared to kermit as ukermit speaks it
+ * (100 byte packets, control characters escaped) that is far fewer bytes
+ * and far fewer turnarounds for a binary image.
+ *
+ * YMODEM starts the batch with block 0 carrying the file name and size,
+ * which lets loady drop the padding of the last block. The end of the file
+ * is EOT, and an empty block 0 ends the batch. XMODEM (loadx) has neither
+ * block 0 nor the size, the last block is padded with CPMEOF.
+ *
+ * Blocks are acked one by one. Optionally, a window of blocks is sent
+ * ahead of the acks; with a target which keeps up that hides the
+ * turnaround. On a NAK or timeout, the window is shrunk and blocks are
+ * sent again from the one not acked (go back N), clean runs grow the
+ * window back up to the limit given.
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include "rev.h"
+#include "serial.h"
+#include "file.h"
+#include "f_status.h"
+#include "k_encode.h"
+#include "timer.h"
+#include "crc.h"
+#include "console.h"
+
+#define SOH_CHAR		0x01
+#define STX_CHAR		0x02
+#define EOT_CHAR		0x04
+#define ACK_CHAR		0x06
+#define NAK_CHAR		0x15
+#define CAN_CHAR		0x18
+#define CPMEOF_CHAR		0x1A
+#define CRC_CHAR		'C'
+
+/* Block sizes */
+#define Y_BLOCK_SMALL		128
+#define Y_BLOCK_LARGE		1024
+/* block type, number, complement */
+#define Y_HEADER		3
+/* Largest block on the wire: header, data, CRC-16 */
+#define Y_FRAME_MAX		(Y_HEADER + Y_BLOCK_LARGE + 2)
+
+/* Blocks in flight: limit, and clean blocks to grow by one */
+#define Y_WINDOW_MAX		16
+#define Y_WINDOW_GROW		16
+/* Tries for one block before giving up */
+#define Y_RETRY_MAX		10
+/* Response timeout: more than U-Boot's 2s to get a block header */
+#define Y_TIMEOUT_MS		3000
+/* Wait for the receiver to start asking for blocks */
+#define Y_START_TIMEOUT_MS	60000
+/* No more responses for blocks dropped in flight after this */
+#define Y_DRAIN_MS		100
+
+/* Packet size and wire bytes of ukermit, for -B */
+#define K_CHUNK			100
+#define K_PACKET_OVERHEAD	6
+#define K_ACK_SIZE		6
+
+#define PORT_ARG		"p"
+#define PORT_ARG_C		'p'
+#define DNLD_ARG		"f"
+#define DNLD_ARG_C		'f'
+#define SILENT_STAT_ARG		"q"
+#define SILENT_STAT_C		'q'
+#define XMODEM_ARG		"x"
+#define XMODEM_ARG_C		'x'
+#define WINDOW_ARG		"w"
+#define WINDOW_ARG_C		'w'
+#define ADDR_ARG		"a"
+#define ADDR_ARG_C		'a'
+#define PROMPT_ARG		"P"
+#define PROMPT_ARG_C		'P'
+#define ESTIMATE_ARG		"E"
+#define ESTIMATE_ARG_C		'E'
+#define ESTIMATE_BAUD_ARG	"b"
+#define ESTIMATE_BAUD_ARG_C	'b'
+
+#define DEFAULT_PROMPT		"U-Boot# "
+#define LOAD_READY		"bps..."
+#define CONSOLE_BAUD		115200
+/* Wait for loady/loadx to start and for the prompt after the transfer */
+#define CON_TIMEOUT_MS		5000
+/* Echoes timed to estimate the turnaround of an ack with -E -p */
+#define RTT_SAMPLES		8
+#define CMD_SIZE		100
+
+/* Set for loadx, else loady */
+static int xmodem;
+/* Largest window of blocks to send ahead of the acks */
+static int window_max = 1;
+/* Set if loady/loadx is driven from here */
+static int console_mode;
+static unsigned long load_addr;
+static char *prompt = DEFAULT_PROMPT;
+
+/**
+ * Sender state
+ *
+ * Block n is sent from frames[n % Y_WINDOW_MAX] - frames are built when
+ * first sent and kept till acked, so going back needs no file seeks.
+ */
+static struct {
+	unsigned char frames[Y_WINDOW_MAX][Y_FRAME_MAX];
+	unsigned int frame_len[Y_WINDOW_MAX];
+	/** CRC-16 (else 8 bit checksum) as the receiver asked for */
+	int crc_mode;
+	/** blocks in flight now */
+	int window;
+	/** acks in a row since the last error */
+	int clean;
+	/** statistics */
+	unsigned long blocks;
+	unsigned long retransmits;
+	unsigned long timeouts;
+	unsigned long naks;
+	int window_min;
+} y_tx;
+
+/**
+ * @brief y_build_block - put a block in frame format
+ *
+ * @param frame - where the block goes
+ * @param number - block number
+ * @param data - data of the block, padded by the caller
+ * @param size - Y_BLOCK_SMALL or Y_BLOCK_LARGE
+ *
+ * @return bytes of the frame
+ */
+static unsigned int y_build_block(unsigned char *frame, unsigned long number,
+				  unsigned char *data, unsigned int size)
+{
+	unsigned short crc;
+	unsigned char sum = 0;
+	unsigned int i;
+
+	frame[0] = (size == Y_BLOCK_LARGE) ? STX_CHAR : SOH_CHAR;
+	frame[1] = number & 0xFF;
+	frame[2] = ~number & 0xFF;
+	if (data != frame + Y_HEADER)
+		memcpy(frame + Y_HEADER, data, size);
+	if (y_tx.crc_mode) {
+		crc = crc16_update(0, frame + Y_HEADER, size);
+		frame[Y_HEADER + size] = crc >> 8;
+		frame[Y_HEADER + size + 1] = crc & 0xFF;
+		return Y_HEADER + size + 2;
+	}
+	for (i = 0; i < size; i++)
+		sum += frame[Y_HEADER + i];
+	frame[Y_HEADER + size] = sum;
+	return Y_HEADER + size + 1;
+}
+
+/**
+ * @brief y_response - get the receiver's answer to a block
+ *
+ * @param timeout_ms - how long to wait
+ *
+ * @return ACK_CHAR, NAK_CHAR, CRC_CHAR, CAN_CHAR, SERIAL_TIMEDOUT or
+ * SERIAL_FAILED
+ */
+static signed int y_response(unsigned int timeout_ms)
+{
+	unsigned char c;
+	unsigned long long deadline = t_now_us() + timeout_ms * 1000ULL;
+	unsigned long long now;
+	int ret;
+
+	while ((now = t_now_us()) < deadline) {
+		ret = s_read_timeout(&c, 1, (deadline - now + 999) / 1000);
+		if (ret == SERIAL_FAILED)
+			return ret;
+		if (ret <= 0)
+			break;
+		switch (c) {
+		case ACK_CHAR:
+		case NAK_CHAR:
+		case CRC_CHAR:
+		case CAN_CHAR:
+			return c;
+		default:
+			/* console chatter, line noise */
+			break;
+		}
+	}
+	return SERIAL_TIMEDOUT;
+}
+
+/**
+ * @brief y_drain - drop answers to blocks which were sent in vain
+ */
+static void y_drain(void)
+{
+	unsigned char c;
+
+	while (s_read_timeout(&c, 1, Y_DRAIN_MS) > 0)
+		;
+}
+
+/**
+ * @brief y_send_frame - send a frame and wait for it to be acked
+ *
+ * Used for block 0 and the end of transfer, where nothing is in flight.
+ *
+ * @param frame - frame to send
+ * @param len - bytes of frame
+ * @param what - for error messages
+ *
+ * @return -success/failure
+ */
+static signed int y_send_frame(unsigned char *frame, unsigned int len,
+			       char *what)
+{
+	int retry, ret;
+
+	for (retry = 0; retry < Y_RETRY_MAX; retry++) {
+		s_write(frame, len);
+		ret = y_response(Y_TIMEOUT_MS);
+		if (ret == ACK_CHAR)
+			return 0;
+		if (ret == CAN_CHAR || ret == SERIAL_FAILED) {
+			APP_ERROR("%s: transfer cancelled by target\n", what)
+			    return -1;
+		}
+		y_tx.retransmits++;
+	}
+	APP_ERROR("%s: no ack after %d tries\n", what, Y_RETRY_MAX)
+	    return -1;
+}
+
+/**
+ * @brief y_wait_start - wait for the receiver to ask for the first block
+ *
+ * 'C' asks for CRC-16, NAK for the 8 bit checksum.
+ *
+ * @return -success/failure
+ */
+static signed int y_wait_start(void)
+{
+	int ret;
+
+	ret = y_response(Y_START_TIMEOUT_MS);
+	if (ret == CRC_CHAR || ret == NAK_CHAR) {
+		y_tx.crc_mode = (ret == CRC_CHAR);
+		/* more of them may be queued, they are not answers to blocks */
+		s_flush(NULL, NULL);
+		return 0;
+	}
+	APP_ERROR("Receiver did not start (is loady/loadx running?)\n")
+	    return -1;
+}
+
+/**
+ * @brief y_header_block - build YMODEM block 0: file name and size
+ *
+ * @param frame - where the block goes
+ * @param f_name - file name (path is dropped), NULL for the end of batch
+ * @param size - file size
+ *
+ * @return bytes of the frame
+ */
+static unsigned int y_header_block(unsigned char *frame, char *f_name,
+				   signed long size)
+{
+	unsigned char *data = frame + Y_HEADER;
+	char *base;
+	int len;
+
+	memset(data, 0, Y_BLOCK_SMALL);
+	if (f_name != NULL) {
+		base = strrchr(f_name, '/');
+		if (base == NULL)
+			base = strrchr(f_name, '\\');
+		base = (base == NULL) ? f_name : base + 1;
+		len = snprintf((char *)data, Y_BLOCK_SMALL - 16, "%s", base);
+		if (len > Y_BLOCK_SMALL - 17)
+			len = Y_BLOCK_SMALL - 17;
+		sprintf((char *)data + len + 1, "%ld", size);
+	}
+	return y_build_block(frame, 0, data, Y_BLOCK_SMALL);
+}
+
+/**
+ * @brief y_shrink - a block went wrong: smaller window, go back
+ */
+static void y_shrink(void)
+{
+	y_tx.clean = 0;
+	if (y_tx.window > 1) {
+		y_tx.window /= 2;
+		if (y_tx.window < y_tx.window_min)
+			y_tx.window_min = y_tx.window;
+	}
+}
+
+/**
+ * @brief y_send_data - send the open file as data blocks
+ *
+ * @param size - file size
+ * @param silent_status - no progress display
+ *
+ * @return -success/failure
+ */
+static signed int y_send_data(signed long size, int silent_status)
+{
+	unsigned long blocks, base = 1, next = 1, built = 0, n;
+	unsigned int slot, block_size;
+	signed long remaining = size, left;
+	int retry = 0, ret;
+	unsigned char *data;
+
+	/* all but the last block are large, that one as small as fits */
+	blocks = (size + Y_BLOCK_LARGE - 1) / Y_BLOCK_LARGE;
+	y_tx.window = window_max;
+	y_tx.window_min = window_max;
+	while (base <= blocks) {
+		/* fill up the window */
+		while (next < base + y_tx.window && next <= blocks) {
+			slot = next % Y_WINDOW_MAX;
+			if (next > built) {
+				data = y_tx.frames[slot] + Y_HEADER;
+				left = remaining;
+				block_size = (left > Y_BLOCK_SMALL) ?
+				    Y_BLOCK_LARGE : Y_BLOCK_SMALL;
+				if (left > Y_BLOCK_LARGE)
+					left = Y_BLOCK_LARGE;
+				if (f_read(data, left) != left) {
+					APP_ERROR("Oops.. file read failed!\n")
+					    return -1;
+				}
+				memset(data + left, CPMEOF_CHAR,
+				       block_size - left);
+				y_tx.frame_len[slot] =
+				    y_build_block(y_tx.frames[slot], next,
+						  data, block_size);
+				remaining -= left;
+				built = next;
+			}
+			s_write(y_tx.frames[slot], y_tx.frame_len[slot]);
+			next++;
+		}
+		ret = y_response(Y_TIMEOUT_MS);
+		if (ret == ACK_CHAR) {
+			base++;
+			retry = 0;
+			y_tx.blocks++;
+			if (++y_tx.clean >= Y_WINDOW_GROW &&
+			    y_tx.window < window_max) {
+				y_tx.window++;
+				y_tx.clean = 0;
+			}
+			if (!silent_status) {
+				n = (base - 1) * Y_BLOCK_LARGE;
+				f_status_show((n > size) ? size : n);
+			}
+			continue;
+		}
+		if (ret == CAN_CHAR || ret == SERIAL_FAILED) {
+			APP_ERROR("Transfer cancelled by target at block %lu\n",
+				  base)
+			    return -1;
+		}
+		/* NAK, 'C' (how U-Boot NAKs in CRC mode) or timeout */
+		if (ret == SERIAL_TIMEDOUT)
+			y_tx.timeouts++;
+		else
+			y_tx.naks++;
+		if (++retry == Y_RETRY_MAX) {
+			APP_ERROR("Failed after %d tries at block %lu - "
+				  "success send = %lu bytes\n", Y_RETRY_MAX,
+				  base, (base - 1) * Y_BLOCK_LARGE)
+			    return -1;
+		}
+		if (next - base > 1)
+			y_drain();
+		y_tx.retransmits += next - base;
+		y_shrink();
+		next = base;
+	}
+	return 0;
+}
+
+/**
+ * @brief y_send_end - end of file, and for YMODEM end of batch
+ *
+ * @return -success/failure
+ */
+static signed int y_send_end(void)
+{
+	unsigned char eot = EOT_CHAR;
+	int retry, ret = 0;
+
+	/* Receivers may NAK the first EOT to be sure of it */
+	for (retry = 0; retry < Y_RETRY_MAX; retry++) {
+		s_write(&eot, 1);
+		ret = y_response(Y_TIMEOUT_MS);
+		if (ret == ACK_CHAR || ret == CAN_CHAR ||
+		    ret == SERIAL_FAILED)
+			break;
+	}
+	if (ret != ACK_CHAR) {
+		APP_ERROR("End of transfer was not acked\n")
+		    return -1;
+	}
+	if (xmodem)
+		return 0;
+	/* loady asks for the next file, an empty block 0 says none */
+	if (y_wait_start())
+		return -1;
+	return y_send_frame(y_tx.frames[0], y_header_block(y_tx.frames[0],
+							   NULL, 0),
+			    "End of batch");
+}
+
+/**
+ * @brief y_load - start loady/loadx on the target
+ *
+ * @param addr - address to load to
+ *
+ * @return -success/failure
+ */
+static signed int y_load(unsigned long addr)
+{
+	char cmd[CMD_SIZE];
+
+	sprintf(cmd, "%s 0x%08lX", xmodem ? "loadx" : "loady", addr);
+	if (con_send_cmd(cmd) != SERIAL_OK) {
+		APP_ERROR("Failed to send command '%s'\n", cmd)
+		    return -1;
+	}
+	if (con_expect_timeout(LOAD_READY, NULL, 0, CON_TIMEOUT_MS)) {
+		APP_ERROR("%s did not start\n", cmd)
+		    return -1;
+	}
+	return 0;
+}
+
+/**
+ * @brief y_download - send a file with ymodem or xmodem
+ *
+ * @param f_name - file name to send
+ * @param silent_status - no progress display
+ *
+ * @return -success/failure
+ */
+static signed int y_download(char *f_name, int silent_status)
+{
+	signed long size;
+	unsigned long long start, elapsed;
+	int ret;
+
+	size = f_size(f_name);
+	if (size <= 0) {
+		APP_ERROR("File Size Operation failed! File exists?\n")
+		    return -1;
+	}
+	if (f_open(f_name) != FILE_OK) {
+		APP_ERROR("File Open failed!File Exists & readable?\n")
+		    return -1;
+	}
+	memset(&y_tx, 0, sizeof(y_tx));
+	if (console_mode) {
+		con_set_echo(0);
+		ret = y_load(load_addr);
+		if (ret)
+			goto out;
+	}
+	ret = y_wait_start();
+	if (ret)
+		goto out;
+	if (!silent_status)
+		f_status_init(size, NORMAL_PRINT);
+	else
+		COLOR_PRINT(BLUE, "Transfer start (%ld bytes, %s)\n", size,
+			    xmodem ? "xmodem" : "ymodem");
+	start = t_now_us();
+	if (!xmodem) {
+		ret = y_send_frame(y_tx.frames[0],
+				   y_header_block(y_tx.frames[0], f_name, size),
+				   "File header");
+		if (ret)
+			goto out;
+	}
+	ret = y_send_data(size, silent_status);
+	if (!ret)
+		ret = y_send_end();
+	elapsed = t_now_us() - start;
+	COLOR_PRINT(BLUE, "\n%lu blocks, retransmitted: %lu (naks: %lu, "
+		    "timeouts: %lu) window: %d..%d - %.0f bytes/s\n",
+		    y_tx.blocks, y_tx.retransmits, y_tx.naks, y_tx.timeouts,
+		    y_tx.window_min, window_max,
+		    elapsed ? size * 1000000.0 / elapsed : 0.0);
+	if (!ret && console_mode)
+		ret = con_expect_timeout(prompt, NULL, 0, CON_TIMEOUT_MS);
+out:
+	if (!ret && silent_status)
+		COLOR_PRINT(GREEN, "Transfer complete\n");
+	f_close();
+	return ret;
+}
+
+/**
+ * @brief y_link_rtt - time the round trip of the console on the port
+ *
+ * U-Boot echoes what is typed at its prompt: a space is sent and timed
+ * till its echo, then a backspace takes it off again. An ack cannot come
+ * back faster than that, the target has to check the block on top.
+ *
+ * @return average round trip in us, 0 on failure
+ */
+static unsigned long long y_link_rtt(void)
+{
+	unsigned long long start, total = 0;
+	int i;
+
+	con_set_echo(0);
+	s_flush(NULL, NULL);
+	for (i = 0; i < RTT_SAMPLES; i++) {
+		start = t_now_us();
+		if (s_putc(' ') < 0 ||
+		    con_expect_timeout(" ", NULL, 0, CON_TIMEOUT_MS)) {
+			APP_ERROR("No echo from the console, at the prompt?\n")
+			    return 0;
+		}
+		total += t_now_us() - start;
+		if (s_putc('\b') < 0 ||
+		    con_expect_timeout("\b \b", NULL, 0, CON_TIMEOUT_MS)) {
+			APP_ERROR("No echo from the console, at the prompt?\n")
+			    return 0;
+		}
+	}
+	return total / RTT_SAMPLES;
+}
+
+/**
+ * @brief y_estimate - estimate what goes on the wire with ukermit's kermit
+ *
+ * Bytes both ways and turnarounds (kermit packets acked one by one,
+ * ymodem blocks a window at a time) are counted for the file, and the
+ * time they take at the given rate with 10 bits a byte is printed, plus
+ * a round trip for each turnaround if one was measured on the link. The
+ * measured time of a real transfer is in the summary each tool prints.
+ *
+ * @param f_name - file to look at
+ * @param baud - line rate
+ * @param rtt_us - round trip of the link, see y_link_rtt, 0 if unknown
+ *
+ * @return -success/failure
+ */
+static signed int y_estimate(char *f_name, unsigned long baud,
+			     unsigned long long rtt_us)
+{
+	signed long size, off, n;
+	unsigned char *data, out[K_CHUNK * 2];
+	unsigned long k_wire = 0, k_packets = 0, y_wire, y_blocks, tail;
+	unsigned long y_turns;
+	double rtt = rtt_us / 1000000.0;
+	unsigned int sum;
+
+	size = f_size(f_name);
+	if (size <= 0) {
+		APP_ERROR("File Size Operation failed! File exists?\n")
+		    return -1;
+	}
+	if (f_open(f_name) != FILE_OK) {
+		APP_ERROR("File Open failed!File Exists & readable?\n")
+		    return -1;
+	}
+	data = malloc(size);
+	if (data == NULL || f_read(data, size) != size) {
+		APP_ERROR("failed to read the file\n")
+		    free(data);
+		f_close();
+		return -1;
+	}
+	f_close();
+	for (off = 0; off < size; off += K_CHUNK) {
+		n = (size - off > K_CHUNK) ? K_CHUNK : size - off;
+		sum = 0;
+		k_wire += k_encode(out, data + off, n, &sum) +
+		    K_PACKET_OVERHEAD + K_ACK_SIZE;
+		k_packets++;
+	}
+	/* ETX */
+	k_wire++;
+	free(data);
+
+	y_blocks = size / Y_BLOCK_LARGE;
+	tail = size % Y_BLOCK_LARGE;
+	y_wire = y_blocks * (Y_FRAME_MAX + 1);
+	if (tail) {
+		y_wire += ((tail > Y_BLOCK_SMALL) ? Y_BLOCK_LARGE :
+			   Y_BLOCK_SMALL) + Y_HEADER + 2 + 1;
+		y_blocks++;
+	}
+	/* block 0 twice, EOT, C in between */
+	y_wire += 2 * (Y_HEADER + Y_BLOCK_SMALL + 2 + 1) + 2 + 2;
+	y_blocks += 2;
+	y_turns = (y_blocks + window_max - 1) / window_max;
+
+	if (rtt_us)
+		printf("Estimate for %ld bytes at %lu bps, with a %.2fms round "
+		       "trip for each turnaround:\n", size, baud,
+		       rtt_us / 1000.0);
+	else
+		printf("Estimate for %ld bytes at %lu bps, time without "
+		       "turnaround delays:\n", size, baud);
+	printf("  kermit: %9lu bytes on wire (%6.2f%%), %6lu packets, "
+	       "%8.2f s\n", k_wire, 100.0 * k_wire / size, k_packets,
+	       k_wire * 10.0 / baud + k_packets * rtt);
+	printf("  ymodem: %9lu bytes on wire (%6.2f%%), %6lu packets, "
+	       "%8.2f s (window %d)\n", y_wire, 100.0 * y_wire / size,
+	       y_blocks, y_wire * 10.0 / baud + y_turns * rtt, window_max);
+	printf("ymodem moves %.2fx fewer bytes and waits for %.1fx fewer acks\n",
+	       (double)k_wire / y_wire, (double)k_packets / y_turns);
+	return 0;
+}
+
+/**
+ * @brief usage help
+ *
+ * @param appname - application name
+ */
+static void usage(char *appname)
+{
+#ifdef __WIN32__
+#define PORT_NAME "COM1"
+#define F_NAME "c:\\temp\\u-boot.bin"
+#else
+#define PORT_NAME "/dev/ttyS0"
+#define F_NAME "~/tmp/u-boot.bin"
+#endif
+	printf("App description:\n"
+	       "---------------\n"
+	       "This Application helps download a file "
+	       "using U-Boot's ymodem (loady) or xmodem (loadx)\n"
+	       "over serial port\n\n"
+	       "Syntax:\n"
+	       "------\n"
+	       "%s -" PORT_ARG " portName -" DNLD_ARG " fileToDownload"
+	       " [-" XMODEM_ARG "] [-" WINDOW_ARG " window] [-"
+	       SILENT_STAT_ARG "]\n"
+	       "\t[-" ADDR_ARG " loadAddress [-" PROMPT_ARG " prompt]]\n"
+	       "%s -" ESTIMATE_ARG " -" DNLD_ARG " fileToCompare [-"
+	       ESTIMATE_BAUD_ARG " baudrate] [-" PORT_ARG " portName [-"
+	       WINDOW_ARG " window]]\n\n"
+	       "Where:\n" "-----\n"
+	       "portName - RS232 device being used. Example: " PORT_NAME "\n"
+	       "fileToDownload - file to be downloaded\n"
+	       XMODEM_ARG " - xmodem for loadx, default is ymodem for loady\n"
+	       "window - blocks to send ahead of acks, 1 to %d (default 1)\n"
+	       SILENT_STAT_ARG " - quiet status download status\n"
+	       "loadAddress - (hex) run loady/loadx to this address from "
+	       "here, it must not be\n\trunning already\n"
+	       "prompt - U-Boot prompt (default '" DEFAULT_PROMPT "')\n"
+	       ESTIMATE_ARG " - estimate bytes on wire, packets and time against "
+	       "ukermit for\n\tfileToCompare at baudrate (default %d). With "
+	       "a port, the round trip of\n\tthe console echo there is "
+	       "added for each ack turnaround\n\n"
+	       "Usage Example:\n" "-------------\n"
+	       "%s -" PORT_ARG " " PORT_NAME " -" DNLD_ARG " " F_NAME "\n"
+	       "%s -" PORT_ARG " " PORT_NAME " -" DNLD_ARG " " F_NAME " -"
+	       ADDR_ARG " 0x80000000 -" WINDOW_ARG " 4\n",
+	       appname, appname, Y_WINDOW_MAX, CONSOLE_BAUD, appname,
+	       appname);
+	REVPRINT();
+	LIC_PRINT();
+}
+
+/**
+ * @brief  application entry
+ *
+ * @param argc -argument count
+ * @param *argv - argument string
+ *
+ * @return fail/pass
+ */
+int main(int argc, char **argv)
+{
+	char *port = NULL;
+	char *download_file = NULL;
+	char *appname = argv[0];
+	int c;
+	int ret = 0;
+	int silent = 0;
+	int estimate = 0;
+	unsigned long estimate_baud = CONSOLE_BAUD;
+	unsigned long long rtt;
+
+	/* Option validation */
+	opterr = 0;
+
+	while ((c =
+		getopt(argc, argv,
+		       PORT_ARG ":" DNLD_ARG ":" SILENT_STAT_ARG XMODEM_ARG
+		       WINDOW_ARG ":" ADDR_ARG ":" PROMPT_ARG ":" ESTIMATE_ARG
+		       ESTIMATE_BAUD_ARG ":")) != -1)
+		switch (c) {
+		case PORT_ARG_C:
+			port = optarg;
+			break;
+		case DNLD_ARG_C:
+			download_file = optarg;
+			break;
+		case SILENT_STAT_C:
+			silent = 1;
+			break;
+		case XMODEM_ARG_C:
+			xmodem = 1;
+			break;
+		case WINDOW_ARG_C:
+			sscanf(optarg, "%d", &window_max);
+			if (window_max < 1 || window_max > Y_WINDOW_MAX) {
+				APP_ERROR("window must be 1 to %d\n",
+					  Y_WINDOW_MAX)
+				    return 1;
+			}
+			break;
+		case ADDR_ARG_C:
+			sscanf(optarg, "%lx", &load_addr);
+			console_mode = 1;
+			break;
+		case PROMPT_ARG_C:
+			prompt = optarg;
+			break;
+		case ESTIMATE_ARG_C:
+			estimate = 1;
+			break;
+		case ESTIMATE_BAUD_ARG_C:
+			sscanf(optarg, "%lu", &estimate_baud);
+			break;
+		case '?':
+			if ((optopt == DNLD_ARG_C) || (optopt == PORT_ARG_C)
+			    || (optopt == WINDOW_ARG_C) || (optopt == ADDR_ARG_C)
+			    || (optopt == PROMPT_ARG_C)
+			    || (optopt == ESTIMATE_BAUD_ARG_C)) {
+				APP_ERROR("Option -%c requires an argument.\n",
+					  optopt)
+			} else if (isprint(optopt)) {
+				APP_ERROR("Unknown option `-%c'.\n", optopt)
+			} else {
+				APP_ERROR("Unknown option character `\\x%x'.\n",
+					  optopt)
+			}
+			usage(appname);
+			return 1;
+		default:
+			abort();
+		}
+	if (estimate && download_file != NULL && estimate_baud) {
+		if (port == NULL)
+			return y_estimate(download_file, estimate_baud, 0);
+		/* the console is at its usual rate, whatever baudrate is */
+		if (s_open(port) != SERIAL_OK ||
+		    s_configure(CONSOLE_BAUD, NOPARITY, ONE_STOP_BIT, 8) !=
+		    SERIAL_OK) {
+			APP_ERROR("serial open failed\n")
+			    return -1;
+		}
+		rtt = y_link_rtt();
+		s_close();
+		if (!rtt)
+			return -1;
+		return y_estimate(download_file, estimate_baud, rtt);
+	}
+	if ((port == NULL) || (download_file == NULL)) {
+		APP_ERROR("Error: Not Enough Args\n")
+		    usage(appname);
+		return -1;
+	}
+
+	/* Setup the port */
+	ret = s_open(port);
+	if (ret != SERIAL_OK) {
+		APP_ERROR("serial open failed\n")
+		    return ret;
+	}
+	ret = s_configure(CONSOLE_BAUD, NOPARITY, ONE_STOP_BIT, 8);
+	if (ret != SERIAL_OK) {
+		s_close();
+		APP_ERROR("serial configure failed\n")
+		    return ret;
+	}
+
+	s_flush(NULL, NULL);
+	ret = y_download(download_file, silent);
+	if (ret != 0) {
+		s_close();
+		APP_ERROR("Data transmit failed\n")
+		    return ret;
+	}
+	ret = s_close();
+	if (ret != SERIAL_OK) {
+		APP_ERROR("serial close failed\n")
+		    return ret;
+	}
+	printf("\nFile Download completed\n");
+	return 0;
+}
@@ -0,0 +1,204 @@
+/**
+ * @file
+ * @brief The part of the libusb-1.0 API pusb uses, for the mock
+ *
+ * FileName: tools/pusb/libusb.h
+ *
+ * Building pusb with -Itools/pusb picks this header instead of the one of
+ * libusb, and tools/pusb/mockusb.c implements it with simulated boards.
+ * Names, values and layouts follow libusb-1.0, so pusb builds against
+ * either unchanged.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#ifndef __TOOLS_PUSB_LIBUSB_H
+#define __TOOLS_PUSB_LIBUSB_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#define LIBUSB_CALL
+
+typedef struct libusb_context libusb_context;
+typedef struct libusb_device libusb_device;
+typedef struct libusb_device_handle libusb_device_handle;
+typedef int libusb_hotplug_callback_handle;
+
+enum libusb_error {
+	LIBUSB_SUCCESS = 0,
+	LIBUSB_ERROR_IO = -1,
+	LIBUSB_ERROR_INVALID_PARAM = -2,
+	LIBUSB_ERROR_ACCESS = -3,
+	LIBUSB_ERROR_NO_DEVICE = -4,
+	LIBUSB_ERROR_NOT_FOUND = -5,
+	LIBUSB_ERROR_BUSY = -6,
+	LIBUSB_ERROR_TIMEOUT = -7,
+	LIBUSB_ERROR_OVERFLOW = -8,
+	LIBUSB_ERROR_PIPE = -9,
+	LIBUSB_ERROR_INTERRUPTED = -10,
+	LIBUSB_ERROR_NO_MEM = -11,
+	LIBUSB_ERROR_NOT_SUPPORTED = -12,
+	LIBUSB_ERROR_OTHER = -99,
+};
+
+enum libusb_transfer_status {
+	LIBUSB_TRANSFER_COMPLETED,
+	LIBUSB_TRANSFER_ERROR,
+	LIBUSB_TRANSFER_TIMED_OUT,
+	LIBUSB_TRANSFER_CANCELLED,
+	LIBUSB_TRANSFER_STALL,
+	LIBUSB_TRANSFER_NO_DEVICE,
+	LIBUSB_TRANSFER_OVERFLOW,
+};
+
+enum libusb_transfer_flags {
+	LIBUSB_TRANSFER_SHORT_NOT_OK = 1 << 0,
+	LIBUSB_TRANSFER_FREE_BUFFER = 1 << 1,
+	LIBUSB_TRANSFER_FREE_TRANSFER = 1 << 2,
+	LIBUSB_TRANSFER_ADD_ZERO_PACKET = 1 << 3,
+};
+
+enum libusb_transfer_type {
+	LIBUSB_TRANSFER_TYPE_BULK = 2,
+};
+
+enum libusb_capability {
+	LIBUSB_CAP_HAS_CAPABILITY = 0x0000,
+	LIBUSB_CAP_HAS_HOTPLUG = 0x0001,
+};
+
+typedef enum {
+	LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED = 1 << 0,
+	LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT = 1 << 1,
+} libusb_hotplug_event;
+
+typedef enum {
+	LIBUSB_HOTPLUG_NO_FLAGS = 0,
+	LIBUSB_HOTPLUG_ENUMERATE = 1 << 0,
+} libusb_hotplug_flag;
+
+#define LIBUSB_HOTPLUG_MATCH_ANY	-1
+
+struct libusb_device_descriptor {
+	uint8_t bLength;
+	uint8_t bDescriptorType;
+	uint16_t bcdUSB;
+	uint8_t bDeviceClass;
+	uint8_t bDeviceSubClass;
+	uint8_t bDeviceProtocol;
+	uint8_t bMaxPacketSize0;
+	uint16_t idVendor;
+	uint16_t idProduct;
+	uint16_t bcdDevice;
+	uint8_t iManufacturer;
+	uint8_t iProduct;
+	uint8_t iSerialNumber;
+	uint8_t bNumConfigurations;
+};
+
+struct libusb_transfer;
+typedef void (LIBUSB_CALL *libusb_transfer_cb_fn) (struct libusb_transfer *
+						   transfer);
+
+struct libusb_transfer {
+	libusb_device_handle *dev_handle;
+	uint8_t flags;
+	unsigned char endpoint;
+	unsigned char type;
+	unsigned int timeout;
+	enum libusb_transfer_status status;
+	int length;
+	int actual_length;
+	libusb_transfer_cb_fn callback;
+	void *user_data;
+	unsigned char *buffer;
+	int num_iso_packets;
+};
+
+typedef int (LIBUSB_CALL *libusb_hotplug_callback_fn) (libusb_context *ctx,
+						       libusb_device *device,
+						       libusb_hotplug_event
+						       event,
+						       void *user_data);
+
+static inline void libusb_fill_bulk_transfer(struct libusb_transfer *transfer,
+					     libusb_device_handle *dev_handle,
+					     unsigned char endpoint,
+					     unsigned char *buffer, int length,
+					     libusb_transfer_cb_fn callback,
+					     void *user_data,
+					     unsigned int timeout)
+{
+	transfer->dev_handle = dev_handle;
+	transfer->endpoint = endpoint;
+	transfer->type = LIBUSB_TRANSFER_TYPE_BULK;
+	transfer->timeout = timeout;
+	transfer->buffer = buffer;
+	transfer->length = length;
+	transfer->user_data = user_data;
+	transfer->callback = callback;
+}
+
+int libusb_init(libusb_context **ctx);
+void libusb_exit(libusb_context *ctx);
+const char *libusb_error_name(int errcode);
+int libusb_has_capability(uint32_t capability);
+
+ssize_t libusb_get_device_list(libusb_context *ctx, libusb_device ***list);
+void libusb_free_device_list(libusb_device **list, int unref_devices);
+libusb_device *libusb_ref_device(libusb_device *dev);
+void libusb_unref_device(libusb_device *dev);
+int libusb_get_device_descriptor(libusb_device *dev,
+				 struct libusb_device_descriptor *desc);
+uint8_t libusb_get_bus_number(libusb_device *dev);
+uint8_t libusb_get_device_address(libusb_device *dev);
+int libusb_get_port_numbers(libusb_device *dev, uint8_t *port_numbers,
+			    int port_numbers_len);
+
+int libusb_open(libusb_device *dev, libusb_device_handle **dev_handle);
+void libusb_close(libusb_device_handle *dev_handle);
+int libusb_set_configuration(libusb_device_handle *dev, int configuration);
+int libusb_claim_interface(libusb_device_handle *dev, int interface_number);
+int libusb_release_interface(libusb_device_handle *dev,
+			     int interface_number);
+int libusb_clear_halt(libusb_device_handle *dev, unsigned char endpoint);
+
+struct libusb_transfer *libusb_alloc_transfer(int iso_packets);
+int libusb_submit_transfer(struct libusb_transfer *transfer);
+int libusb_cancel_transfer(struct libusb_transfer *transfer);
+void libusb_free_transfer(struct libusb_transfer *transfer);
+
+int libusb_handle_events_timeout_completed(libusb_context *ctx,
+					   struct timeval *tv,
+					   int *completed);
+
+int libusb_hotplug_register_callback(libusb_context *ctx, int events,
+				     int flags, int vendor_id, int product_id,
+				     int dev_class,
+				     libusb_hotplug_callback_fn cb_fn,
+				     void *user_data,
+				     libusb_hotplug_callback_handle *
+				     callback_handle);
+void libusb_hotplug_deregister_callback(libusb_context *ctx,
+					libusb_hotplug_callback_handle
+					callback_handle);
+
+#endif				/* __TOOLS_PUSB_LIBUSB_H */
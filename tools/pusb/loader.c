@@ -0,0 +1,176 @@
+/**
+ * @file
+ * @brief Reference second stage loader for pusb: the protocol
+ *
+ * FileName: tools/pusb/loader.c
+ *
+ * Implements the APIs in tools/pusb/loader.h
+ *
+ * Nothing from a C library is used, so this builds for a bare target as
+ * it is. The CRC32 goes a nibble at a time with a 16 entry table, small
+ * enough for the internal RAM a loader runs from.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#include "loader.h"
+
+static const unsigned int ld_crc_table[16] = {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+	0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+	0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+/**
+ * @brief ld_crc32 - carry on a CRC32 over more data
+ *
+ * @param crc - CRC32 so far, 0 to start
+ * @param p - data
+ * @param len - number of bytes
+ *
+ * @return CRC32 including the data
+ */
+static unsigned int ld_crc32(unsigned int crc, const unsigned char *p,
+			     unsigned int len)
+{
+	crc = ~crc;
+	while (len--) {
+		crc ^= *p++;
+		crc = (crc >> 4) ^ ld_crc_table[crc & 0x0F];
+		crc = (crc >> 4) ^ ld_crc_table[crc & 0x0F];
+	}
+	return ~crc;
+}
+
+/**
+ * @brief ld_word - little endian word out of the bytes received
+ *
+ * @param p - 4 bytes
+ *
+ * @return word
+ */
+static unsigned int ld_word(const unsigned char *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+/**
+ * @brief ld_put_word - little endian word into the reply
+ *
+ * @param p - 4 bytes
+ * @param w - word
+ */
+static void ld_put_word(unsigned char *p, unsigned int w)
+{
+	p[0] = w;
+	p[1] = w >> 8;
+	p[2] = w >> 16;
+	p[3] = w >> 24;
+}
+
+/**
+ * @brief ld_init - get ready for the first header
+ *
+ * @param l - loader
+ * @param ctx - passed to ld_store
+ */
+void ld_init(struct ld *l, void *ctx)
+{
+	l->state = LD_HEADER;
+	l->have = 0;
+	l->ctx = ctx;
+}
+
+/**
+ * @brief ld_header - act on a complete header
+ *
+ * @param l - loader
+ *
+ * @return LD_MORE, LD_REPLY, LD_GO or LD_ERROR
+ */
+static int ld_header(struct ld *l)
+{
+	unsigned int command = ld_word(l->word);
+
+	l->have = 0;
+	if (command == LD_JUMP) {
+		l->entry = ld_word(l->word + 4);
+		return LD_GO;
+	}
+	if (command != LD_LOAD)
+		return LD_ERROR;
+	l->addr = ld_word(l->word + 4);
+	l->size = ld_word(l->word + 8);
+	l->done = 0;
+	l->crc = 0;
+	l->state = l->size ? LD_DATA : LD_CRC;
+	return LD_MORE;
+}
+
+/**
+ * @brief ld_input - take bytes received from the host
+ *
+ * @param l - loader
+ * @param buf - bytes received
+ * @param len - number of bytes
+ * @param used - gets the number of bytes taken
+ *
+ * @return LD_MORE, LD_REPLY, LD_GO or LD_ERROR
+ */
+int ld_input(struct ld *l, const unsigned char *buf, unsigned int len,
+	     unsigned int *used)
+{
+	unsigned int pos = 0, n;
+	int ret = LD_MORE;
+
+	while (pos < len && ret == LD_MORE) {
+		switch (l->state) {
+		case LD_HEADER:
+			l->word[l->have++] = buf[pos++];
+			if (l->have == LD_HEADER_SIZE)
+				ret = ld_header(l);
+			break;
+		case LD_DATA:
+			n = l->size - l->done;
+			if (n > len - pos)
+				n = len - pos;
+			ld_store(l->ctx, l->addr + l->done, buf + pos, n);
+			l->crc = ld_crc32(l->crc, buf + pos, n);
+			l->done += n;
+			pos += n;
+			if (l->done == l->size)
+				l->state = LD_CRC;
+			break;
+		case LD_CRC:
+			l->word[l->have++] = buf[pos++];
+			if (l->have < 4)
+				break;
+			ld_put_word(l->reply, ld_word(l->word) == l->crc ?
+				    LD_STATUS_OK : LD_STATUS_CRC);
+			ld_put_word(l->reply + 4, l->crc);
+			l->have = 0;
+			l->state = LD_HEADER;
+			ret = LD_REPLY;
+			break;
+		}
+	}
+	*used = pos;
+	return ret;
+}
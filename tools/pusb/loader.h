@@ -0,0 +1,119 @@
+/**
+ * @file
+ * @brief Reference second stage loader for pusb: the protocol
+ *
+ * FileName: tools/pusb/loader.h
+ *
+ * Once the boot ROM runs the loader pusb sent it, the loader enumerates
+ * with USB ids of its own (pusb -l) and takes each image (pusb -s) as:
+ * - a header of three little endian words: LD_LOAD, address and size
+ * - the data, split in transfers however the host likes
+ * - the CRC32 of the data (the one of zlib and U-Boot), one word
+ * It then answers with two words, LD_STATUS_xxx and the CRC32 of what it
+ * stored, which pusb reads with an IN transfer. A header of LD_JUMP, the
+ * entry address and 0 (pusb -j) ends the session.
+ *
+ * This is the part of a loader which does not depend on the SoC. A port
+ * runs its USB driver, feeds what it receives to ld_input and sends the
+ * answer or jumps when told to, and provides ld_store to put the data in
+ * memory. tools/pusb/mockusb.c is such a port, on the host.
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#ifndef __TOOLS_PUSB_LOADER_H
+#define __TOOLS_PUSB_LOADER_H
+
+/** Header commands */
+#define LD_LOAD			0x4C4F4144	/* "LOAD" */
+#define LD_JUMP			0x4A554D50	/* "JUMP" */
+
+/** Status answered to an image */
+#define LD_STATUS_OK		0
+#define LD_STATUS_CRC		1
+
+/** What ld_input wants the port to do */
+#define LD_MORE			0	/* nothing, feed more */
+#define LD_REPLY		1	/* send reply, 8 bytes */
+#define LD_GO			2	/* jump to entry */
+#define LD_ERROR		-1	/* bad header, give up */
+
+/** Where the loader is in an image */
+#define LD_HEADER		0
+#define LD_DATA			1
+#define LD_CRC			2
+
+#define LD_HEADER_SIZE		12
+#define LD_REPLY_SIZE		8
+
+/** State of a loader */
+struct ld {
+	int state;
+	/** header or CRC word being received */
+	unsigned char word[LD_HEADER_SIZE];
+	unsigned int have;
+	/** image being loaded: where, how much, how much stored */
+	unsigned int addr;
+	unsigned int size;
+	unsigned int done;
+	unsigned int crc;
+	/** with LD_REPLY: status and CRC32, little endian */
+	unsigned char reply[LD_REPLY_SIZE];
+	/** with LD_GO: where to jump */
+	unsigned int entry;
+	/** given back to ld_store */
+	void *ctx;
+};
+
+/**
+ * @brief ld_init - get ready for the first header
+ *
+ * @param l - loader
+ * @param ctx - passed to ld_store
+ */
+void ld_init(struct ld *l, void *ctx);
+
+/**
+ * @brief ld_input - take bytes received from the host
+ *
+ * Stops after the bytes which complete an image or a jump, the rest is to
+ * be fed again once the reply is sent.
+ *
+ * @param l - loader
+ * @param buf - bytes received
+ * @param len - number of bytes
+ * @param used - gets the number of bytes taken
+ *
+ * @return LD_MORE, LD_REPLY, LD_GO or LD_ERROR
+ */
+int ld_input(struct ld *l, const unsigned char *buf, unsigned int len,
+	     unsigned int *used);
+
+/**
+ * @brief ld_store - put data of an image in memory, provided by the port
+ *
+ * @param ctx - as given to ld_init
+ * @param addr - where it goes
+ * @param data - data received
+ * @param len - number of bytes
+ */
+void ld_store(void *ctx, unsigned int addr, const unsigned char *data,
+	      unsigned int len);
+
+#endif				/* __TOOLS_PUSB_LOADER_H */
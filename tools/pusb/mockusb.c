@@ -0,0 +1,860 @@
+/**
+ * @file
+ * @brief libusb for pusb tests: simulated boot ROMs and loaders
+ *
+ * FileName: tools/pusb/mockusb.c
+ *
+ * Implements the APIs in tools/pusb/libusb.h without hardware. Boards
+ * enumerate with the ids of the OMAP boot ROM, answer GET_ASICID with an
+ * ASIC ID and take a DOWNLOAD as the ROM does, storing the image in
+ * <MOCK_OUT><board>.bin. Transfers take the time the bus would.
+ *
+ * With MOCK_LOADER_PID, each board then comes back with the ids of a
+ * second stage loader running the reference loader of
+ * tools/pusb/loader.c, which stores image n in <MOCK_OUT><board>_<n>.bin.
+ *
+ * Set from the environment:
+ * - MOCK_DEVICES: boards (1), MOCK_APPEAR_MS: when the first one comes
+ *   (0), MOCK_STAGGER_MS: how much later each next one does (0)
+ * - MOCK_SOC: chip ids in hex, a comma list cycled over the boards
+ *   (3430), MOCK_ROMREV: ROM revision (0x07), MOCK_PID: product id (from
+ *   the chip)
+ * - MOCK_WINDOW_MS: how long the ROM waits for DOWNLOAD (3000)
+ * - MOCK_CMD_READY_MS, MOCK_SIZE_READY_MS: how long the ROM NAKs the
+ *   command after the ASIC ID and the size after the command (0)
+ * - MOCK_LATE_TAKE: the command and size words complete as timed out
+ *   with all of them taken
+ * - MOCK_STALL_CMD: the first command stalls until the halt is cleared
+ * - MOCK_BPS: bulk OUT bytes/s (16000000), MOCK_SCHED_US: submit to bus
+ *   latency (250), MOCK_SCAN_US: cost of a bus scan (300)
+ * - MOCK_NO_HOTPLUG: no hotplug, pusb has to poll
+ * - MOCK_OUT: prefix of the files stored (board), MOCK_LOG: trace
+ * - MOCK_LOADER_PID, MOCK_LOADER_VID (0x0451): ids of the loader, which
+ *   comes MOCK_LOADER_MS (100) after the ROM jumped to it
+ * - MOCK_LOADER_CORRUPT: image n has a byte flipped on the way
+ * - MOCK_LOADER_NEVER: the loader never comes
+ *
+ */
+/*
+ * (C) Copyright 2010
+ * Texas Instruments, <www.ti.com>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation version 2.
+ *
+ * This program is distributed "as is" WITHOUT ANY WARRANTY of any kind,
+ * whether express or implied; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+ * MA 02111-1307 USA
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "libusb.h"
+#include "loader.h"
+
+#define MAX_DEVICES		64
+#define MAX_HOTPLUG		8
+#define ROM_VID			0x0451
+#define ROM_GET_ASICID		0xF0030003
+#define ROM_DOWNLOAD		0xF0030002
+/** a board is gone this long after the ROM or the loader jumped */
+#define JUMP_US			5000
+#define LOADER_ALIVE_US		600000000LL
+
+/** What a device is waiting for */
+#define R_COMMAND		0
+#define R_SIZE			1
+#define R_DATA			2
+#define R_DONE			3
+#define R_LOADER		4
+
+#define LOG(ARGS...) \
+	do { \
+		if (mock_log) { \
+			fprintf(stderr, "[mock %lld] ", \
+				(now_us() - t0) / 1000); \
+			fprintf(stderr, ARGS); \
+		} \
+	} while (0)
+
+struct libusb_device {
+	int board;
+	int refs;
+	int open;
+	uint16_t vid, pid;
+	/** when it enumerates and leaves, us */
+	long long appear, gone;
+	int announced, left_announced;
+	int state;
+	/* ROM */
+	unsigned int soc, romrev;
+	int asic_pending;
+	long long command_ready, size_ready;
+	int stall;
+	unsigned long need, total;
+	FILE *out;
+	/* loader */
+	struct ld ld;
+	int image;
+	int reply_pending;
+};
+
+struct libusb_device_handle {
+	libusb_device *dev;
+	/** when the last OUT and IN transfers ended */
+	long long last_end[2];
+};
+
+/** A transfer and its place in the queue */
+struct mock_transfer {
+	struct libusb_transfer t;
+	long long submitted;
+	int active, cancelled;
+	struct mock_transfer *next;
+};
+
+static long long t0;
+static int mock_log;
+static libusb_device devices[MAX_DEVICES];
+static int num_devices;
+static struct mock_transfer *queue;
+static long bps, sched_us, scan_us;
+static long window_ms, command_ready_ms, size_ready_ms;
+static int late_take, stall_command, no_hotplug;
+static const char *out_prefix;
+static long loader_pid, loader_vid, loader_ms, loader_corrupt;
+static int loader_never;
+
+static struct {
+	int used;
+	libusb_hotplug_callback_fn fn;
+	void *user_data;
+	int events, vid, pid;
+} hotplug[MAX_HOTPLUG];
+
+static long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static long env(const char *name, long def)
+{
+	char *v = getenv(name);
+
+	return v ? strtol(v, NULL, 0) : def;
+}
+
+static int present(libusb_device *d, long long t)
+{
+	return t >= d->appear && t < d->gone;
+}
+
+int libusb_init(libusb_context **ctx)
+{
+	int i, n = env("MOCK_DEVICES", 1), nsoc = 1;
+	long appear = env("MOCK_APPEAR_MS", 0);
+	long stagger = env("MOCK_STAGGER_MS", 0);
+	unsigned int socs[16] = { 0x3430 };
+	char *s = getenv("MOCK_SOC"), *tok;
+
+	if (ctx)
+		*ctx = NULL;
+	if (t0)
+		return 0;
+	t0 = now_us();
+	mock_log = env("MOCK_LOG", 0);
+	bps = env("MOCK_BPS", 16000000);
+	sched_us = env("MOCK_SCHED_US", 250);
+	scan_us = env("MOCK_SCAN_US", 300);
+	window_ms = env("MOCK_WINDOW_MS", 3000);
+	command_ready_ms = env("MOCK_CMD_READY_MS", 0);
+	size_ready_ms = env("MOCK_SIZE_READY_MS", 0);
+	late_take = env("MOCK_LATE_TAKE", 0);
+	stall_command = env("MOCK_STALL_CMD", 0);
+	no_hotplug = env("MOCK_NO_HOTPLUG", 0);
+	loader_pid = env("MOCK_LOADER_PID", 0);
+	loader_vid = env("MOCK_LOADER_VID", ROM_VID);
+	loader_ms = env("MOCK_LOADER_MS", 100);
+	loader_corrupt = env("MOCK_LOADER_CORRUPT", -1);
+	loader_never = env("MOCK_LOADER_NEVER", 0);
+	out_prefix = getenv("MOCK_OUT") ? getenv("MOCK_OUT") : "board";
+	if (s) {
+		s = strdup(s);
+		nsoc = 0;
+		for (tok = strtok(s, ","); tok && nsoc < 16;
+		     tok = strtok(NULL, ","))
+			socs[nsoc++] = strtoul(tok, NULL, 16);
+		free(s);
+		if (!nsoc)
+			socs[nsoc++] = 0x3430;
+	}
+	for (i = 0; i < n && i < MAX_DEVICES; i++) {
+		libusb_device *d = &devices[num_devices++];
+
+		memset(d, 0, sizeof(*d));
+		d->board = i;
+		d->vid = ROM_VID;
+		d->soc = socs[i % nsoc];
+		if (d->soc == 0x4460)
+			d->pid = 0xD010;
+		else
+			d->pid = ((d->soc >> 12) == 4) ? 0xD00F : 0xD009;
+		d->pid = env("MOCK_PID", d->pid);
+		d->romrev = env("MOCK_ROMREV", 0x07);
+		d->appear = t0 + (appear + i * stagger) * 1000;
+		d->gone = d->appear + window_ms * 1000;
+		d->asic_pending = 1;
+		d->stall = stall_command;
+		d->state = R_COMMAND;
+	}
+	return 0;
+}
+
+void libusb_exit(libusb_context *ctx)
+{
+}
+
+const char *libusb_error_name(int errcode)
+{
+	switch (errcode) {
+	case LIBUSB_SUCCESS:
+		return "LIBUSB_SUCCESS";
+	case LIBUSB_ERROR_IO:
+		return "LIBUSB_ERROR_IO";
+	case LIBUSB_ERROR_NO_DEVICE:
+		return "LIBUSB_ERROR_NO_DEVICE";
+	case LIBUSB_ERROR_NOT_FOUND:
+		return "LIBUSB_ERROR_NOT_FOUND";
+	case LIBUSB_ERROR_BUSY:
+		return "LIBUSB_ERROR_BUSY";
+	case LIBUSB_ERROR_TIMEOUT:
+		return "LIBUSB_ERROR_TIMEOUT";
+	case LIBUSB_ERROR_PIPE:
+		return "LIBUSB_ERROR_PIPE";
+	case LIBUSB_ERROR_NOT_SUPPORTED:
+		return "LIBUSB_ERROR_NOT_SUPPORTED";
+	}
+	return "LIBUSB_ERROR_OTHER";
+}
+
+int libusb_has_capability(uint32_t capability)
+{
+	if (capability == LIBUSB_CAP_HAS_HOTPLUG)
+		return !no_hotplug;
+	return 1;
+}
+
+ssize_t libusb_get_device_list(libusb_context *ctx, libusb_device ***list)
+{
+	long long t = now_us();
+	int i, n = 0;
+	libusb_device **l = calloc(num_devices + 1, sizeof(*l));
+
+	if (!l)
+		return LIBUSB_ERROR_NO_MEM;
+	usleep(scan_us);
+	for (i = 0; i < num_devices; i++) {
+		if (present(&devices[i], t)) {
+			devices[i].refs++;
+			l[n++] = &devices[i];
+		}
+	}
+	*list = l;
+	return n;
+}
+
+void libusb_free_device_list(libusb_device **list, int unref_devices)
+{
+	int i;
+
+	if (unref_devices)
+		for (i = 0; list[i]; i++)
+			list[i]->refs--;
+	free(list);
+}
+
+libusb_device *libusb_ref_device(libusb_device *dev)
+{
+	dev->refs++;
+	return dev;
+}
+
+void libusb_unref_device(libusb_device *dev)
+{
+	dev->refs--;
+}
+
+int libusb_get_device_descriptor(libusb_device *dev,
+				 struct libusb_device_descriptor *desc)
+{
+	memset(desc, 0, sizeof(*desc));
+	desc->bLength = 18;
+	desc->idVendor = dev->vid;
+	desc->idProduct = dev->pid;
+	desc->bNumConfigurations = 1;
+	return 0;
+}
+
+uint8_t libusb_get_bus_number(libusb_device *dev)
+{
+	return 1;
+}
+
+uint8_t libusb_get_device_address(libusb_device *dev)
+{
+	return 10 + (dev - devices);
+}
+
+/* boards hang off hubs of 7 ports */
+int libusb_get_port_numbers(libusb_device *dev, uint8_t *port_numbers,
+			    int port_numbers_len)
+{
+	if (port_numbers_len < 2)
+		return LIBUSB_ERROR_OVERFLOW;
+	port_numbers[0] = 1 + dev->board / 7;
+	port_numbers[1] = 1 + dev->board % 7;
+	return 2;
+}
+
+int libusb_open(libusb_device *dev, libusb_device_handle **dev_handle)
+{
+	if (!present(dev, now_us()))
+		return LIBUSB_ERROR_NO_DEVICE;
+	*dev_handle = calloc(1, sizeof(**dev_handle));
+	if (!*dev_handle)
+		return LIBUSB_ERROR_NO_MEM;
+	(*dev_handle)->dev = dev;
+	dev->open++;
+	LOG("open board %d (%04x:%04x)\n", dev->board, dev->vid, dev->pid);
+	return 0;
+}
+
+void libusb_close(libusb_device_handle *dev_handle)
+{
+	dev_handle->dev->open--;
+	free(dev_handle);
+}
+
+int libusb_set_configuration(libusb_device_handle *dev, int configuration)
+{
+	return present(dev->dev, now_us()) ? 0 : LIBUSB_ERROR_NO_DEVICE;
+}
+
+int libusb_claim_interface(libusb_device_handle *dev, int interface_number)
+{
+	return present(dev->dev, now_us()) ? 0 : LIBUSB_ERROR_NO_DEVICE;
+}
+
+int libusb_release_interface(libusb_device_handle *dev, int interface_number)
+{
+	return present(dev->dev, now_us()) ? 0 : LIBUSB_ERROR_NO_DEVICE;
+}
+
+int libusb_clear_halt(libusb_device_handle *dev, unsigned char endpoint)
+{
+	LOG("clear halt board %d ep %02x\n", dev->dev->board, endpoint);
+	if (!(endpoint & 0x80))
+		dev->dev->stall = 0;
+	return 0;
+}
+
+struct libusb_transfer *libusb_alloc_transfer(int iso_packets)
+{
+	struct mock_transfer *m = calloc(1, sizeof(*m));
+
+	return m ? &m->t : NULL;
+}
+
+void libusb_free_transfer(struct libusb_transfer *transfer)
+{
+	if (!transfer)
+		return;
+	if (transfer->flags & LIBUSB_TRANSFER_FREE_BUFFER)
+		free(transfer->buffer);
+	free((struct mock_transfer *)transfer);
+}
+
+int libusb_submit_transfer(struct libusb_transfer *transfer)
+{
+	struct mock_transfer *m = (struct mock_transfer *)transfer, **p;
+
+	if (m->active)
+		return LIBUSB_ERROR_BUSY;
+	if (!present(transfer->dev_handle->dev, now_us()))
+		return LIBUSB_ERROR_NO_DEVICE;
+	m->active = 1;
+	m->cancelled = 0;
+	m->submitted = now_us();
+	m->next = NULL;
+	for (p = &queue; *p; p = &(*p)->next) ;
+	*p = m;
+	return 0;
+}
+
+int libusb_cancel_transfer(struct libusb_transfer *transfer)
+{
+	struct mock_transfer *m = (struct mock_transfer *)transfer;
+
+	if (!m->active)
+		return LIBUSB_ERROR_NOT_FOUND;
+	m->cancelled = 1;
+	return 0;
+}
+
+/**
+ * @brief asic_id - what the ROM answers to GET_ASICID
+ *
+ * @param d - board
+ * @param buf - gets the ASIC ID, 128 bytes will do
+ *
+ * @return its size
+ */
+static int asic_id(libusb_device *d, unsigned char *buf)
+{
+	int omap4 = (d->soc >> 12) == 4, n = 0, i;
+
+	buf[n++] = 5;		/* items */
+	buf[n++] = 0x01;	/* ID */
+	buf[n++] = 0x05;
+	buf[n++] = 0x01;
+	buf[n++] = d->soc >> 8;
+	buf[n++] = d->soc & 0xFF;
+	buf[n++] = 0x00;
+	buf[n++] = d->romrev;
+	buf[n++] = 0x13;	/* secure mode */
+	buf[n++] = 0x02;
+	buf[n++] = 0x01;
+	buf[n++] = 0x00;
+	buf[n++] = 0x12;	/* public ID */
+	buf[n++] = 0x15;
+	buf[n++] = 0x01;
+	for (i = 0; i < 20; i++)
+		buf[n++] = 0xA0 + i;
+	buf[n++] = 0x14;	/* root key hash */
+	buf[n++] = omap4 ? 0x21 : 0x15;
+	buf[n++] = 0x01;
+	for (i = 0; i < (omap4 ? 32 : 20); i++)
+		buf[n++] = 0xB0 + i;
+	buf[n++] = 0x15;	/* checksum */
+	buf[n++] = 0x09;
+	buf[n++] = 0x01;
+	for (i = 0; i < 8; i++)
+		buf[n++] = 0xC0 + i;
+	return n;
+}
+
+/**
+ * @brief head_time - when the transfer first in its endpoint queue ends
+ *
+ * @param m - transfer
+ * @param status - gets how it ends
+ *
+ * @return time in us, -1 if it would wait for ever
+ */
+static long long head_time(struct mock_transfer *m, int *status)
+{
+	libusb_device_handle *h = m->t.dev_handle;
+	libusb_device *d = h->dev;
+	int in = (m->t.endpoint & 0x80) ? 1 : 0;
+	long long start = m->submitted + sched_us, ready = 0, end, deadline;
+
+	deadline = m->t.timeout ? m->submitted + m->t.timeout * 1000LL : -1;
+	*status = LIBUSB_TRANSFER_COMPLETED;
+	if (m->cancelled) {
+		*status = LIBUSB_TRANSFER_CANCELLED;
+		return m->submitted;
+	}
+	if (start < h->last_end[in])
+		start = h->last_end[in];
+	if (in) {
+		if (!d->asic_pending && !d->reply_pending)
+			ready = -1;
+		end = start + 100;
+	} else {
+		if (d->stall && d->state == R_COMMAND) {
+			*status = LIBUSB_TRANSFER_STALL;
+			return start;
+		}
+		if (d->state == R_COMMAND)
+			ready = d->command_ready;
+		else if (d->state == R_SIZE)
+			ready = d->size_ready;
+		else if (d->state == R_DONE)
+			ready = -1;
+		if (ready > start)
+			start = ready;
+		end = start + (long long)m->t.length * 1000000 / bps;
+	}
+	/* the board leaves before it would end */
+	if (d->gone <= (ready < 0 ? (deadline < 0 ? d->gone : deadline) : end)
+	    && (deadline < 0 || d->gone < deadline)) {
+		*status = LIBUSB_TRANSFER_NO_DEVICE;
+		return d->gone > m->submitted ? d->gone : m->submitted;
+	}
+	if (ready < 0 || (deadline >= 0 && end > deadline)) {
+		if (deadline < 0)
+			return -1;
+		*status = LIBUSB_TRANSFER_TIMED_OUT;
+		return deadline;
+	}
+	return end;
+}
+
+/* the memory of the loader of board ctx: a file per image */
+void ld_store(void *ctx, unsigned int addr, const unsigned char *data,
+	      unsigned int len)
+{
+	libusb_device *d = ctx;
+	char name[256];
+
+	if (!d->out) {
+		snprintf(name, sizeof(name), "%s%d_%d.bin", out_prefix,
+			 d->board, d->image);
+		d->out = fopen(name, "wb");
+		LOG("loader %d image %d: %u bytes at 0x%08X\n", d->board,
+		    d->image, d->ld.size, d->ld.addr);
+	}
+	if (d->out)
+		fwrite(data, 1, len, d->out);
+}
+
+/**
+ * @brief loader_out - a loader got an OUT transfer
+ *
+ * @param d - board
+ * @param buf - data
+ * @param len - its size
+ * @param t - when, us
+ */
+static void loader_out(libusb_device *d, unsigned char *buf, int len,
+		       long long t)
+{
+	unsigned char flipped;
+	unsigned int used;
+	int ret;
+
+	while (len) {
+		/* the buffer is the host's: flip a copy of the first byte */
+		if (d->image == loader_corrupt && d->ld.state == LD_DATA &&
+		    !d->ld.done) {
+			LOG("loader %d image %d corrupted\n", d->board,
+			    d->image);
+			flipped = buf[0] ^ 1;
+			ret = ld_input(&d->ld, &flipped, 1, &used);
+		} else {
+			ret = ld_input(&d->ld, buf, len, &used);
+		}
+		buf += used;
+		len -= used;
+		switch (ret) {
+		case LD_REPLY:
+			if (d->out)
+				fclose(d->out);
+			d->out = NULL;
+			LOG("loader %d image %d: CRC 0x%08X\n", d->board,
+			    d->image, d->ld.crc);
+			d->reply_pending = 1;
+			d->image++;
+			break;
+		case LD_GO:
+			LOG("loader %d jump to 0x%08X\n", d->board,
+			    d->ld.entry);
+			d->state = R_DONE;
+			d->gone = t + JUMP_US;
+			return;
+		case LD_ERROR:
+			LOG("loader %d bad header\n", d->board);
+			return;
+		}
+	}
+}
+
+/**
+ * @brief rom_jump - ROM done, the loader comes next if there is one
+ *
+ * @param d - board
+ * @param t - when, us
+ */
+static void rom_jump(libusb_device *d, long long t)
+{
+	libusb_device *l;
+
+	d->state = R_DONE;
+	d->gone = t + JUMP_US;
+	LOG("board %d booting %lu bytes\n", d->board, d->total);
+	if (!loader_pid || loader_never || num_devices == MAX_DEVICES)
+		return;
+	l = &devices[num_devices++];
+	memset(l, 0, sizeof(*l));
+	l->board = d->board;
+	l->vid = loader_vid;
+	l->pid = loader_pid;
+	l->state = R_LOADER;
+	l->appear = d->gone + loader_ms * 1000;
+	l->gone = l->appear + LOADER_ALIVE_US;
+	ld_init(&l->ld, l);
+}
+
+/**
+ * @brief rom_out - a ROM got an OUT transfer
+ *
+ * @param d - board
+ * @param buf - data
+ * @param len - its size
+ * @param t - when, us
+ */
+static void rom_out(libusb_device *d, unsigned char *buf, int len,
+		    long long t)
+{
+	unsigned int w = 0;
+	char name[256];
+
+	if (len >= 4)
+		w = buf[0] | buf[1] << 8 | buf[2] << 16 |
+		    (unsigned int)buf[3] << 24;
+	switch (d->state) {
+	case R_COMMAND:
+		LOG("board %d command 0x%08X\n", d->board, w);
+		if (len == 4 && w == ROM_GET_ASICID) {
+			d->asic_pending = 1;
+		} else if (len == 4 && w == ROM_DOWNLOAD) {
+			d->state = R_SIZE;
+			d->size_ready = t + size_ready_ms * 1000;
+		}
+		break;
+	case R_SIZE:
+		LOG("board %d size %u\n", d->board, w);
+		d->need = d->total = w;
+		d->state = R_DATA;
+		snprintf(name, sizeof(name), "%s%d.bin", out_prefix, d->board);
+		d->out = fopen(name, "wb");
+		break;
+	case R_DATA:
+		if ((unsigned long)len > d->need)
+			len = d->need;
+		if (d->out)
+			fwrite(buf, 1, len, d->out);
+		d->need -= len;
+		if (d->need)
+			break;
+		if (d->out)
+			fclose(d->out);
+		d->out = NULL;
+		rom_jump(d, t);
+		break;
+	}
+}
+
+/**
+ * @brief complete - end a transfer and call back
+ *
+ * @param m - transfer
+ * @param status - how it ends
+ * @param t - when, us
+ */
+static void complete(struct mock_transfer *m, int status, long long t)
+{
+	libusb_device_handle *h = m->t.dev_handle;
+	libusb_device *d = h->dev;
+	int in = (m->t.endpoint & 0x80) ? 1 : 0, word, n;
+	unsigned char id[128];
+	struct mock_transfer **p;
+
+	for (p = &queue; *p != m; p = &(*p)->next) ;
+	*p = m->next;
+	m->active = 0;
+	m->t.status = status;
+	m->t.actual_length = 0;
+	if (status != LIBUSB_TRANSFER_COMPLETED) {
+		if (status != LIBUSB_TRANSFER_CANCELLED)
+			LOG("board %d ep %02x status %d\n", d->board,
+			    m->t.endpoint, status);
+	} else if (in && d->state == R_LOADER) {
+		n = (m->t.length < LD_REPLY_SIZE) ? m->t.length : LD_REPLY_SIZE;
+		memcpy(m->t.buffer, d->ld.reply, n);
+		m->t.actual_length = n;
+		d->reply_pending = 0;
+	} else if (in) {
+		n = asic_id(d, id);
+		if (n > m->t.length) {
+			m->t.status = LIBUSB_TRANSFER_OVERFLOW;
+			n = m->t.length;
+		}
+		memcpy(m->t.buffer, id, n);
+		m->t.actual_length = n;
+		d->asic_pending = 0;
+		d->command_ready = t + command_ready_ms * 1000;
+		LOG("board %d ASIC ID read (%d of %d)\n", d->board, n,
+		    m->t.length);
+	} else {
+		word = (m->t.length == 4 &&
+			(d->state == R_COMMAND || d->state == R_SIZE));
+		m->t.actual_length = m->t.length;
+		if (d->state == R_LOADER)
+			loader_out(d, m->t.buffer, m->t.length, t);
+		else
+			rom_out(d, m->t.buffer, m->t.length, t);
+		/* taken just as the timeout fired */
+		if (word && late_take)
+			m->t.status = LIBUSB_TRANSFER_TIMED_OUT;
+	}
+	if (status == LIBUSB_TRANSFER_COMPLETED)
+		h->last_end[in] = t;
+	m->t.callback(&m->t);
+	if (m->t.flags & LIBUSB_TRANSFER_FREE_TRANSFER)
+		libusb_free_transfer(&m->t);
+}
+
+static void hotplug_call(libusb_device *d, libusb_hotplug_event event)
+{
+	int j;
+
+	for (j = 0; j < MAX_HOTPLUG; j++)
+		if (hotplug[j].used && (hotplug[j].events & event) &&
+		    (hotplug[j].vid == LIBUSB_HOTPLUG_MATCH_ANY ||
+		     hotplug[j].vid == d->vid) &&
+		    (hotplug[j].pid == LIBUSB_HOTPLUG_MATCH_ANY ||
+		     hotplug[j].pid == d->pid))
+			hotplug[j].fn(NULL, d, event, hotplug[j].user_data);
+}
+
+/**
+ * @brief hotplug_scan - report boards which came or left
+ *
+ * @param t - now, us
+ * @param next - gets when the next one does, -1 for never
+ *
+ * @return 1 if any was reported
+ */
+static int hotplug_scan(long long t, long long *next)
+{
+	int i, j, fired = 0;
+	libusb_device *d;
+
+	*next = -1;
+	for (j = 0; j < MAX_HOTPLUG && !hotplug[j].used; j++) ;
+	if (j == MAX_HOTPLUG)
+		return 0;
+	for (i = 0; i < num_devices; i++) {
+		d = &devices[i];
+		if (!d->announced && t >= d->appear) {
+			d->announced = fired = 1;
+			hotplug_call(d, LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED);
+		}
+		if (!d->left_announced && t >= d->gone) {
+			d->left_announced = fired = 1;
+			hotplug_call(d, LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT);
+		}
+		if (!d->announced && (*next < 0 || d->appear < *next))
+			*next = d->appear;
+		if (!d->left_announced && (*next < 0 || d->gone < *next))
+			*next = d->gone;
+	}
+	return fired;
+}
+
+/* one event per call: a transfer ends or boards come or leave */
+int libusb_handle_events_timeout_completed(libusb_context *ctx,
+					   struct timeval *tv, int *completed)
+{
+	long long until = now_us(), t, best, next, e;
+	struct mock_transfer *m, *o, *bm;
+	struct timespec ts;
+	int st, bst = 0;
+
+	until += tv ? tv->tv_sec * 1000000LL + tv->tv_usec : 60000000LL;
+	while (!(completed && *completed)) {
+		t = now_us();
+		if (hotplug_scan(t, &next))
+			return 0;
+		/* only the first in each endpoint queue can end */
+		best = -1;
+		bm = NULL;
+		for (m = queue; m; m = m->next) {
+			for (o = queue; o != m; o = o->next)
+				if (o->t.dev_handle == m->t.dev_handle &&
+				    o->t.endpoint == m->t.endpoint &&
+				    !m->cancelled)
+					break;
+			if (o != m)
+				continue;
+			e = head_time(m, &st);
+			if (e >= 0 && (best < 0 || e < best)) {
+				best = e;
+				bm = m;
+				bst = st;
+			}
+		}
+		if (bm && best <= t) {
+			complete(bm, bst, best);
+			return 0;
+		}
+		if (t >= until)
+			return 0;
+		if (!bm || best > until)
+			best = until;
+		if (next >= 0 && next < best)
+			best = next;
+		ts.tv_sec = (best - t) / 1000000;
+		ts.tv_nsec = ((best - t) % 1000000) * 1000;
+		nanosleep(&ts, NULL);
+	}
+	return 0;
+}
+
+int libusb_hotplug_register_callback(libusb_context *ctx, int events,
+				     int flags, int vendor_id, int product_id,
+				     int dev_class,
+				     libusb_hotplug_callback_fn cb_fn,
+				     void *user_data,
+				     libusb_hotplug_callback_handle *
+				     callback_handle)
+{
+	long long t = now_us();
+	int i, j;
+
+	if (no_hotplug)
+		return LIBUSB_ERROR_NOT_SUPPORTED;
+	for (j = 0; j < MAX_HOTPLUG && hotplug[j].used; j++) ;
+	if (j == MAX_HOTPLUG)
+		return LIBUSB_ERROR_NO_MEM;
+	hotplug[j].used = 1;
+	hotplug[j].fn = cb_fn;
+	hotplug[j].user_data = user_data;
+	hotplug[j].events = events;
+	hotplug[j].vid = vendor_id;
+	hotplug[j].pid = product_id;
+	if (callback_handle)
+		*callback_handle = j;
+	/* boards already there are only reported with ENUMERATE */
+	for (i = 0; i < num_devices; i++) {
+		if (t < devices[i].appear || devices[i].announced)
+			continue;
+		devices[i].announced = 1;
+		if ((flags & LIBUSB_HOTPLUG_ENUMERATE) &&
+		    present(&devices[i], t))
+			hotplug_call(&devices[i],
+				     LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED);
+	}
+	return 0;
+}
+
+void libusb_hotplug_deregister_callback(libusb_context *ctx,
+					libusb_hotplug_callback_handle
+					callback_handle)
+{
+	hotplug[callback_handle].used = 0;
+}
@@ -0,0 +1,126 @@
+#!/bin/sh
+#
+# Boot simulated boards with pusb built against tools/pusb/mockusb.c
+# (make usbtest), and check what they got
+#
+# (C) Copyright 2010
+# Texas Instruments, <www.ti.com>
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the
+# Free Software Foundation version 2.
+#
+# This program is distributed .as is. WITHOUT ANY WARRANTY of any kind,
+# whether express or implied; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+# General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 59 Temple Place, Suite 330, Boston,
+# MA 02111-1307 USA
+
+PUSB=${1:-./pusb_mock}
+TMP=`mktemp -d` || exit 1
+trap 'rm -rf "$TMP"' 0
+MOCK_OUT=$TMP/board
+export MOCK_OUT
+LOADER="-l 0451:d00e"
+failed=0
+
+# reset the mock settings and what the boards got
+fresh() {
+	unset MOCK_DEVICES MOCK_STAGGER_MS MOCK_SOC MOCK_LATE_TAKE \
+		MOCK_LOADER_PID MOCK_LOADER_CORRUPT MOCK_LOADER_NEVER
+	rm -f $TMP/board*
+}
+
+pass() {
+	echo "PASS: $1"
+}
+
+fail() {
+	echo "FAIL: $1"
+	failed=`expr $failed + 1`
+}
+
+# STATUS is what pusb exited with
+# expect NAME ok STATUS [BOARD FILE]... - pusb succeeded and each BOARD
+# file stored by the mock matches FILE
+# expect NAME fail STATUS MESSAGE - pusb failed, saying MESSAGE in log
+expect() {
+	name=$1
+	want=$2
+	got=$3
+	shift 3
+	if [ "$want" = ok ] && [ $got -ne 0 ]; then
+		fail "$name: pusb failed"
+		return
+	fi
+	if [ "$want" = fail ] && [ $got -eq 0 ]; then
+		fail "$name: pusb did not fail"
+		return
+	fi
+	if [ "$want" = fail ] && ! grep -q "$1" $TMP/log; then
+		fail "$name: no \"$1\" in `cat $TMP/log`"
+		return
+	fi
+	[ "$want" = fail ] && shift
+	while [ $# -gt 1 ]; do
+		if ! cmp -s $TMP/$1 $2; then
+			fail "$name: $1 differs from `basename $2`"
+			return
+		fi
+		shift 2
+	done
+	pass "$name"
+}
+
+dd if=/dev/urandom of=$TMP/rom.bin bs=1000 count=40 2>/dev/null
+dd if=/dev/urandom of=$TMP/image0.bin bs=1000 count=200 2>/dev/null
+dd if=/dev/urandom of=$TMP/image1.bin bs=1 count=4097 2>/dev/null
+
+fresh
+$PUSB -q -f $TMP/rom.bin
+expect "ROM stage" ok $? board0.bin $TMP/rom.bin
+
+fresh
+MOCK_DEVICES=4 MOCK_STAGGER_MS=50 MOCK_SOC=3430,3630,4430,4460 \
+	$PUSB -q -n 4 -f $TMP/rom.bin
+expect "ROM stage, 4 boards of 4 chips" ok $? \
+	board0.bin $TMP/rom.bin board1.bin $TMP/rom.bin \
+	board2.bin $TMP/rom.bin board3.bin $TMP/rom.bin
+
+fresh
+MOCK_LATE_TAKE=1 $PUSB -q -f $TMP/rom.bin
+expect "ROM stage, words taken as they time out" ok $? \
+	board0.bin $TMP/rom.bin
+
+fresh
+MOCK_LOADER_PID=0xd00e $PUSB -q -f $TMP/rom.bin $LOADER \
+	-s 80008000:$TMP/image0.bin -s 81000000:$TMP/image1.bin -j 80008000
+expect "second stage" ok $? board0.bin $TMP/rom.bin \
+	board0_0.bin $TMP/image0.bin board0_1.bin $TMP/image1.bin
+
+fresh
+MOCK_DEVICES=2 MOCK_LOADER_PID=0xd00e $PUSB -q -n 2 -f $TMP/rom.bin \
+	$LOADER -s 80008000:$TMP/image0.bin -j 80008000
+expect "second stage, 2 boards" ok $? \
+	board0_0.bin $TMP/image0.bin board1_0.bin $TMP/image0.bin
+
+fresh
+MOCK_LOADER_PID=0xd00e MOCK_LOADER_CORRUPT=1 $PUSB -q -f $TMP/rom.bin \
+	$LOADER -s 80008000:$TMP/image0.bin -s 81000000:$TMP/image1.bin \
+	-j 80008000 >$TMP/log 2>&1
+expect "second stage, CRC mismatch" fail $? "image1.bin: loader status 1"
+
+fresh
+MOCK_LOADER_PID=0xd00e MOCK_LOADER_NEVER=1 $PUSB -q -f $TMP/rom.bin \
+	$LOADER -s 80008000:$TMP/image0.bin >$TMP/log 2>&1
+expect "second stage, no loader" fail $? "no loader 0451:D00E"
+
+if [ $failed -ne 0 ]; then
+	echo "$failed test(s) failed"
+	exit 1
+fi
+echo "All tests passed"